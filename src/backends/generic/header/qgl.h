@@ -39,6 +39,8 @@
 #include <GL/gl.h>
 #endif
 
+#include <stddef.h>
+
 #ifndef APIENTRY
 #define APIENTRY
 #endif
@@ -49,6 +51,11 @@
 #define GL_POINT_SIZE_MAX_EXT 0x8127
 #define GL_DISTANCE_ATTENUATION_EXT 0x8129
 
+#ifndef GL_ARB_vertex_buffer_object
+#define GL_ARRAY_BUFFER_ARB 0x8892
+#define GL_STATIC_DRAW_ARB 0x88E4
+#endif
+
 #ifndef GL_EXT_texture_env_combine
 #define GL_COMBINE_EXT 0x8570
 #define GL_COMBINE_RGB_EXT 0x8571
@@ -111,5 +118,10 @@ extern void ( APIENTRY *qglPointParameterfvARB ) ( GLenum param,
 		const GLfloat *value );
 extern void ( APIENTRY *qglColorTableEXT ) ( GLenum, GLenum, GLsizei, GLenum,
 		GLenum, const GLvoid * );
+extern void ( APIENTRY *qglBindBufferARB ) ( GLenum target, GLuint buffer );
+extern void ( APIENTRY *qglDeleteBuffersARB ) ( GLsizei n, const GLuint *buffers );
+extern void ( APIENTRY *qglGenBuffersARB ) ( GLsizei n, GLuint *buffers );
+extern void ( APIENTRY *qglBufferDataARB ) ( GLenum target, ptrdiff_t size,
+		const GLvoid *data, GLenum usage );
 
 #endif
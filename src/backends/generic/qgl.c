@@ -42,6 +42,11 @@ void (APIENTRY *qglPointParameterfARB)(GLenum param, GLfloat value);
 void (APIENTRY *qglPointParameterfvARB)(GLenum param, const GLfloat *value);
 void (APIENTRY *qglColorTableEXT)(GLenum, GLenum, GLsizei, GLenum, GLenum,
 		const GLvoid *);
+void (APIENTRY *qglBindBufferARB)(GLenum target, GLuint buffer);
+void (APIENTRY *qglDeleteBuffersARB)(GLsizei n, const GLuint *buffers);
+void (APIENTRY *qglGenBuffersARB)(GLsizei n, GLuint *buffers);
+void (APIENTRY *qglBufferDataARB)(GLenum target, ptrdiff_t size,
+		const GLvoid *data, GLenum usage);
 
 /* ========================================================================= */
 
@@ -50,6 +55,10 @@ void QGL_EXT_Reset ( void )
 	qglPointParameterfARB     = NULL;
 	qglPointParameterfvARB    = NULL;
 	qglColorTableEXT          = NULL;
+	qglBindBufferARB          = NULL;
+	qglDeleteBuffersARB       = NULL;
+	qglGenBuffersARB          = NULL;
+	qglBufferDataARB          = NULL;
 }
 
 /* ========================================================================= */
@@ -42,6 +42,8 @@ main(int argc, char **argv)
 
 #ifndef BUSY_WAIT
 	struct timespec t;
+	cvar_t *sv_eventloop;
+	long long wait;
 #endif
 
 	/* register signal handler */
@@ -125,6 +127,10 @@ main(int argc, char **argv)
 	/* Do not delay reads on stdin*/
 	fcntl(fileno(stdin), F_SETFL, fcntl(fileno(stdin), F_GETFL, NULL) | FNDELAY);
 
+#ifndef BUSY_WAIT
+	sv_eventloop = Cvar_Get("sv_eventloop", "1", 0);
+#endif
+
 	oldtime = Sys_Milliseconds();
 	t.tv_sec = 0;
 
@@ -135,8 +141,21 @@ main(int argc, char **argv)
 		do
 		{
 #ifndef BUSY_WAIT
-			/* Sleep 10 microseconds */
-			t.tv_nsec = 10000;
+			if (dedicated && dedicated->value && sv_eventloop->value)
+			{
+				/* A dedicated server blocks in NET_Sleep() until
+				   a packet arrives or the next tick is due. Only
+				   the rest of this millisecond is left to sleep. */
+				wait = (long long)(oldtime + 1) * 1000 - Sys_Microseconds();
+				wait = wait < 0 ? 0 : (wait > 1000 ? 1000 : wait);
+				t.tv_nsec = (long)wait * 1000;
+			}
+			else
+			{
+				/* Sleep 10 microseconds */
+				t.tv_nsec = 10000;
+			}
+
 			nanosleep(&t, NULL);
 #endif
 
@@ -19,11 +19,19 @@
  *
  * =======================================================================
  *
- * Low level network code, based upon the BSD socket api.
+ * Low level network code, based upon the BSD socket api. Where
+ * recvmmsg() and sendmmsg() are available, the server socket is
+ * drained into a ring of packets with one call and outgoing server
+ * packets are queued until NET_FlushPackets().
  *
  * =======================================================================
  */
 
+/* For recvmmsg() and sendmmsg() - must be before sys/socket.h include! */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE
+#endif
+
 #include "../../common/header/common.h"
 
 #include <unistd.h>
@@ -44,6 +52,12 @@ netadr_t net_local_adr;
 #define MAX_LOOPBACK 4
 #define QUAKE2MCAST "ff12::666"
 
+#if defined(__linux__)
+ #define NET_MMSG
+#endif
+
+#define NET_BATCH 64 /* packets per recvmmsg() / sendmmsg() */
+
 typedef struct
 {
 	byte data[MAX_MSGLEN];
@@ -56,12 +70,40 @@ typedef struct
 	int get, send;
 } loopback_t;
 
+typedef struct
+{
+	byte data[MAX_MSGLEN];
+	int datalen;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+} netpacket_t;
+
+/* packets received ahead, per protocol */
+typedef struct
+{
+	netpacket_t packets[NET_BATCH];
+	int get, count;
+} netring_t;
+
 loopback_t loopbacks[2];
 int ip_sockets[2];
 int ip6_sockets[2];
 int ipx_sockets[2];
 char *multicast_interface = NULL;
 
+static cvar_t *net_batch;
+static netring_t net_rings[3];
+static netpacket_t net_queue[NET_BATCH];
+static int net_queuesockets[NET_BATCH];
+static int net_queued;
+
+/* the last resolved multicast destination */
+static struct sockaddr_in6 net_mcastfrom, net_mcastto;
+static qboolean net_mcastvalid;
+
+static int net_recvcalls, net_recvpackets;
+static int net_sendcalls, net_sendpackets;
+
 int NET_Socket(char *net_interface, int port, netsrc_t type, int family);
 char *NET_ErrorString(void);
 
@@ -182,9 +224,27 @@ SockadrToNetadr(struct sockaddr_storage *s, netadr_t *a)
 	}
 }
 
+static void
+NET_Stats_f(void)
+{
+	Com_Printf("received %i packets in %i calls, sent %i packets in %i calls\n",
+			net_recvpackets, net_recvcalls, net_sendpackets, net_sendcalls);
+#ifdef NET_MMSG
+	Com_Printf("batching %s\n", net_batch->value ? "on" : "off");
+#else
+	Com_Printf("batching not supported on this platform\n");
+#endif
+
+	net_recvcalls = net_recvpackets = 0;
+	net_sendcalls = net_sendpackets = 0;
+}
+
 void
 NET_Init()
 {
+	net_batch = Cvar_Get("net_batch", "1", 0);
+
+	Cmd_AddCommand("net_stats", NET_Stats_f);
 }
 
 qboolean
@@ -510,6 +570,57 @@ NET_SendLoopPacket(netsrc_t sock, int length, void *data, netadr_t to)
 	loop->msgs[i].datalen = length;
 }
 
+/*
+ * Reads as many packets as are waiting on the
+ * socket into the protocol's ring
+ */
+static void
+NET_FillRing(netring_t *ring, int net_socket)
+{
+#ifdef NET_MMSG
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iovs[NET_BATCH];
+	netpacket_t *p;
+	int i, ret;
+
+	for (i = 0, p = ring->packets; i < NET_BATCH; i++, p++)
+	{
+		iovs[i].iov_base = p->data;
+		iovs[i].iov_len = sizeof(p->data);
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_name = &p->addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(p->addr);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = recvmmsg(net_socket, msgs, NET_BATCH, MSG_DONTWAIT, NULL);
+	net_recvcalls++;
+
+	ring->get = 0;
+	ring->count = 0;
+
+	if (ret == -1)
+	{
+		if ((errno != EWOULDBLOCK) && (errno != ECONNREFUSED))
+		{
+			Com_Printf("NET_GetPacket: %s\n", NET_ErrorString());
+		}
+
+		return;
+	}
+
+	for (i = 0; i < ret; i++)
+	{
+		ring->packets[i].datalen = msgs[i].msg_len;
+		ring->packets[i].addrlen = msgs[i].msg_hdr.msg_namelen;
+	}
+
+	ring->count = ret;
+	net_recvpackets += ret;
+#endif
+}
+
 qboolean
 NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
@@ -519,12 +630,24 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 	int net_socket;
 	int protocol;
 	int err;
+	netring_t *ring;
+	netpacket_t *p;
 
 	if (NET_GetLoopPacket(sock, net_from, net_message))
 	{
 		return true;
 	}
 
+#ifdef NET_MMSG
+	/* packets read ahead before net_batch was
+	   toggled would be handed out late, drop them */
+	if (net_batch->modified && (sock == NS_SERVER))
+	{
+		net_batch->modified = false;
+		memset(net_rings, 0, sizeof(net_rings));
+	}
+#endif
+
 	for (protocol = 0; protocol < 3; protocol++)
 	{
 		if (protocol == 0)
@@ -545,9 +668,40 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 			continue;
 		}
 
+#ifdef NET_MMSG
+		if (net_batch->value && (sock == NS_SERVER))
+		{
+			ring = &net_rings[protocol];
+
+			if (ring->get >= ring->count)
+			{
+				NET_FillRing(ring, net_socket);
+			}
+
+			while (ring->get < ring->count)
+			{
+				p = &ring->packets[ring->get++];
+				SockadrToNetadr(&p->addr, net_from);
+
+				if (p->datalen >= net_message->maxsize)
+				{
+					Com_Printf("Oversize packet from %s\n", NET_AdrToString(*net_from));
+					continue;
+				}
+
+				memcpy(net_message->data, p->data, p->datalen);
+				net_message->cursize = p->datalen;
+				return true;
+			}
+
+			continue;
+		}
+#endif
+
 		fromlen = sizeof(from);
 		ret = recvfrom(net_socket, net_message->data, net_message->maxsize,
 				0, (struct sockaddr *)&from, &fromlen);
+		net_recvcalls++;
 
 		SockadrToNetadr(&from, net_from);
 
@@ -565,6 +719,8 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 			continue;
 		}
 
+		net_recvpackets++;
+
 		if (ret == net_message->maxsize)
 		{
 			Com_Printf("Oversize packet from %s\n", NET_AdrToString(*net_from));
@@ -578,6 +734,77 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 	return false;
 }
 
+/*
+ * Sends all queued server packets, one
+ * sendmmsg() per socket.
+ */
+void
+NET_FlushPackets(void)
+{
+#ifdef NET_MMSG
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iovs[NET_BATCH];
+	netpacket_t *p;
+	int first, i, count, sent, ret;
+	int net_socket;
+	qboolean done[NET_BATCH];
+
+	memset(done, 0, sizeof(done));
+
+	for (first = 0; first < net_queued; first++)
+	{
+		if (done[first])
+		{
+			continue;
+		}
+
+		/* gather everything for this socket */
+		net_socket = net_queuesockets[first];
+		count = 0;
+
+		for (i = first; i < net_queued; i++)
+		{
+			if (done[i] || (net_queuesockets[i] != net_socket))
+			{
+				continue;
+			}
+
+			p = &net_queue[i];
+			iovs[count].iov_base = p->data;
+			iovs[count].iov_len = p->datalen;
+			memset(&msgs[count].msg_hdr, 0, sizeof(msgs[count].msg_hdr));
+			msgs[count].msg_hdr.msg_name = &p->addr;
+			msgs[count].msg_hdr.msg_namelen = p->addrlen;
+			msgs[count].msg_hdr.msg_iov = &iovs[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+			count++;
+			done[i] = true;
+		}
+
+		/* a failed packet ends the call, skip it */
+		for (sent = 0; sent < count; )
+		{
+			ret = sendmmsg(net_socket, msgs + sent, count - sent, 0);
+			net_sendcalls++;
+
+			if (ret == -1)
+			{
+				Com_Printf("NET_SendPacket ERROR: %s\n", NET_ErrorString());
+				ret = 1;
+			}
+			else
+			{
+				net_sendpackets += ret;
+			}
+
+			sent += ret;
+		}
+	}
+#endif
+
+	net_queued = 0;
+}
+
 void
 NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 {
@@ -656,7 +883,13 @@ NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 
 		/* If multicast socket, must specify scope.
 		   So multicast_interface must be specified */
-		if (IN6_IS_ADDR_MULTICAST(&s6->sin6_addr))
+		if (IN6_IS_ADDR_MULTICAST(&s6->sin6_addr) && net_mcastvalid &&
+			!memcmp(s6, &net_mcastfrom, sizeof(net_mcastfrom)))
+		{
+			/* same destination as last time */
+			memcpy(s6, &net_mcastto, sizeof(net_mcastto));
+		}
+		else if (IN6_IS_ADDR_MULTICAST(&s6->sin6_addr))
 		{
 			struct addrinfo hints;
 			struct addrinfo *res;
@@ -705,7 +938,11 @@ NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 				}
 
 				/* sockaddr_in6 should now have a valid scope_id. */
+				memcpy(&net_mcastfrom, s6, sizeof(net_mcastfrom));
 				memcpy(s6, res->ai_addr, res->ai_addrlen);
+				memcpy(&net_mcastto, s6, sizeof(net_mcastto));
+				net_mcastvalid = true;
+				freeaddrinfo(res);
 			}
 			else
 			{
@@ -716,12 +953,32 @@ NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 		}
 	}
 
+#ifdef NET_MMSG
+	if (net_batch->value && (sock == NS_SERVER) && (length <= MAX_MSGLEN))
+	{
+		if (net_queued == NET_BATCH)
+		{
+			NET_FlushPackets();
+		}
+
+		memcpy(net_queue[net_queued].data, data, length);
+		net_queue[net_queued].datalen = length;
+		memcpy(&net_queue[net_queued].addr, &addr, sizeof(addr));
+		net_queue[net_queued].addrlen = addr_size;
+		net_queuesockets[net_queued] = net_socket;
+		net_queued++;
+		return;
+	}
+#endif
+
 	ret = sendto(net_socket,
 			data,
 			length,
 			0,
 			(struct sockaddr *)&addr,
 			addr_size);
+	net_sendcalls++;
+	net_sendpackets++;
 
 	if (ret == -1)
 	{
@@ -771,6 +1028,11 @@ NET_Config(qboolean multiplayer)
 {
 	int i;
 
+	/* nothing queued or read ahead
+	   may outlive the sockets */
+	NET_FlushPackets();
+	memset(net_rings, 0, sizeof(net_rings));
+
 	if (!multiplayer)
 	{
 		/* shut down any existing sockets */
@@ -989,6 +1251,9 @@ NET_Sleep(int msec)
 	extern cvar_t *dedicated;
 	extern qboolean stdin_active;
 
+	/* nothing queued waits out the sleep */
+	NET_FlushPackets();
+
 	if ((!ip_sockets[NS_SERVER] &&
 		 !ip6_sockets[NS_SERVER]) || (dedicated && !dedicated->value))
 	{
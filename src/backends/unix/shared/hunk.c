@@ -19,7 +19,9 @@
  *
  * =======================================================================
  *
- * This file implements the low level part of the Hunk_* memory system
+ * This file implements the low level part of the Hunk_* memory system.
+ * Every hunk is recorded with its name, reservation and final size, so
+ * that "hunklist" can show how much of the reservations is really used.
  *
  * =======================================================================
  */
@@ -46,19 +48,150 @@
  #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#define MAX_HUNKS 1024
+#define HUNK_HUGEPAGESIZE 0x200000
+#define HUNK_HUGEMIN 0x800000 /* only BSP hunks are this large */
+
+typedef struct
+{
+	char name[MAX_QPATH];
+	byte *base;
+	int reserved;
+	int used;
+	int mapped;
+	qboolean huge;
+} hunkinfo_t;
+
 byte *membase;
 int maxhunksize;
 int curhunksize;
 
+static qboolean hunkhuge;
+static hunkinfo_t *curhunk;
+static hunkinfo_t hunks[MAX_HUNKS];
+static int hunk_begins, hunk_frees;
+static cvar_t *hunk_hugepages;
+
+static void
+Hunk_List_f(void)
+{
+	hunkinfo_t *h;
+	int i, count, reserved, used, mapped;
+
+	count = reserved = used = mapped = 0;
+
+	Com_Printf("   reserved       used     mapped\n");
+
+	for (i = 0, h = hunks; i < MAX_HUNKS; i++, h++)
+	{
+		if (!h->base)
+		{
+			continue;
+		}
+
+		Com_Printf("%11i%11i%11i %s%s\n", h->reserved, h->used, h->mapped,
+				h->name, h->huge ? " (huge pages)" : "");
+
+		count++;
+		reserved += h->reserved;
+		used += h->used;
+		mapped += h->mapped;
+	}
+
+	Com_Printf("%i hunks, %i bytes used of %i reserved, %i mapped\n",
+			count, used, reserved, mapped);
+	Com_Printf("%i hunks allocated and %i freed since startup\n",
+			hunk_begins, hunk_frees);
+}
+
+static hunkinfo_t *
+Hunk_FindInfo(byte *base)
+{
+	int i;
+
+	for (i = 0; i < MAX_HUNKS; i++)
+	{
+		if (hunks[i].base == base)
+		{
+			return &hunks[i];
+		}
+	}
+
+	return NULL;
+}
+
+#ifdef MADV_HUGEPAGE
+/*
+ * Reserves a block aligned to the huge page size and asks
+ * for transparent huge pages. Big BSP hunks are walked all
+ * over by the renderer, so fewer TLB entries help there.
+ */
+static byte *
+Hunk_MapHuge(int size)
+{
+	byte *base, *aligned;
+	size_t lead, trail;
+
+	base = mmap(0, size + HUNK_HUGEPAGESIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (base == (byte *)-1)
+	{
+		return NULL;
+	}
+
+	aligned = (byte *)(((size_t)base + HUNK_HUGEPAGESIZE - 1) &
+			~((size_t)HUNK_HUGEPAGESIZE - 1));
+	lead = aligned - base;
+	trail = HUNK_HUGEPAGESIZE - lead;
+
+	if (lead)
+	{
+		munmap(base, lead);
+	}
+
+	if (trail)
+	{
+		munmap(aligned + size, trail);
+	}
+
+	madvise(aligned, size, MADV_HUGEPAGE);
+
+	return aligned;
+}
+#endif
+
+void
+Hunk_Init(void)
+{
+	hunk_hugepages = Cvar_Get("hunk_hugepages", "0", CVAR_ARCHIVE);
+	Cmd_AddCommand("hunklist", Hunk_List_f);
+}
+
 void *
-Hunk_Begin(int maxsize)
+Hunk_Begin(int maxsize, const char *name)
 {
 	/* reserve a huge chunk of memory, but don't commit any yet */
 	maxhunksize = maxsize + sizeof(int);
 	curhunksize = 0;
+	membase = NULL;
+	hunkhuge = false;
 
-	membase = mmap(0, maxhunksize, PROT_READ | PROT_WRITE,
-			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+	if (hunk_hugepages && hunk_hugepages->value && (maxhunksize >= HUNK_HUGEMIN))
+	{
+		maxhunksize = (maxhunksize + HUNK_HUGEPAGESIZE - 1) &
+			~(HUNK_HUGEPAGESIZE - 1);
+		membase = Hunk_MapHuge(maxhunksize);
+		hunkhuge = (membase != NULL);
+	}
+#endif
+
+	if (!membase)
+	{
+		membase = mmap(0, maxhunksize, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
 
 	if ((membase == NULL) || (membase == (byte *)-1))
 	{
@@ -67,6 +200,19 @@ Hunk_Begin(int maxsize)
 
 	*((int *)membase) = curhunksize;
 
+	hunk_begins++;
+	curhunk = Hunk_FindInfo(NULL);
+
+	if (curhunk)
+	{
+		Q_strlcpy(curhunk->name, name ? name : "?", sizeof(curhunk->name));
+		curhunk->base = membase;
+		curhunk->reserved = maxsize;
+		curhunk->used = 0;
+		curhunk->mapped = maxhunksize;
+		curhunk->huge = hunkhuge;
+	}
+
 	return membase + sizeof(int);
 }
 
@@ -92,12 +238,22 @@ int
 Hunk_End(void)
 {
 	byte *n = NULL;
+	int endsize;
+
+	endsize = curhunksize + sizeof(int);
+
+	/* don't split the last huge page */
+	if (hunkhuge)
+	{
+		endsize = (endsize + HUNK_HUGEPAGESIZE - 1) & ~(HUNK_HUGEPAGESIZE - 1);
+	}
 
 #if defined(__linux__)
-	n = (byte *)mremap(membase, maxhunksize, curhunksize + sizeof(int), 0);
+	/* shrinks in place, nothing is copied */
+	n = (byte *)mremap(membase, maxhunksize, endsize, 0);
 #elif defined(__FreeBSD__)
 	size_t old_size = maxhunksize;
-	size_t new_size = curhunksize + sizeof(int);
+	size_t new_size = endsize;
 	void *unmap_base;
 	size_t unmap_len;
 
@@ -121,7 +277,7 @@ Hunk_End(void)
  #endif
 
 	size_t old_size = maxhunksize;
-	size_t new_size = curhunksize + sizeof(int);
+	size_t new_size = endsize;
 	void *unmap_base;
 	size_t unmap_len;
 	long page_size;
@@ -152,7 +308,13 @@ Hunk_End(void)
 		Sys_Error("Hunk_End: Could not remap virtual block (%d)", errno);
 	}
 
-	*((int *)membase) = curhunksize + sizeof(int);
+	*((int *)membase) = endsize;
+
+	if (curhunk)
+	{
+		curhunk->used = curhunksize;
+		curhunk->mapped = endsize;
+	}
 
 	return curhunksize;
 }
@@ -160,12 +322,20 @@ Hunk_End(void)
 void
 Hunk_Free(void *base)
 {
+	hunkinfo_t *h;
 	byte *m;
 
 	if (base)
 	{
 		m = ((byte *)base) - sizeof(int);
 
+		if ((h = Hunk_FindInfo(m)) != NULL)
+		{
+			h->base = NULL;
+		}
+
+		hunk_frees++;
+
 		if (munmap(m, *((int *)m)))
 		{
 			Sys_Error("Hunk_Free: munmap failed (%d)", errno);
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -44,6 +45,7 @@
 #include <errno.h>
 #include <dlfcn.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include "../../common/header/common.h"
 #include "../../common/header/glob.h"
@@ -82,6 +84,13 @@ Sys_Init(void)
 int
 Sys_Milliseconds(void)
 {
+#ifdef CLOCK_MONOTONIC
+	/* same clock as Sys_Microseconds(), so that
+	   jumps of the wall clock don't disturb ticks */
+	curtime = (int)(Sys_Microseconds() / 1000);
+
+	return curtime;
+#else
 	struct timeval tp;
 	struct timezone tzp;
 	static int secbase;
@@ -97,6 +106,55 @@ Sys_Milliseconds(void)
 	curtime = (tp.tv_sec - secbase) * 1000 + tp.tv_usec / 1000;
 
 	return curtime;
+#endif
+}
+
+/*
+ * Monotonic time in microseconds since the first call. With
+ * CLOCK_MONOTONIC it is also the base of Sys_Milliseconds(),
+ * and so of game time, besides profiling and statistics.
+ */
+long long
+Sys_Microseconds(void)
+{
+	return Sys_Nanoseconds() / 1000;
+}
+
+/*
+ * Monotonic time in nanoseconds since the first call,
+ * for benchmarks of things that take less than a
+ * microsecond.
+ */
+long long
+Sys_Nanoseconds(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec now;
+	static struct timespec first;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (!first.tv_sec)
+	{
+		first = now;
+	}
+
+	return (long long)(now.tv_sec - first.tv_sec) * 1000000000 +
+		(now.tv_nsec - first.tv_nsec);
+#else
+	struct timeval now;
+	static struct timeval first;
+
+	gettimeofday(&now, NULL);
+
+	if (!first.tv_sec)
+	{
+		first = now;
+	}
+
+	return ((long long)(now.tv_sec - first.tv_sec) * 1000000 +
+		(now.tv_usec - first.tv_usec)) * 1000;
+#endif
 }
 
 void
@@ -559,3 +617,107 @@ Sys_RedirectStdout(void)
 {
 	return;
 }
+
+/* ======================================================================= */
+
+typedef struct
+{
+	pthread_t thread;
+	sysThreadFunc_t func;
+	void *arg;
+} sysThread_t;
+
+static void *
+Sys_ThreadMain(void *arg)
+{
+	sysThread_t *thread = arg;
+
+	thread->func(thread->arg);
+
+	return NULL;
+}
+
+void *
+Sys_CreateThread(sysThreadFunc_t func, void *arg)
+{
+	sysThread_t *thread;
+
+	thread = malloc(sizeof(sysThread_t));
+	thread->func = func;
+	thread->arg = arg;
+
+	if (pthread_create(&thread->thread, NULL, Sys_ThreadMain, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void
+Sys_WaitThread(void *thread)
+{
+	pthread_join(((sysThread_t *)thread)->thread, NULL);
+	free(thread);
+}
+
+void *
+Sys_CreateMutex(void)
+{
+	pthread_mutex_t *mutex;
+
+	mutex = malloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init(mutex, NULL);
+
+	return mutex;
+}
+
+void
+Sys_DestroyMutex(void *mutex)
+{
+	pthread_mutex_destroy(mutex);
+	free(mutex);
+}
+
+void
+Sys_LockMutex(void *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void
+Sys_UnlockMutex(void *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void *
+Sys_CreateCond(void)
+{
+	pthread_cond_t *cond;
+
+	cond = malloc(sizeof(pthread_cond_t));
+	pthread_cond_init(cond, NULL);
+
+	return cond;
+}
+
+void
+Sys_DestroyCond(void *cond)
+{
+	pthread_cond_destroy(cond);
+	free(cond);
+}
+
+void
+Sys_WaitCond(void *cond, void *mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+void
+Sys_BroadcastCond(void *cond)
+{
+	pthread_cond_broadcast(cond);
+}
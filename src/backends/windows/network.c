@@ -1209,6 +1209,14 @@ NET_Config(qboolean multiplayer)
 	}
 }
 
+/*
+ * Packets are sent right away here
+ */
+void
+NET_FlushPackets(void)
+{
+}
+
 /* 
  * sleeps msec or until
  * net socket is ready
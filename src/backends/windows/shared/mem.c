@@ -32,8 +32,14 @@ int hunkcount;
 int hunkmaxsize;
 int cursize;
 
+void
+Hunk_Init(void)
+{
+	/* nothing to register, no huge pages or statistics here */
+}
+
 void *
-Hunk_Begin(int maxsize)
+Hunk_Begin(int maxsize, const char *name)
 {
 	/* reserve a huge chunk of memory,
 	   but don't commit any yet */
@@ -25,6 +25,11 @@
  * =======================================================================
  */
 
+/* Condition variables need Vista */
+#ifndef _WIN32_WINNT
+ #define _WIN32_WINNT 0x0600
+#endif
+
 #include <errno.h>
 #include <float.h>
 #include <fcntl.h>
@@ -429,6 +434,45 @@ Sys_Milliseconds(void)
 	return curtime;
 }
 
+/*
+ * Monotonic time in microseconds since the first call, for
+ * profiling and statistics. Game time still comes from
+ * timeGetTime() in Sys_Milliseconds().
+ */
+long long
+Sys_Microseconds(void)
+{
+	return Sys_Nanoseconds() / 1000;
+}
+
+/*
+ * Monotonic time in nanoseconds since the first call,
+ * for benchmarks of things that take less than a
+ * microsecond.
+ */
+long long
+Sys_Nanoseconds(void)
+{
+	static LARGE_INTEGER freq;
+	static LARGE_INTEGER first;
+	LARGE_INTEGER now;
+	long long ticks;
+
+	if (!freq.QuadPart)
+	{
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&first);
+	}
+
+	QueryPerformanceCounter(&now);
+	ticks = now.QuadPart - first.QuadPart;
+
+	/* whole seconds first, ticks * 10^9 overflows
+	   after a few minutes */
+	return ticks / freq.QuadPart * 1000000000 +
+		ticks % freq.QuadPart * 1000000000 / freq.QuadPart;
+}
+
 void
 Sys_Sleep(int msec)
 {
@@ -852,3 +896,108 @@ Sys_GetProcAddress(void *handle, const char *sym)
 	return GetProcAddress(handle, sym);
 }
 
+
+/* ======================================================================= */
+
+typedef struct
+{
+	HANDLE thread;
+	sysThreadFunc_t func;
+	void *arg;
+} sysThread_t;
+
+static DWORD WINAPI
+Sys_ThreadMain(LPVOID arg)
+{
+	sysThread_t *thread = arg;
+
+	thread->func(thread->arg);
+
+	return 0;
+}
+
+void *
+Sys_CreateThread(sysThreadFunc_t func, void *arg)
+{
+	sysThread_t *thread;
+
+	thread = malloc(sizeof(sysThread_t));
+	thread->func = func;
+	thread->arg = arg;
+	thread->thread = CreateThread(NULL, 0, Sys_ThreadMain, thread, 0, NULL);
+
+	if (thread->thread == NULL)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void
+Sys_WaitThread(void *thread)
+{
+	WaitForSingleObject(((sysThread_t *)thread)->thread, INFINITE);
+	CloseHandle(((sysThread_t *)thread)->thread);
+	free(thread);
+}
+
+void *
+Sys_CreateMutex(void)
+{
+	CRITICAL_SECTION *mutex;
+
+	mutex = malloc(sizeof(CRITICAL_SECTION));
+	InitializeCriticalSection(mutex);
+
+	return mutex;
+}
+
+void
+Sys_DestroyMutex(void *mutex)
+{
+	DeleteCriticalSection(mutex);
+	free(mutex);
+}
+
+void
+Sys_LockMutex(void *mutex)
+{
+	EnterCriticalSection(mutex);
+}
+
+void
+Sys_UnlockMutex(void *mutex)
+{
+	LeaveCriticalSection(mutex);
+}
+
+void *
+Sys_CreateCond(void)
+{
+	CONDITION_VARIABLE *cond;
+
+	cond = malloc(sizeof(CONDITION_VARIABLE));
+	InitializeConditionVariable(cond);
+
+	return cond;
+}
+
+void
+Sys_DestroyCond(void *cond)
+{
+	free(cond);
+}
+
+void
+Sys_WaitCond(void *cond, void *mutex)
+{
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+void
+Sys_BroadcastCond(void *cond)
+{
+	WakeAllConditionVariable(cond);
+}
@@ -0,0 +1,645 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Headless timedemo. Replays a client demo through the client code the
+ * way timedemo does, one demo message per frame, but with the renderer,
+ * sound and input stubbed out. No window, GL context or audio device is
+ * needed. For every subsystem the time per frame is written to stdout as
+ * CSV, mean and percentiles in microseconds, one row per subsystem. The
+ * console output of the demo and everything else goes to stderr.
+ *
+ * Usage: q2demobench [options] [+set cvar value ...] demo
+ *
+ *  -passes <n>   replays of the demo (default 3)
+ *  -lag <n>      unacknowledged usercmds predicted per frame (default 6)
+ *
+ * The demo is read from demos/<demo>.dm2 in the search path.
+ *
+ * =======================================================================
+ */
+
+#include "../client/header/client.h"
+
+enum
+{
+	BENCH_PARSE,
+	BENCH_PREDICT,
+	BENCH_ENTITIES,
+	BENCH_TENTS,
+	BENCH_PARTICLES,
+	BENCH_LIGHTS,
+	BENCH_TOTAL,
+	BENCH_NUMTIMERS
+};
+
+static const char *bench_names[BENCH_NUMTIMERS] = {
+	"CL_ParseServerMessage",
+	"CL_PredictMovement",
+	"CL_AddPacketEntities",
+	"CL_AddTEnts",
+	"CL_AddParticles",
+	"CL_AddDLights",
+	"frame"
+};
+
+/* things the benchmark provides instead of
+   cl_main.c, misc.c and the refresh and sound */
+client_static_t cls;
+client_state_t cl;
+centity_t cl_entities[MAX_EDICTS];
+entity_state_t *cl_parse_entities;
+byte net_message_buffer[MAX_MSGLEN];
+sizebuf_t net_message;
+console_t con;
+viddef_t viddef;
+vrect_t scr_vrect;
+qboolean snd_is_underwater;
+
+cvar_t *cl_add_blend;
+cvar_t *cl_add_entities;
+cvar_t *cl_add_lights;
+cvar_t *cl_add_particles;
+cvar_t *cl_footsteps;
+cvar_t *cl_gun;
+cvar_t *cl_noskins;
+cvar_t *cl_paused;
+cvar_t *cl_predict;
+cvar_t *cl_showclamp;
+cvar_t *cl_showmiss;
+cvar_t *cl_shownet;
+cvar_t *cl_timedemo;
+cvar_t *cl_vwep;
+cvar_t *gl_stereo;
+cvar_t *hand;
+cvar_t *horplus;
+
+cvar_t *dedicated;
+cvar_t *portable;
+cvar_t *log_stats;
+FILE *log_stats_file;
+FILE *logfile;
+
+static int bench_passes = 3;
+static int bench_lag = 6;
+static long long *bench_samples[BENCH_NUMTIMERS];
+static int bench_numsamples;
+static int bench_maxsamples;
+
+/* stands in for every model, skin and
+   sound, the client never looks inside */
+static int bench_handle;
+
+/* stdout only gets the results */
+void
+Com_Printf(char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	vfprintf(stderr, fmt, argptr);
+	va_end(argptr);
+}
+
+void
+Com_DPrintf(char *fmt, ...)
+{
+}
+
+void
+Com_MDPrintf(char *fmt, ...)
+{
+}
+
+void
+Com_Error(int code, char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	fprintf(stderr, "Error: ");
+	vfprintf(stderr, fmt, argptr);
+	fprintf(stderr, "\n");
+	va_end(argptr);
+
+	exit(1);
+}
+
+int
+Com_ServerState(void)
+{
+	return 0;
+}
+
+void
+Qcommon_Shutdown(void)
+{
+}
+
+void
+CL_Shutdown(void)
+{
+}
+
+void
+CL_ClearState(void)
+{
+	CL_ClearEffects();
+	CL_ClearTEnts();
+
+	memset(&cl, 0, sizeof(cl));
+	memset(&cl_entities, 0, sizeof(cl_entities));
+}
+
+void
+CL_WriteDemoMessage(void)
+{
+}
+
+void
+CL_AddNetgraph(void)
+{
+}
+
+void
+CL_ParseInventory(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_ITEMS; i++)
+	{
+		cl.inventory[i] = MSG_ReadShort(&net_message);
+	}
+}
+
+void
+CL_ParseDownload(void)
+{
+	int size;
+
+	size = MSG_ReadShort(&net_message);
+	MSG_ReadByte(&net_message);
+
+	if (size > 0)
+	{
+		net_message.readcount += size;
+	}
+}
+
+void
+Cmd_ForwardToServer(void)
+{
+}
+
+/* refresh */
+
+void
+R_BeginRegistration(char *map)
+{
+}
+
+struct model_s *
+R_RegisterModel(char *name)
+{
+	return (struct model_s *)&bench_handle;
+}
+
+struct image_s *
+R_RegisterSkin(char *name)
+{
+	return (struct image_s *)&bench_handle;
+}
+
+struct image_s *
+Draw_FindPic(char *name)
+{
+	return (struct image_s *)&bench_handle;
+}
+
+void
+R_SetSky(char *name, float rotate, vec3_t axis)
+{
+}
+
+void
+R_EndRegistration(void)
+{
+}
+
+void
+R_RenderFrame(refdef_t *fd)
+{
+}
+
+/* sound */
+
+void
+S_BeginRegistration(void)
+{
+}
+
+struct sfx_s *
+S_RegisterSound(char *name)
+{
+	return (struct sfx_s *)&bench_handle;
+}
+
+void
+S_EndRegistration(void)
+{
+}
+
+void
+S_StartSound(vec3_t origin, int entnum, int entchannel, struct sfx_s *sfx,
+		float fvol, float attenuation, float timeofs)
+{
+}
+
+void
+S_StartLocalSound(char *sound)
+{
+}
+
+/* screen, console and input */
+
+void
+SCR_UpdateScreen(void)
+{
+}
+
+void
+SCR_AddDirtyPoint(int x, int y)
+{
+}
+
+void
+SCR_TouchPics(void)
+{
+}
+
+void
+SCR_PlayCinematic(char *name)
+{
+}
+
+void
+SCR_EndLoadingPlaque(void)
+{
+}
+
+void
+SCR_DrawCrosshair(void)
+{
+}
+
+void
+SCR_CenterPrint(char *str)
+{
+}
+
+void
+Con_ClearNotify(void)
+{
+}
+
+void
+IN_Update(void)
+{
+}
+
+/*
+ * Servers send "precache" once all configstrings
+ * are there, this is the part of CL_Precache_f()
+ * that doesn't download anything.
+ */
+static void
+Bench_Precache_f(void)
+{
+	unsigned checksum;
+
+	CM_LoadMap(cl.configstrings[CS_MODELS + 1], true, &checksum);
+	CL_RegisterSounds();
+	CL_PrepRefresh();
+}
+
+static void
+Bench_AddSample(int timer, long long nsec)
+{
+	int i;
+
+	if (timer == 0)
+	{
+		if (bench_numsamples == bench_maxsamples)
+		{
+			bench_maxsamples = bench_maxsamples ? bench_maxsamples * 2 : 4096;
+
+			for (i = 0; i < BENCH_NUMTIMERS; i++)
+			{
+				bench_samples[i] = realloc(bench_samples[i],
+						bench_maxsamples * sizeof(long long));
+
+				if (!bench_samples[i])
+				{
+					Com_Error(ERR_FATAL, "Out of memory");
+				}
+			}
+		}
+
+		bench_numsamples++;
+	}
+
+	bench_samples[timer][bench_numsamples - 1] = nsec;
+}
+
+/*
+ * Usercmds like a client with bench_lag of them
+ * in flight would have, so that prediction runs
+ */
+static void
+Bench_MakeCmd(int msec)
+{
+	usercmd_t *cmd;
+
+	cls.netchan.outgoing_sequence++;
+	cls.netchan.incoming_acknowledged = cls.netchan.outgoing_sequence - bench_lag;
+
+	cmd = &cl.cmds[cls.netchan.outgoing_sequence & (CMD_BACKUP - 1)];
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->msec = msec;
+	cmd->forwardmove = 200;
+	cmd->angles[YAW] = (short)(cls.netchan.outgoing_sequence * 64);
+}
+
+/*
+ * One frame of the client: a demo message
+ * is parsed and the scene is built
+ */
+static void
+Bench_Frame(void)
+{
+	long long start, now, first;
+	int msec;
+
+	first = start = Sys_Nanoseconds();
+	CL_ParseServerMessage();
+	Cbuf_Execute();
+	now = Sys_Nanoseconds();
+
+	if ((cls.state != ca_active) || !cl.refresh_prepped || !cl.frame.valid)
+	{
+		return;
+	}
+
+	Bench_AddSample(BENCH_PARSE, now - start);
+
+	/* timedemo shows every frame right when it arrives */
+	msec = cl.frame.servertime - cl.time;
+	msec = msec < 1 ? 1 : (msec > 250 ? 250 : msec);
+	cl.time = cl.frame.servertime;
+	cls.realtime += msec;
+	cls.rframetime = cls.nframetime = msec * 0.001f;
+
+	start = Sys_Nanoseconds();
+	Bench_MakeCmd(msec);
+	CL_PredictMovement();
+	now = Sys_Nanoseconds();
+	Bench_AddSample(BENCH_PREDICT, now - start);
+
+	start = now;
+	V_ClearScene();
+	CL_CalcLerpFrac();
+	CL_CalcViewValues();
+	CL_AddPacketEntities(&cl.frame);
+	now = Sys_Nanoseconds();
+	Bench_AddSample(BENCH_ENTITIES, now - start);
+
+	start = now;
+	CL_AddTEnts();
+	now = Sys_Nanoseconds();
+	Bench_AddSample(BENCH_TENTS, now - start);
+
+	start = now;
+	CL_AddParticles();
+	now = Sys_Nanoseconds();
+	Bench_AddSample(BENCH_PARTICLES, now - start);
+
+	start = now;
+	CL_AddDLights();
+	CL_AddLightStyles();
+	CL_RunDLights();
+	CL_RunLightStyles();
+	now = Sys_Nanoseconds();
+	Bench_AddSample(BENCH_LIGHTS, now - start);
+
+	Bench_AddSample(BENCH_TOTAL, now - first);
+}
+
+static int
+Bench_Replay(char *name)
+{
+	fileHandle_t f;
+	int len, frames;
+
+	if (FS_FOpenFile(va("demos/%s.dm2", name), &f, false) < 0)
+	{
+		return -1;
+	}
+
+	CL_ClearState();
+	cls.state = ca_connected;
+	cls.netchan.outgoing_sequence = cls.netchan.incoming_acknowledged = 0;
+	frames = bench_numsamples;
+
+	while (1)
+	{
+		if (FS_Read(&len, 4, f) != 4)
+		{
+			break;
+		}
+
+		len = LittleLong(len);
+
+		if ((len < 0) || (len > MAX_MSGLEN))
+		{
+			break;
+		}
+
+		SZ_Clear(&net_message);
+
+		if (FS_Read(net_message.data, len, f) != len)
+		{
+			break;
+		}
+
+		net_message.cursize = len;
+		net_message.readcount = 0;
+
+		Bench_Frame();
+	}
+
+	FS_FCloseFile(f);
+	cls.state = ca_disconnected;
+
+	return bench_numsamples - frames;
+}
+
+static int
+Bench_CompareSamples(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+Bench_Report(int timer)
+{
+	long long *s, total;
+	int i, n;
+
+	s = bench_samples[timer];
+	n = bench_numsamples;
+	total = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		total += s[i];
+	}
+
+	qsort(s, n, sizeof(long long), Bench_CompareSamples);
+
+	printf("%s,%.3f,%.3f,%.3f,%.3f,%.3f\n", bench_names[timer],
+			total / 1000.0 / n, s[n / 2] / 1000.0, s[n * 90 / 100] / 1000.0,
+			s[n * 99 / 100] / 1000.0, s[n - 1] / 1000.0);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *demoname = NULL;
+	int i, frames;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "+set"))
+		{
+			i += 2;
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-passes"))
+		{
+			bench_passes = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-lag"))
+		{
+			bench_lag = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if (argv[i][0] != '-')
+		{
+			demoname = argv[i];
+		}
+		else
+		{
+			demoname = NULL;
+			break;
+		}
+	}
+
+	if (!demoname || (bench_passes < 1) || (bench_lag < 1) ||
+		(bench_lag >= CMD_BACKUP))
+	{
+		fprintf(stderr, "Usage: %s [-passes n] [-lag n] "
+				"[+set cvar value ...] demo\n", argv[0]);
+		return 1;
+	}
+
+	/* just enough of Qcommon_Init() and CL_Init()
+	   for the filesystem, collision and the client */
+	COM_InitArgv(argc, argv);
+	Swap_Init();
+	Cbuf_Init();
+	Cmd_Init();
+	Cvar_Init();
+
+	Cbuf_AddEarlyCommands(false);
+	Cbuf_Execute();
+
+	dedicated = Cvar_Get("dedicated", "0", CVAR_NOSET);
+	portable = Cvar_Get("portable", "0", 0);
+	log_stats = Cvar_Get("log_stats", "0", 0);
+
+	cl_add_blend = Cvar_Get("cl_blend", "1", 0);
+	cl_add_lights = Cvar_Get("cl_lights", "1", 0);
+	cl_add_particles = Cvar_Get("cl_particles", "1", 0);
+	cl_add_entities = Cvar_Get("cl_entities", "1", 0);
+	cl_gun = Cvar_Get("cl_gun", "2", 0);
+	cl_footsteps = Cvar_Get("cl_footsteps", "1", 0);
+	cl_noskins = Cvar_Get("cl_noskins", "0", 0);
+	cl_predict = Cvar_Get("cl_predict", "1", 0);
+	cl_shownet = Cvar_Get("cl_shownet", "0", 0);
+	cl_showmiss = Cvar_Get("cl_showmiss", "0", 0);
+	cl_showclamp = Cvar_Get("showclamp", "0", 0);
+	cl_paused = Cvar_Get("paused", "0", 0);
+	cl_timedemo = Cvar_Get("timedemo", "1", 0);
+	cl_vwep = Cvar_Get("cl_vwep", "1", 0);
+	gl_stereo = Cvar_Get("gl_stereo", "0", 0);
+	hand = Cvar_Get("hand", "0", 0);
+	horplus = Cvar_Get("horplus", "1", 0);
+
+	FS_InitFilesystem();
+	CM_Init();
+
+	Cbuf_AddEarlyCommands(true);
+	Cbuf_Execute();
+
+	Cmd_AddCommand("precache", Bench_Precache_f);
+
+	SZ_Init(&net_message, net_message_buffer, sizeof(net_message_buffer));
+	viddef.width = 640;
+	viddef.height = 480;
+	scr_vrect.width = viddef.width;
+	scr_vrect.height = viddef.height;
+
+	frames = 0;
+
+	for (i = 0; i < bench_passes; i++)
+	{
+		if ((frames = Bench_Replay(demoname)) < 0)
+		{
+			Com_Error(ERR_FATAL, "Couldn't open demos/%s.dm2", demoname);
+		}
+	}
+
+	if (!bench_numsamples)
+	{
+		Com_Error(ERR_FATAL, "demos/%s.dm2 has no frames", demoname);
+	}
+
+	Com_Printf("\ndemos/%s.dm2, %i frames, %i passes, prediction of %i cmds\n",
+			demoname, frames, bench_passes, bench_lag);
+	printf("subsystem,mean_us,p50_us,p90_us,p99_us,max_us\n");
+
+	for (i = 0; i < BENCH_NUMTIMERS; i++)
+	{
+		Bench_Report(i);
+	}
+
+	return 0;
+}
@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Headless collision benchmark. Loads a map through the filesystem and
+ * CM_LoadMap(), links some fake entities into the server world and
+ * replays a generated or recorded set of traces, printing ns/op
+ * percentiles for the collision entry points. No renderer, network or
+ * game library is involved.
+ *
+ * Usage: q2bench [options] [+set cvar value ...] map
+ *
+ *  -count <n>    number of generated traces (default 100000)
+ *  -seed <n>     seed for the generator (default 1)
+ *  -ents <n>     number of entities linked for SV_Trace (default 64)
+ *  -batch <n>    operations per timed sample (default 16)
+ *  -passes <n>   passes over the trace set (default 3)
+ *  -load <file>  replay traces recorded with -save instead
+ *  -save <file>  write the generated traces to a file
+ *
+ * =======================================================================
+ */
+
+#include "../server/header/server.h"
+#include "../common/header/zone.h"
+
+typedef struct
+{
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	int mask;
+} benchtrace_t;
+
+enum
+{
+	BENCH_BOXTRACE,
+	BENCH_POINTCONTENTS,
+	BENCH_BOXLEAFNUMS,
+	BENCH_SVTRACE,
+	BENCH_LINKEDICT,
+	BENCH_FATPVS
+};
+
+/* things the benchmark provides instead
+   of misc.c, clientserver.c and sv_main.c */
+cvar_t *dedicated;
+cvar_t *portable;
+FILE *logfile;
+server_t sv;
+game_export_t *ge;
+
+static game_export_t bench_ge;
+static benchtrace_t *bench_traces;
+static int bench_count = 100000;
+static int bench_seed = 1;
+static int bench_ents = 64;
+static int bench_batch = 16;
+static int bench_passes = 3;
+static volatile int bench_sink; /* keeps the results alive */
+static byte bench_fatpvs[MAX_MAP_LEAFS / 8];
+
+void
+Com_Printf(char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	vprintf(fmt, argptr);
+	va_end(argptr);
+}
+
+void
+Com_DPrintf(char *fmt, ...)
+{
+}
+
+void
+Com_MDPrintf(char *fmt, ...)
+{
+}
+
+void
+Com_Error(int code, char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	fprintf(stderr, "Error: ");
+	vfprintf(stderr, fmt, argptr);
+	fprintf(stderr, "\n");
+	va_end(argptr);
+
+	exit(1);
+}
+
+int
+Com_ServerState(void)
+{
+	return 0;
+}
+
+void
+Qcommon_Shutdown(void)
+{
+}
+
+static float
+Bench_Random(float min, float max)
+{
+	return min + (float)rand() / RAND_MAX * (max - min);
+}
+
+/*
+ * A mix modelled after a busy deathmatch server: short
+ * player moves, long shots and position tests.
+ */
+static void
+Bench_GenerateTraces(void)
+{
+	static vec3_t boxes[3][2] = {
+		{{-16, -16, -24}, {16, 16, 32}},
+		{{-16, -16, -24}, {16, 16, 4}},
+		{{-4, -4, -4}, {4, 4, 4}}
+	};
+	benchtrace_t *t;
+	cmodel_t *world;
+	vec3_t dir;
+	float len;
+	int i, j;
+
+	world = sv.models[1];
+
+	for (i = 0, t = bench_traces; i < bench_count; i++, t++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			t->start[j] = Bench_Random(world->mins[j], world->maxs[j]);
+			dir[j] = Bench_Random(-1, 1);
+		}
+
+		VectorNormalize(dir);
+
+		switch (i & 3)
+		{
+			case 0:
+			case 1:
+				/* player movement */
+				len = Bench_Random(0, 64);
+				VectorCopy(boxes[i & 1][0], t->mins);
+				VectorCopy(boxes[i & 1][1], t->maxs);
+				t->mask = MASK_PLAYERSOLID;
+				break;
+			case 2:
+				/* shots */
+				len = 8192;
+				VectorClear(t->mins);
+				VectorClear(t->maxs);
+				t->mask = MASK_SHOT;
+				break;
+			default:
+				/* position tests */
+				len = 0;
+				VectorCopy(boxes[2][0], t->mins);
+				VectorCopy(boxes[2][1], t->maxs);
+				t->mask = MASK_SOLID;
+				break;
+		}
+
+		VectorMA(t->start, len, dir, t->end);
+	}
+}
+
+static qboolean
+Bench_LoadTraces(char *name)
+{
+	benchtrace_t *t;
+	char line[512];
+	FILE *f;
+	int n;
+
+	if ((f = fopen(name, "r")) == NULL)
+	{
+		return false;
+	}
+
+	bench_count = 0;
+
+	/* -save ends every trace with a newline, so a line
+	   without one or with fewer numbers was cut off */
+	while (fgets(line, sizeof(line), f))
+	{
+		if (!strchr(line, '\n') ||
+			(sscanf(line, "%*f %*f %*f %*f %*f %*f %*f %*f %*f %*f %*f %*f %d", &n) != 1))
+		{
+			fclose(f);
+			Com_Error(ERR_FATAL, "%s is truncated after %i traces", name, bench_count);
+		}
+
+		bench_count++;
+	}
+
+	if (bench_count < 1)
+	{
+		fclose(f);
+		Com_Error(ERR_FATAL, "%s has no traces", name);
+	}
+
+	bench_traces = Z_Malloc(bench_count * sizeof(benchtrace_t));
+	rewind(f);
+
+	for (n = 0, t = bench_traces; n < bench_count; n++, t++)
+	{
+		if (!fgets(line, sizeof(line), f) ||
+			(sscanf(line, "%f %f %f %f %f %f %f %f %f %f %f %f %d",
+				&t->start[0], &t->start[1], &t->start[2],
+				&t->end[0], &t->end[1], &t->end[2],
+				&t->mins[0], &t->mins[1], &t->mins[2],
+				&t->maxs[0], &t->maxs[1], &t->maxs[2], &t->mask) != 13))
+		{
+			fclose(f);
+			Com_Error(ERR_FATAL, "%s changed while reading it", name);
+		}
+	}
+
+	fclose(f);
+
+	return true;
+}
+
+static void
+Bench_SaveTraces(char *name)
+{
+	benchtrace_t *t;
+	FILE *f;
+	int i;
+
+	if ((f = fopen(name, "w")) == NULL)
+	{
+		Com_Printf("Couldn't write %s\n", name);
+		return;
+	}
+
+	for (i = 0, t = bench_traces; i < bench_count; i++, t++)
+	{
+		fprintf(f, "%.9g %.9g %.9g %.9g %.9g %.9g %g %g %g %g %g %g %d\n",
+				t->start[0], t->start[1], t->start[2],
+				t->end[0], t->end[1], t->end[2],
+				t->mins[0], t->mins[1], t->mins[2],
+				t->maxs[0], t->maxs[1], t->maxs[2], t->mask);
+	}
+
+	fclose(f);
+	Com_Printf("Wrote %i traces to %s\n", bench_count, name);
+}
+
+/*
+ * Scatters player sized boxes over the map and
+ * links them, so that SV_Trace has something to
+ * clip against besides the world.
+ */
+static void
+Bench_SpawnEntities(void)
+{
+	edict_t *ent;
+	cmodel_t *world;
+	int i, j;
+
+	bench_ge.edict_size = sizeof(edict_t);
+	bench_ge.num_edicts = bench_ents + 1;
+	bench_ge.max_edicts = bench_ents + 1;
+	bench_ge.edicts = Z_Malloc(bench_ge.max_edicts * sizeof(edict_t));
+	ge = &bench_ge;
+
+	SV_ClearWorld();
+
+	world = sv.models[1];
+
+	for (i = 1; i <= bench_ents; i++)
+	{
+		ent = EDICT_NUM(i);
+		ent->s.number = i;
+		ent->inuse = true;
+		ent->solid = SOLID_BBOX;
+
+		/* every eighth one is as large as a platform */
+		if (!(i & 7))
+		{
+			VectorSet(ent->mins, -128, -128, -16);
+			VectorSet(ent->maxs, 128, 128, 16);
+		}
+		else
+		{
+			VectorSet(ent->mins, -16, -16, -24);
+			VectorSet(ent->maxs, 16, 16, 32);
+		}
+
+		for (j = 0; j < 3; j++)
+		{
+			ent->s.origin[j] = Bench_Random(world->mins[j], world->maxs[j]);
+		}
+
+		SV_LinkEdict(ent);
+	}
+}
+
+static int
+Bench_CompareSamples(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+Bench_Run(char *name, int op)
+{
+	benchtrace_t *t;
+	long long *samples;
+	long long start, total;
+	int numsamples, numbatches;
+	int pass, b, i, j, first, last;
+	int leafs[64], topnode, rowbytes;
+	vec3_t mins, maxs;
+	trace_t tr;
+
+	rowbytes = ((CM_NumClusters() + 31) >> 5) << 2;
+	numbatches = (bench_count + bench_batch - 1) / bench_batch;
+	samples = Z_Malloc(numbatches * bench_passes * sizeof(long long));
+	numsamples = 0;
+	total = 0;
+
+	for (pass = 0; pass < bench_passes; pass++)
+	{
+		CM_ClearTraceCache();
+
+		for (b = 0; b < numbatches; b++)
+		{
+			first = b * bench_batch;
+			last = first + bench_batch < bench_count ? first + bench_batch : bench_count;
+
+			start = Sys_Nanoseconds();
+
+			for (i = first, t = &bench_traces[first]; i < last; i++, t++)
+			{
+				switch (op)
+				{
+					case BENCH_BOXTRACE:
+						tr = CM_BoxTrace(t->start, t->end, t->mins, t->maxs,
+								0, t->mask);
+						bench_sink += tr.contents;
+						break;
+					case BENCH_POINTCONTENTS:
+						bench_sink += CM_PointContents(t->start, 0);
+						break;
+					case BENCH_BOXLEAFNUMS:
+						VectorAdd(t->start, t->mins, mins);
+						VectorAdd(t->start, t->maxs, maxs);
+						bench_sink += CM_BoxLeafnums(mins, maxs, leafs, 64, &topnode);
+						break;
+					case BENCH_SVTRACE:
+						tr = SV_Trace(t->start, t->mins, t->maxs, t->end,
+								NULL, t->mask);
+						bench_sink += tr.contents;
+						break;
+					case BENCH_LINKEDICT:
+						/* relinking without moving, like most
+						   gi.linkentity() calls in a frame */
+						if (bench_ents)
+						{
+							SV_LinkEdict(EDICT_NUM(i % bench_ents + 1));
+						}
+						break;
+					case BENCH_FATPVS:
+						/* the merge SV_FatPVS does for every client */
+						for (j = 0; j < 3; j++)
+						{
+							mins[j] = t->start[j] - 8;
+							maxs[j] = t->start[j] + 8;
+						}
+
+						topnode = CM_BoxLeafnums(mins, maxs, leafs, 64, NULL);
+						memcpy(bench_fatpvs, CM_ClusterPVS(CM_LeafCluster(leafs[0])), rowbytes);
+
+						for (j = 1; j < topnode; j++)
+						{
+							CM_OrVis(bench_fatpvs, CM_ClusterPVS(CM_LeafCluster(leafs[j])), rowbytes);
+						}
+
+						bench_sink += bench_fatpvs[0];
+						break;
+				}
+			}
+
+			start = Sys_Nanoseconds() - start;
+			total += start;
+			samples[numsamples++] = start / (last - first);
+		}
+
+		SV_EndLinkFrame();
+	}
+
+	qsort(samples, numsamples, sizeof(long long), Bench_CompareSamples);
+
+	Com_Printf("%-18s %8lld %8lld %8lld %8lld %8lld\n", name,
+			total / ((long long)bench_count * bench_passes),
+			samples[numsamples / 2], samples[numsamples * 90 / 100],
+			samples[numsamples * 99 / 100], samples[numsamples - 1]);
+
+	Z_Free(samples);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *mapname = NULL;
+	char *loadname = NULL;
+	char *savename = NULL;
+	unsigned checksum;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "+set"))
+		{
+			i += 2;
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-count"))
+		{
+			bench_count = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-seed"))
+		{
+			bench_seed = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-ents"))
+		{
+			bench_ents = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-batch"))
+		{
+			bench_batch = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-passes"))
+		{
+			bench_passes = (int)strtol(argv[++i], (char **)NULL, 10);
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-load"))
+		{
+			loadname = argv[++i];
+		}
+		else if ((i + 1 < argc) && !strcmp(argv[i], "-save"))
+		{
+			savename = argv[++i];
+		}
+		else if (argv[i][0] != '-')
+		{
+			mapname = argv[i];
+		}
+		else
+		{
+			mapname = NULL;
+			break;
+		}
+	}
+
+	if (!mapname || (bench_count < 1) || (bench_batch < 1) ||
+		(bench_passes < 1) || (bench_ents < 0) || (bench_ents > MAX_EDICTS - 1))
+	{
+		printf("Usage: %s [-count n] [-seed n] [-ents n] [-batch n] [-passes n]\n"
+			   "       [-load file] [-save file] [+set cvar value ...] map\n", argv[0]);
+		return 1;
+	}
+
+	/* just enough of Qcommon_Init() for
+	   the filesystem and the collision code */
+	COM_InitArgv(argc, argv);
+	Swap_Init();
+	Cbuf_Init();
+	Cmd_Init();
+	Cvar_Init();
+
+	Cbuf_AddEarlyCommands(false);
+	Cbuf_Execute();
+
+	dedicated = Cvar_Get("dedicated", "1", CVAR_NOSET);
+	portable = Cvar_Get("portable", "0", 0);
+
+	/* the world cvars SV_Init() registers */
+	sv_areagrid = Cvar_Get("sv_areagrid", "0", CVAR_LATCH);
+	sv_linkcache = Cvar_Get("sv_linkcache", "1", 0);
+
+	FS_InitFilesystem();
+	CM_Init();
+
+	sv.models[1] = CM_LoadMap(va("maps/%s.bsp", mapname), false, &checksum);
+	sv.state = ss_game;
+
+	srand(bench_seed);
+
+	if (loadname)
+	{
+		if (!Bench_LoadTraces(loadname))
+		{
+			Com_Error(ERR_FATAL, "Couldn't read %s", loadname);
+		}
+	}
+	else
+	{
+		bench_traces = Z_Malloc(bench_count * sizeof(benchtrace_t));
+		Bench_GenerateTraces();
+	}
+
+	if (savename)
+	{
+		Bench_SaveTraces(savename);
+	}
+
+	Bench_SpawnEntities();
+
+	Com_Printf("\nmaps/%s.bsp, checksum %u, %i traces, %i entities, cm_simd %g, cm_tracecache %g\n",
+			mapname, checksum, bench_count, bench_ents,
+			Cvar_VariableValue("cm_simd"), Cvar_VariableValue("cm_tracecache"));
+	Cmd_ExecuteString("cm_visinfo");
+	Com_Printf("%i passes, %i ops per sample, all times in ns/op\n\n",
+			bench_passes, bench_batch);
+	Com_Printf("%-18s %8s %8s %8s %8s %8s\n", "", "mean", "p50", "p90", "p99", "max");
+
+	Bench_Run("CM_BoxTrace", BENCH_BOXTRACE);
+	Bench_Run("CM_PointContents", BENCH_POINTCONTENTS);
+	Bench_Run("CM_BoxLeafnums", BENCH_BOXLEAFNUMS);
+	Bench_Run("SV_Trace", BENCH_SVTRACE);
+	Bench_Run("SV_LinkEdict", BENCH_LINKEDICT);
+	Bench_Run("fat PVS", BENCH_FATPVS);
+
+	Com_Printf("\n");
+	SV_AreaStats_f();
+
+	return 0;
+}
@@ -53,6 +53,7 @@ CL_RequestNextDownload(void)
 	unsigned int map_checksum; /* for detecting cheater maps */
 	char fn[MAX_OSPATH];
 	dmdl_t *pheader;
+	int i;
 
 	if (cls.state != ca_connected)
 	{
@@ -350,6 +351,12 @@ CL_RequestNextDownload(void)
 					map_checksum, cl.configstrings[CS_MAPCHECKSUM]);
 			return;
 		}
+
+		/* the map's textures are known now, read them ahead */
+		for (i = 0; i < numtexinfo; i++)
+		{
+			FS_Prefetch(va("textures/%s.wal", map_surfaces[i].rname));
+		}
 	}
 
 	if ((precache_check > ENV_CNT) && (precache_check < TEXTURE_CNT))
@@ -390,9 +397,6 @@ CL_RequestNextDownload(void)
 	/* confirm existance of textures, download any that don't exist */
 	if (precache_check == TEXTURE_CNT + 1)
 	{
-		extern int numtexinfo;
-		extern mapsurface_t map_surfaces[];
-
 		if (allow_download->value && allow_download_maps->value)
 		{
 			while (precache_tex < numtexinfo)
@@ -412,10 +416,15 @@ CL_RequestNextDownload(void)
 		precache_check = TEXTURE_CNT + 999;
 	}
 
+	FS_LoadPhase("sounds");
 	CL_RegisterSounds();
 
+	FS_LoadPhase("refresh");
 	CL_PrepRefresh();
 
+	FS_StopLoadTiming();
+	FS_PrefetchFlush();
+
 	MSG_WriteByte(&cls.netchan.message, clc_stringcmd);
 	MSG_WriteString(&cls.netchan.message, va("begin %i\n", precache_spawncount));
 	cls.forcePacket = true;
@@ -107,6 +107,16 @@ CL_AddPacketEntities(frame_t *frame)
 	int autoanim;
 	clientinfo_t *ci;
 	unsigned int effects, renderfx;
+	int maxclients;
+
+	/* players move in every frame, even when the game
+	   runs slower than the server sends frames */
+	maxclients = cl.maxclients;
+
+	if (maxclients < 1)
+	{
+		maxclients = MAX_CLIENTS;
+	}
 
 	/* bonus items rotate at a fixed rate */
 	autorotate = anglemod(cl.time * 0.1f);
@@ -179,8 +189,8 @@ CL_AddPacketEntities(frame_t *frame)
 			renderfx |= RF_SHELL_HALF_DAM;
 		}
 
-		ent.oldframe = cent->prev.frame;
-		ent.backlerp = 1.0f - cl.lerpfrac;
+		ent.oldframe = cent->gameprev.frame;
+		ent.backlerp = 1.0f - cl.gamelerpfrac;
 
 		if (renderfx & (RF_FRAMELERP | RF_BEAM))
 		{
@@ -189,7 +199,7 @@ CL_AddPacketEntities(frame_t *frame)
 			VectorCopy(cent->current.origin, ent.origin);
 			VectorCopy(cent->current.old_origin, ent.oldorigin);
 		}
-		else
+		else if ((s1->number <= maxclients) || cent->subframes)
 		{
 			/* interpolate origin */
 			for (i = 0; i < 3; i++)
@@ -198,6 +208,15 @@ CL_AddPacketEntities(frame_t *frame)
 				   	(cent->current.origin[i] - cent->prev.origin[i]);
 			}
 		}
+		else
+		{
+			/* the game moves everything else */
+			for (i = 0; i < 3; i++)
+			{
+				ent.origin[i] = ent.oldorigin[i] = cent->gameprev.origin[i] + cl.gamelerpfrac *
+				   	(cent->current.origin[i] - cent->gameprev.origin[i]);
+			}
+		}
 
 		/* tweak the color of beams */
 		if (renderfx & RF_BEAM)
@@ -294,14 +313,24 @@ CL_AddPacketEntities(frame_t *frame)
 		}
 		else
 		{
-			/* interpolate angles */
+			/* interpolate angles, the game turns players
+			   in game frames and missiles in every frame */
 			float a1, a2;
 
 			for (i = 0; i < 3; i++)
 			{
 				a1 = cent->current.angles[i];
-				a2 = cent->prev.angles[i];
-				ent.angles[i] = LerpAngle(a2, a1, cl.lerpfrac);
+
+				if (cent->subframes && (s1->number > maxclients))
+				{
+					a2 = cent->prev.angles[i];
+					ent.angles[i] = LerpAngle(a2, a1, cl.lerpfrac);
+				}
+				else
+				{
+					a2 = cent->gameprev.angles[i];
+					ent.angles[i] = LerpAngle(a2, a1, cl.gamelerpfrac);
+				}
 			}
 		}
 
@@ -675,9 +704,9 @@ CL_AddViewWeapon(player_state_t *ps, player_state_t *ops)
 	for (i = 0; i < 3; i++)
 	{
 		gun.origin[i] = cl.refdef.vieworg[i] + ops->gunoffset[i]
-			+ cl.lerpfrac * (ps->gunoffset[i] - ops->gunoffset[i]);
+			+ cl.gamelerpfrac * (ps->gunoffset[i] - ops->gunoffset[i]);
 		gun.angles[i] = cl.refdef.viewangles[i] + LerpAngle(ops->gunangles[i],
-			ps->gunangles[i], cl.lerpfrac);
+			ps->gunangles[i], cl.gamelerpfrac);
 	}
 
 	if (gun_frame)
@@ -700,7 +729,7 @@ CL_AddViewWeapon(player_state_t *ps, player_state_t *ops)
 	}
 
 	gun.flags = RF_MINLIGHT | RF_DEPTHHACK | RF_WEAPONMODEL;
-	gun.backlerp = 1.0f - cl.lerpfrac;
+	gun.backlerp = 1.0f - cl.gamelerpfrac;
 	VectorCopy(gun.origin, gun.oldorigin); /* don't lerp at all */
 	V_AddEntity(&gun);
 }
@@ -727,6 +756,28 @@ AdaptFov(float fov, float w, float h)
 	return (atanf(tanf(fov / 360.0f * pi) * (w / h * 0.75f)) / pi * 360.0f);
 }
 
+/*
+ * Returns the frame to lerp from for what only the game
+ * changes, the one before the last game frame. Above 10 Hz
+ * these values stay the same in the frames in between.
+ */
+frame_t *
+CL_GameOldFrame(void)
+{
+	frame_t *oldframe;
+	int num;
+
+	num = cl.frame.serverframe - 1 - cl.frame.serverframe % (cl.framerate / 10);
+	oldframe = &cl.frames[num & (cl.update_backup - 1)];
+
+	if ((oldframe->serverframe != num) || !oldframe->valid)
+	{
+		oldframe = &cl.frame; /* dropped or invalid */
+	}
+
+	return oldframe;
+}
+
 /*
  * Sets cl.refdef view values
  */
@@ -734,13 +785,13 @@ void
 CL_CalcViewValues(void)
 {
 	int i;
-	float lerp, backlerp, ifov;
+	float lerp, gamelerp, backlerp, ifov;
 	frame_t *oldframe;
-	player_state_t *ps, *ops;
+	player_state_t *ps, *ops, *gameops;
 
 	/* find the previous frame to interpolate from */
 	ps = &cl.frame.playerstate;
-	i = (cl.frame.serverframe - 1) & UPDATE_MASK;
+	i = (cl.frame.serverframe - 1) & (cl.update_backup - 1);
 	oldframe = &cl.frames[i];
 
 	if ((oldframe->serverframe != cl.frame.serverframe - 1) || !oldframe->valid)
@@ -749,6 +800,7 @@ CL_CalcViewValues(void)
 	}
 
 	ops = &oldframe->playerstate;
+	gameops = &CL_GameOldFrame()->playerstate;
 
 	/* see if the player entity was teleported this frame */
 	if ((abs(ops->pmove.origin[0] - ps->pmove.origin[0]) > 256 * 8) ||
@@ -756,14 +808,17 @@ CL_CalcViewValues(void)
 		(abs(ops->pmove.origin[2] - ps->pmove.origin[2]) > 256 * 8))
 	{
 		ops = ps; /* don't interpolate */
+		gameops = ps;
 	}
 
 	if(cl_paused->value){
 		lerp = 1.0f;
+		gamelerp = 1.0f;
 	}
 	else
 	{
 		lerp = cl.lerpfrac;
+		gamelerp = cl.gamelerpfrac;
 	}
 
 	/* calculate the origin */
@@ -776,8 +831,8 @@ CL_CalcViewValues(void)
 
 		for (i = 0; i < 3; i++)
 		{
-			cl.refdef.vieworg[i] = cl.predicted_origin[i] + ops->viewoffset[i]
-				+ cl.lerpfrac * (ps->viewoffset[i] - ops->viewoffset[i])
+			cl.refdef.vieworg[i] = cl.predicted_origin[i] + gameops->viewoffset[i]
+				+ cl.gamelerpfrac * (ps->viewoffset[i] - gameops->viewoffset[i])
 				- backlerp * cl.prediction_error[i];
 		}
 
@@ -795,9 +850,9 @@ CL_CalcViewValues(void)
 		for (i = 0; i < 3; i++)
 		{
 			cl.refdef.vieworg[i] = ops->pmove.origin[i] * 0.125 +
-				ops->viewoffset[i] + lerp * (ps->pmove.origin[i] * 0.125 +
-						ps->viewoffset[i] - (ops->pmove.origin[i] * 0.125 +
-							ops->viewoffset[i]));
+				lerp * (ps->pmove.origin[i] - ops->pmove.origin[i]) * 0.125 +
+				gameops->viewoffset[i] + gamelerp * (ps->viewoffset[i] -
+						gameops->viewoffset[i]);
 		}
 	}
 
@@ -822,14 +877,14 @@ CL_CalcViewValues(void)
 
 	for (i = 0; i < 3; i++)
 	{
-		cl.refdef.viewangles[i] += LerpAngle(ops->kick_angles[i],
-				ps->kick_angles[i], lerp);
+		cl.refdef.viewangles[i] += LerpAngle(gameops->kick_angles[i],
+				ps->kick_angles[i], gamelerp);
 	}
 
 	AngleVectors(cl.refdef.viewangles, cl.v_forward, cl.v_right, cl.v_up);
 
 	/* interpolate field of view */
-	ifov = ops->fov + lerp * (ps->fov - ops->fov);
+	ifov = gameops->fov + gamelerp * (ps->fov - gameops->fov);
 	if (horplus->value)
 	{
 		cl.refdef.fov_x = AdaptFov(ifov, cl.refdef.width, cl.refdef.height);
@@ -846,19 +901,17 @@ CL_CalcViewValues(void)
 	}
 
 	/* add the weapon */
-	CL_AddViewWeapon(ps, ops);
+	CL_AddViewWeapon(ps, gameops);
 }
 
 /*
- * Emits all entities, particles, and lights to the refresh
+ * Clamps cl.time into the current frame
+ * and sets the interpolation fraction
  */
 void
-CL_AddEntities(void)
+CL_CalcLerpFrac(void)
 {
-	if (cls.state != ca_active)
-	{
-		return;
-	}
+	int gameframe;
 
 	if (cl.time > cl.frame.servertime)
 	{
@@ -870,26 +923,59 @@ CL_AddEntities(void)
 		cl.time = cl.frame.servertime;
 		cl.lerpfrac = 1.0;
 	}
-	else if (cl.time < cl.frame.servertime - 100)
+	else if (cl.time < cl.frame.servertime - cl.frametime)
 	{
 		if (cl_showclamp->value)
 		{
-			Com_Printf("low clamp %i\n", cl.frame.servertime - 100 - cl.time);
+			Com_Printf("low clamp %i\n",
+					cl.frame.servertime - cl.frametime - cl.time);
 		}
 
-		cl.time = cl.frame.servertime - 100;
+		cl.time = cl.frame.servertime - cl.frametime;
 		cl.lerpfrac = 0;
 	}
 	else
 	{
-		cl.lerpfrac = 1.0 - (cl.frame.servertime - cl.time) * 0.01f;
+		cl.lerpfrac = 1.0f - (cl.frame.servertime - cl.time) /
+			(float)cl.frametime;
+	}
+
+	/* what only the game changes lerps over the 100 msec
+	   after the frame before the last game frame, at
+	   10 Hz that's the same as lerpfrac */
+	gameframe = cl.frame.serverframe - 1 -
+		cl.frame.serverframe % (cl.framerate / 10);
+	cl.gamelerpfrac = (cl.time - (int)((long long)gameframe * 1000 /
+				cl.framerate)) * 0.01f;
+
+	if (cl.gamelerpfrac < 0)
+	{
+		cl.gamelerpfrac = 0;
+	}
+	else if (cl.gamelerpfrac > 1.0f)
+	{
+		cl.gamelerpfrac = 1.0f;
 	}
 
 	if (cl_timedemo->value)
 	{
 		cl.lerpfrac = 1.0;
+		cl.gamelerpfrac = 1.0;
+	}
+}
+
+/*
+ * Emits all entities, particles, and lights to the refresh
+ */
+void
+CL_AddEntities(void)
+{
+	if (cls.state != ca_active)
+	{
+		return;
 	}
 
+	CL_CalcLerpFrac();
 	CL_CalcViewValues();
 	CL_AddPacketEntities(&cl.frame);
 	CL_AddTEnts();
@@ -96,7 +96,7 @@ client_state_t cl;
 
 centity_t cl_entities[MAX_EDICTS];
 
-entity_state_t cl_parse_entities[MAX_PARSE_ENTITIES];
+entity_state_t *cl_parse_entities;
 
 extern cvar_t *allow_download;
 extern cvar_t *allow_download_players;
@@ -197,7 +197,7 @@ CL_Record_f(void)
 
 	/* send the serverdata */
 	MSG_WriteByte(&buf, svc_serverdata);
-	MSG_WriteLong(&buf, PROTOCOL_VERSION);
+	MSG_WriteLong(&buf, PROTOCOL_FRAMERATE(cl.framerate));
 	MSG_WriteLong(&buf, 0x10000 + cl.servercount);
 	MSG_WriteByte(&buf, 1);  /* demos are always attract loops */
 	MSG_WriteString(&buf, cl.gamedir);
@@ -445,14 +445,25 @@ byte *precache_model;
 void
 CL_Precache_f(void)
 {
+	FS_StartLoadTiming();
+	FS_LoadPhase("precache");
+
+	/* all configstrings are known, start reading
+	   everything ahead that's going to be loaded */
+	FS_PrefetchConfigstrings(cl.configstrings);
+
 	/* Yet another hack to let old demos work */
 	if (Cmd_Argc() < 2)
 	{
 		unsigned map_checksum;    /* for detecting cheater maps */
 
 		CM_LoadMap(cl.configstrings[CS_MODELS + 1], true, &map_checksum);
+		FS_LoadPhase("sounds");
 		CL_RegisterSounds();
+		FS_LoadPhase("refresh");
 		CL_PrepRefresh();
+		FS_StopLoadTiming();
+		FS_PrefetchFlush();
 		return;
 	}
 
@@ -843,10 +854,14 @@ CL_Frame(int msec)
 		return;
 	}
 
+	PROF_BEGIN("CL_Frame");
+
 	// Update input stuff
 	if (packetframe || renderframe)
 	{
+		PROF_BEGIN("CL_ReadPackets");
 		CL_ReadPackets();
+		PROF_END();
 		CL_UpdateWindowedMouse();
 		Sys_SendKeyEvents();
 		Cbuf_Execute();
@@ -872,8 +887,10 @@ CL_Frame(int msec)
 	{
 		packetdelta = 0;
 
+		PROF_BEGIN("CL_SendCmd");
 		CL_SendCmd();
 		CL_CheckForResend();
+		PROF_END();
 	}
 
 	if (renderframe)
@@ -900,7 +917,9 @@ CL_Frame(int msec)
 			time_before_ref = Sys_Milliseconds();
 		}
 
+		PROF_BEGIN("SCR_UpdateScreen");
 		SCR_UpdateScreen();
+		PROF_END();
 
 		if (host_speeds->value)
 		{
@@ -908,7 +927,9 @@ CL_Frame(int msec)
 		}
 
 		/* update audio */
+		PROF_BEGIN("S_Update");
 		S_Update(cl.refdef.vieworg, cl.v_forward, cl.v_right, cl.v_up);
+		PROF_END();
 
 #ifdef CDA
 		if (miscframe)
@@ -954,6 +975,8 @@ CL_Frame(int msec)
 			}
 		}
 	}
+
+	PROF_END();
 }
 
 void
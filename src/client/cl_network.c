@@ -354,6 +354,9 @@ CL_Disconnect(void)
 		cls.download = NULL;
 	}
 
+	/* and the timing of the load, if it was interrupted */
+	FS_StopLoadTiming();
+
 	cls.state = ca_disconnected;
 
 	snd_is_underwater = false;
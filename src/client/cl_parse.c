@@ -322,11 +322,26 @@ CL_DeltaEntity(frame_t *frame, int newnum, entity_state_t *old, int bits)
 			VectorCopy(state->old_origin, ent->prev.origin);
 			VectorCopy(state->old_origin, ent->lerp_origin);
 		}
+
+		ent->gameprev = ent->prev;
+		ent->subframes = false;
 	}
 	else
 	{
 		/* shuffle the last state to previous */
 		ent->prev = ent->current;
+
+		/* above 10 Hz only players and missiles move between
+		   game frames, everything else lerps over the whole
+		   100 msec from the state before the game frame */
+		if (PROTOCOL_GAMEFRAME(cl.frame.serverframe, cl.framerate))
+		{
+			ent->gameprev = ent->current;
+		}
+		else if (!VectorCompare(state->origin, ent->current.origin))
+		{
+			ent->subframes = true;
+		}
 	}
 
 	ent->serverframe = cl.frame.serverframe;
@@ -688,7 +703,10 @@ CL_ParseFrame(void)
 
 	cl.frame.serverframe = MSG_ReadLong(&net_message);
 	cl.frame.deltaframe = MSG_ReadLong(&net_message);
-	cl.frame.servertime = cl.frame.serverframe * 100;
+	cl.frame.servertime = (int)((long long)cl.frame.serverframe * 1000 /
+			cl.framerate);
+	cl.frametime = cl.frame.servertime - (int)((long long)
+			(cl.frame.serverframe - 1) * 1000 / cl.framerate);
 
 	/* BIG HACK to let old demos continue to work */
 	if (cls.serverProtocol != 26)
@@ -714,7 +732,7 @@ CL_ParseFrame(void)
 	}
 	else
 	{
-		old = &cl.frames[cl.frame.deltaframe & UPDATE_MASK];
+		old = &cl.frames[cl.frame.deltaframe & (cl.update_backup - 1)];
 
 		if (!old->valid)
 		{
@@ -745,9 +763,9 @@ CL_ParseFrame(void)
 		cl.time = cl.frame.servertime;
 	}
 
-	else if (cl.time < cl.frame.servertime - 100)
+	else if (cl.time < cl.frame.servertime - cl.frametime)
 	{
-		cl.time = cl.frame.servertime - 100;
+		cl.time = cl.frame.servertime - cl.frametime;
 	}
 
 	/* read areabits */
@@ -777,7 +795,7 @@ CL_ParseFrame(void)
 	CL_ParsePacketEntities(old, &cl.frame);
 
 	/* save the frame off in the backup array for later delta comparisons */
-	cl.frames[cl.frame.serverframe & UPDATE_MASK] = cl.frame;
+	cl.frames[cl.frame.serverframe & (cl.update_backup - 1)] = cl.frame;
 
 	if (cl.frame.valid)
 	{
@@ -811,6 +829,38 @@ CL_ParseFrame(void)
 	}
 }
 
+/*
+ * Sizes cl.frames and cl_parse_entities for 1.6 seconds
+ * of frames at the server's frame rate. They're only
+ * allocated again when the rate changes.
+ */
+static void
+CL_AllocFrames(void)
+{
+	static frame_t *frames;
+	static int backup;
+
+	if (backup != PROTOCOL_UPDATE_BACKUP(cl.framerate))
+	{
+		if (frames)
+		{
+			Z_Free(frames);
+			Z_Free(cl_parse_entities);
+		}
+
+		backup = PROTOCOL_UPDATE_BACKUP(cl.framerate);
+		frames = Z_Malloc(sizeof(frame_t) * backup);
+		cl_parse_entities = Z_Malloc(sizeof(entity_state_t) * backup * 64);
+	}
+	else
+	{
+		memset(frames, 0, sizeof(frame_t) * backup);
+	}
+
+	cl.frames = frames;
+	cl.update_backup = backup;
+}
+
 void
 CL_ParseServerData(void)
 {
@@ -826,6 +876,24 @@ CL_ParseServerData(void)
 
 	/* parse protocol version number */
 	i = MSG_ReadLong(&net_message);
+
+	/* servers faster than 10 Hz send their frame rate along */
+	cl.framerate = i >> 16;
+	i &= 0xffff;
+
+	if (!cl.framerate)
+	{
+		cl.framerate = 10;
+	}
+	else if ((cl.framerate < 10) || (cl.framerate > PROTOCOL_MAX_FRAMERATE) ||
+			(cl.framerate % 10))
+	{
+		Com_Error(ERR_DROP, "Server frame rate %i, not 10, 20, 30 or 40",
+				cl.framerate);
+	}
+
+	CL_AllocFrames();
+
 	cls.serverProtocol = i;
 
 	/* another demo hack */
@@ -1078,6 +1146,12 @@ CL_ParseConfigString(void)
 		CL_SetLightstyle(i - CS_LIGHTS);
 	}
 
+	else if (i == CS_MAXCLIENTS)
+	{
+		cl.maxclients = (int)strtol(cl.configstrings[CS_MAXCLIENTS],
+				(char **)NULL, 10);
+	}
+
 	else if (i == CS_CDTRACK)
 	{
 		if (cl.refresh_prepped)
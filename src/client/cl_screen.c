@@ -68,6 +68,7 @@ extern cvar_t *cl_drawfps;
 extern cvar_t *crosshair_scale;
 
 void SCR_TimeRefresh_f(void);
+void SCR_DlightBench_f(void);
 void SCR_Loading_f(void);
 
 /*
@@ -440,6 +441,7 @@ SCR_Init(void)
 
 	/* register our commands */
 	Cmd_AddCommand("timerefresh", SCR_TimeRefresh_f);
+	Cmd_AddCommand("dlightbench", SCR_DlightBench_f);
 	Cmd_AddCommand("loading", SCR_Loading_f);
 	Cmd_AddCommand("sizeup", SCR_SizeUp_f);
 	Cmd_AddCommand("sizedown", SCR_SizeDown_f);
@@ -678,6 +680,79 @@ SCR_TimeRefresh_f(void)
 	Com_Printf("%f seconds (%f fps)\n", time, 128 / time);
 }
 
+/*
+ * Renders the current view with many dynamic lights
+ * circling the player, like in a rocket fight, and
+ * reports the time spent in the refresh per frame
+ */
+void
+SCR_DlightBench_f(void)
+{
+	dlight_t dlights[MAX_DLIGHTS];
+	refdef_t refdef;
+	long long start, frametime, total, worst;
+	int numlights, frames, i, j;
+	float angle;
+
+	if (cls.state != ca_active)
+	{
+		Com_Printf("Not in a map.\n");
+		return;
+	}
+
+	if (Cmd_Argc() > 3)
+	{
+		Com_Printf("usage: dlightbench [lights] [frames]\n");
+		return;
+	}
+
+	numlights = (Cmd_Argc() > 1) ? (int)strtol(Cmd_Argv(1), (char **)NULL, 10) : MAX_DLIGHTS;
+	frames = (Cmd_Argc() > 2) ? (int)strtol(Cmd_Argv(2), (char **)NULL, 10) : 200;
+
+	numlights = numlights < 0 ? 0 : (numlights > MAX_DLIGHTS ? MAX_DLIGHTS : numlights);
+	frames = frames < 1 ? 1 : frames;
+
+	refdef = cl.refdef;
+	refdef.dlights = dlights;
+	refdef.num_dlights = numlights;
+
+	total = worst = 0;
+
+	for (i = 0; i < frames; i++)
+	{
+		for (j = 0; j < numlights; j++)
+		{
+			angle = (i * 0.05f) + (j * 2.0f * M_PI / numlights);
+
+			dlights[j].origin[0] = refdef.vieworg[0] + cos(angle) * (64 + (j % 4) * 48);
+			dlights[j].origin[1] = refdef.vieworg[1] + sin(angle) * (64 + (j % 4) * 48);
+			dlights[j].origin[2] = refdef.vieworg[2] + ((j % 3) - 1) * 32;
+			dlights[j].intensity = 200 + (j % 3) * 50;
+			dlights[j].color[0] = 1.0f;
+			dlights[j].color[1] = 0.5f + (j % 2) * 0.5f;
+			dlights[j].color[2] = 0.25f;
+		}
+
+		start = Sys_Microseconds();
+
+		R_BeginFrame(0);
+		R_RenderFrame(&refdef);
+
+		frametime = Sys_Microseconds() - start;
+		total += frametime;
+
+		if (frametime > worst)
+		{
+			worst = frametime;
+		}
+
+		GLimp_EndFrame();
+	}
+
+	Com_Printf("%i frames with %i dlights: %lld us per frame, worst %lld us\n",
+			frames, numlights, total / frames, worst);
+}
+
 void
 SCR_AddDirtyPoint(int x, int y)
 {
@@ -1400,7 +1400,6 @@ CL_AddPlayerBeams(void)
 	float model_length;
 
 	float hand_multiplier;
-	frame_t *oldframe;
 	player_state_t *ps, *ops;
 
 	framenum = 0;
@@ -1444,20 +1443,12 @@ CL_AddPlayerBeams(void)
 			{
 				/* set up gun position */
 				ps = &cl.frame.playerstate;
-				j = (cl.frame.serverframe - 1) & UPDATE_MASK;
-				oldframe = &cl.frames[j];
-
-				if ((oldframe->serverframe != cl.frame.serverframe - 1) || !oldframe->valid)
-				{
-					oldframe = &cl.frame; /* previous frame was dropped or invalid */
-				}
-
-				ops = &oldframe->playerstate;
+				ops = &CL_GameOldFrame()->playerstate;
 
 				for (j = 0; j < 3; j++)
 				{
 					b->start[j] = cl.refdef.vieworg[j] + ops->gunoffset[j]
-								  + cl.lerpfrac * (ps->gunoffset[j] - ops->gunoffset[j]);
+								  + cl.gamelerpfrac * (ps->gunoffset[j] - ops->gunoffset[j]);
 				}
 
 				VectorMA(b->start, (hand_multiplier * b->offset[0]),
@@ -1790,11 +1781,12 @@ CL_AddExplosions(void)
 		if (f < 0)
 		{
 			f = 0;
+			frac = 0;
 		}
 
 		ent->frame = ex->baseframe + f + 1;
 		ent->oldframe = ex->baseframe + f;
-		ent->backlerp = 1.0f - cl.lerpfrac;
+		ent->backlerp = 1.0f - (frac - f);
 
 		V_AddEntity(ent);
 	}
@@ -605,7 +605,9 @@ V_RenderView(float stereo_separation)
 	cl.refdef.fov_y = CalcFov(cl.refdef.fov_x, (float)cl.refdef.width,
 				(float)cl.refdef.height);
 
+	PROF_BEGIN("R_RenderFrame");
 	R_RenderFrame(&cl.refdef);
+	PROF_END();
 
 	if (cl_stats->value)
 	{
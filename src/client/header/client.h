@@ -30,10 +30,10 @@
 #define MAX_CLIENTWEAPONMODELS 20
 #define	CMD_BACKUP 256 /* allow a lot of command backups for very fast systems */
 
-/* the cl_parse_entities must be large enough to hold UPDATE_BACKUP frames of
+/* the cl_parse_entities must be large enough to hold cl.update_backup frames of
    entities, so that when a delta compressed message arives from the server
    it can be un-deltad from the original */
-#define	MAX_PARSE_ENTITIES	1024
+#define	MAX_PARSE_ENTITIES	(cl.update_backup * 64)
 
 #define MAX_SUSTAINS		32
 #define	PARTICLE_GRAVITY 40
@@ -74,6 +74,8 @@ typedef struct
 	entity_state_t	baseline; /* delta from this if not from a previous frame */
 	entity_state_t	current;
 	entity_state_t	prev; /* will always be valid, but might just be a copy of current */
+	entity_state_t	gameprev; /* prev from before the last game frame */
+	qboolean	subframes; /* moved between game frames, lerps per frame */
 
 	int			serverframe; /* if not current, this ent isn't in the frame */
 
@@ -130,7 +132,8 @@ typedef struct
 
 	frame_t		frame; /* received from server */
 	int			surpressCount; /* number of messages rate supressed */
-	frame_t		frames[UPDATE_BACKUP];
+	frame_t		*frames; /* [update_backup], sized from the serverdata */
+	int			update_backup; /* PROTOCOL_UPDATE_BACKUP(framerate) */
 
 	/* the client maintains its own idea of view angles, which are
 	   sent to the server each frame.  It is cleared to 0 upon entering each level.
@@ -141,6 +144,10 @@ typedef struct
 
 	int			time; /* this is the time value that the client is rendering at. always <= cls.realtime */
 	float		lerpfrac; /* between oldframe and frame */
+	float		gamelerpfrac; /* through the game frame, for what only the game changes */
+	int			framerate; /* server frames per second, from the serverdata */
+	int			maxclients; /* from CS_MAXCLIENTS, 0 until it arrives */
+	int			frametime; /* msec between oldframe and frame */
 
 	refdef_t	refdef;
 
@@ -300,7 +307,7 @@ typedef struct
 extern	centity_t	cl_entities[MAX_EDICTS];
 extern	cdlight_t	cl_dlights[MAX_DLIGHTS];
 
-extern	entity_state_t	cl_parse_entities[MAX_PARSE_ENTITIES];
+extern	entity_state_t	*cl_parse_entities;
 
 extern	netadr_t	net_from;
 extern	sizebuf_t	net_message;
@@ -402,7 +409,10 @@ void CL_RunParticles (void);
 void CL_RunDLights (void);
 void CL_RunLightStyles (void);
 
+void CL_CalcLerpFrac(void);
+frame_t *CL_GameOldFrame(void);
 void CL_CalcViewValues(void);
+void CL_AddPacketEntities(frame_t *frame);
 void CL_AddEntities (void);
 void CL_AddDLights (void);
 void CL_AddTEnts (void);
@@ -475,6 +485,7 @@ extern	int			gun_frame;
 extern	struct model_s	*gun_model;
 
 void V_Init (void);
+void V_ClearScene (void);
 void V_RenderView( float stereo_separation );
 void V_AddEntity (entity_t *ent);
 void V_AddParticle (vec3_t org, unsigned int color, float alpha);
@@ -1921,7 +1921,7 @@ M_Menu_Credits_f(void)
     int isdeveloper = 0;
 
     creditsBuffer = NULL;
-    count = FS_LoadFile("credits", (void **)&creditsBuffer);
+    count = FS_LoadFileWritable("credits", (void **)&creditsBuffer);
 
     if (count != -1)
     {
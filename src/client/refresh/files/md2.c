@@ -26,6 +26,197 @@
 
 #include "../header/local.h"
 
+/*
+ * Converts the strips and fans of the glcmds into one indexed
+ * triangle list. References to the same frame vertex with the
+ * same texture coordinates share a mesh vertex. Returns NULL if
+ * the result needs more than MAX_MESH_VERTS vertexes or doesn't
+ * fit into the hunk.
+ */
+static maliasmesh_t *
+LoadMD2Mesh(model_t *mod, dmdl_t *pheader)
+{
+	maliasmesh_t *mesh;
+	daliasframe_t *frame;
+	dtrivertx_t *verts;
+	int *order, *cmd, *remap, *first, *next, *xyz;
+	float *st;
+	int count, numrefs, numtris, numverts, numindexes, size;
+	int i, j, k, v;
+	long long start;
+
+	start = Sys_Microseconds();
+
+	/* count the references and check them */
+	order = (int *)((byte *)pheader + pheader->ofs_glcmds);
+	numrefs = 0;
+	numtris = 0;
+	cmd = order;
+
+	while ((cmd < order + pheader->num_glcmds) && *cmd)
+	{
+		count = abs(*cmd++);
+
+		if (cmd + count * 3 > order + pheader->num_glcmds)
+		{
+			return NULL;
+		}
+
+		for (i = 0; i < count; i++, cmd += 3)
+		{
+			if ((cmd[2] < 0) || (cmd[2] >= pheader->num_xyz))
+			{
+				return NULL;
+			}
+		}
+
+		numrefs += count;
+		numtris += (count > 2) ? count - 2 : 0;
+	}
+
+	if ((cmd >= order + pheader->num_glcmds) || !numtris)
+	{
+		return NULL;
+	}
+
+	remap = malloc(numrefs * sizeof(int));
+	first = malloc(pheader->num_xyz * sizeof(int));
+	next = malloc(numrefs * sizeof(int));
+	xyz = malloc(numrefs * sizeof(int));
+	st = malloc(numrefs * 2 * sizeof(float));
+
+	for (i = 0; i < pheader->num_xyz; i++)
+	{
+		first[i] = -1;
+	}
+
+	/* the mesh vertexes of a frame vertex are chained,
+	   seams only give a handful of them */
+	numverts = 0;
+	numrefs = 0;
+	cmd = order;
+
+	while (*cmd)
+	{
+		count = abs(*cmd++);
+
+		for (i = 0; i < count; i++, cmd += 3)
+		{
+			for (v = first[cmd[2]]; v != -1; v = next[v])
+			{
+				if (!memcmp(&st[v * 2], cmd, 2 * sizeof(float)))
+				{
+					break;
+				}
+			}
+
+			if (v == -1)
+			{
+				v = numverts++;
+				memcpy(&st[v * 2], cmd, 2 * sizeof(float));
+				xyz[v] = cmd[2];
+				next[v] = first[cmd[2]];
+				first[cmd[2]] = v;
+			}
+
+			remap[numrefs++] = v;
+		}
+	}
+
+	size = numverts * (2 * sizeof(float) + pheader->num_frames * sizeof(dtrivertx_t)) +
+		numtris * 3 * sizeof(unsigned short);
+
+	if ((numverts > MAX_MESH_VERTS) ||
+		(pheader->ofs_end + size + 1024 > ALIAS_HUNK_SIZE))
+	{
+		free(st);
+		free(xyz);
+		free(next);
+		free(first);
+		free(remap);
+
+		return NULL;
+	}
+
+	mesh = Hunk_Alloc(sizeof(maliasmesh_t));
+	mesh->numverts = numverts;
+	mesh->st = Hunk_Alloc(numverts * 2 * sizeof(float));
+	mesh->indexes = Hunk_Alloc(numtris * 3 * sizeof(unsigned short));
+	mesh->verts = Hunk_Alloc(pheader->num_frames * numverts * sizeof(dtrivertx_t));
+
+	memcpy(mesh->st, st, numverts * 2 * sizeof(float));
+
+	/* same winding as OpenGL gives the strips and fans,
+	   triangles with a vertex twice draw nothing */
+	numindexes = 0;
+	numrefs = 0;
+	cmd = order;
+
+	while (*cmd)
+	{
+		count = *cmd++;
+
+		for (i = 2; i < abs(count); i++)
+		{
+			if (count < 0)
+			{
+				j = remap[numrefs];
+				k = remap[numrefs + i - 1];
+			}
+			else if (i & 1)
+			{
+				j = remap[numrefs + i - 1];
+				k = remap[numrefs + i - 2];
+			}
+			else
+			{
+				j = remap[numrefs + i - 2];
+				k = remap[numrefs + i - 1];
+			}
+
+			v = remap[numrefs + i];
+
+			if ((j == k) || (j == v) || (k == v))
+			{
+				continue;
+			}
+
+			mesh->indexes[numindexes++] = j;
+			mesh->indexes[numindexes++] = k;
+			mesh->indexes[numindexes++] = v;
+		}
+
+		numrefs += abs(count);
+		cmd += abs(count) * 3;
+	}
+
+	mesh->numindexes = numindexes;
+
+	for (i = 0; i < pheader->num_frames; i++)
+	{
+		frame = (daliasframe_t *)((byte *)pheader
+				+ pheader->ofs_frames + i * pheader->framesize);
+		verts = mesh->verts + i * numverts;
+
+		for (j = 0; j < numverts; j++)
+		{
+			verts[j] = frame->verts[xyz[j]];
+		}
+	}
+
+	free(st);
+	free(xyz);
+	free(next);
+	free(first);
+	free(remap);
+
+	VID_Printf(PRINT_DEVELOPER, "%s: %i strip and fan vertexes to %i vertexes "
+			"and %i triangles, %i KB in %lld us\n", mod->name, numrefs, numverts,
+			numindexes / 3, size / 1024, Sys_Microseconds() - start);
+
+	return mesh;
+}
+
 void
 LoadMD2(model_t *mod, void *buffer)
 {
@@ -141,6 +332,8 @@ LoadMD2(model_t *mod, void *buffer)
 		poutcmd[i] = LittleLong(pincmd[i]);
 	}
 
+	mod->mesh = LoadMD2Mesh(mod, pheader);
+
 	/* register all skins */
 	memcpy((char *)pheader + pheader->ofs_skins,
 			(char *)pinmodel + pheader->ofs_skins,
@@ -48,8 +48,8 @@ LoadPCX(char *origname, byte **pic, byte **palette, int *width, int *height)
 	*pic = NULL;
 	*palette = NULL;
 
-	/* load the file */
-	len = FS_LoadFile(filename, (void **)&raw);
+	/* load the file, the header is swapped in place */
+	len = FS_LoadFileWritable(filename, (void **)&raw);
 
 	if (!raw)
 	{
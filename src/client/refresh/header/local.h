@@ -78,6 +78,7 @@
 #define BACKFACE_EPSILON 0.01
 #define LIGHTMAP_BYTES 4
 #define MAX_LIGHTMAPS 128
+#define MAX_LIGHTMAP_SIZE 2048
 #define GL_LIGHTMAP_FORMAT GL_RGBA
 
 /* up / down */
@@ -180,6 +181,7 @@ extern int r_visframecount;
 extern int r_framecount;
 extern cplane_t frustum[4];
 extern int c_brush_polys, c_alias_polys;
+extern int c_alias_drawcalls;
 extern int gl_filter_min, gl_filter_max;
 
 /* view origin */
@@ -207,6 +209,12 @@ extern cvar_t *gl_overbrightbits;
 
 extern cvar_t *gl_palettedtexture;
 extern cvar_t *gl_pointparameters;
+extern cvar_t *gl_vbo;
+extern cvar_t *gl_batchworld;
+extern cvar_t *gl_batchmodels;
+extern cvar_t *gl_threads;
+extern cvar_t *gl_lightmapsize;
+extern cvar_t *gl_simd;
 
 extern cvar_t *gl_particle_min_size;
 extern cvar_t *gl_particle_max_size;
@@ -260,6 +268,12 @@ extern int gl_tex_alpha_format;
 
 extern int c_visible_lightmaps;
 extern int c_visible_textures;
+extern int c_world_drawcalls;
+extern int c_world_usec;
+extern int c_lightmap_builds;
+extern int c_lightmap_usec;
+extern int c_lightmap_uploads;
+extern int c_texture_binds;
 
 extern float r_world_matrix[16];
 
@@ -280,6 +294,7 @@ void V_AddBlend(float r, float g, float b, float a, float *v_blend);
 void R_RenderView(refdef_t *fd);
 void R_ScreenShot(void);
 void R_DrawAliasModel(entity_t *e);
+void R_LerpTest_f(void);
 void R_DrawBrushModel(entity_t *e);
 void R_DrawSpriteModel(entity_t *e);
 void R_DrawBeam(entity_t *e);
@@ -290,6 +305,8 @@ void R_RenderBrushPoly(msurface_t *fa);
 void R_InitParticleTexture(void);
 void Draw_InitLocal(void);
 void R_SubdivideSurface(msurface_t *fa);
+void R_BuildWorldGeometry(model_t *mod);
+void R_FreeWorldGeometry(void);
 qboolean R_CullBox(vec3_t mins, vec3_t maxs);
 void R_RotateForEntity(entity_t *e);
 void R_MarkLeaves(void);
@@ -301,6 +318,10 @@ void R_ClearSkyBox(void);
 void R_DrawSkyBox(void);
 void R_MarkLights(dlight_t *light, int bit, mnode_t *node);
 
+typedef void (*rjobfunc_t)(int job);
+void R_RunJobs(rjobfunc_t func, int numjobs);
+void R_ShutdownJobs(void);
+
 void COM_StripExtension(char *in, char *out);
 
 void R_SwapBuffers(int);
@@ -358,6 +379,7 @@ typedef struct
 	qboolean npottextures;
 	qboolean palettedtexture;
 	qboolean pointparameters;
+	qboolean vbo;
 
 	// ----
 
@@ -389,6 +411,13 @@ typedef struct
 	unsigned char originalBlueGammaTable[256];
 } glstate_t;
 
+typedef struct
+{
+	int x;
+	int y; /* first free row */
+	int width;
+} lmskyline_t;
+
 typedef struct
 {
 	int internal_format;
@@ -396,11 +425,20 @@ typedef struct
 
 	msurface_t *lightmap_surfaces[MAX_LIGHTMAPS];
 
-	int allocated[BLOCK_WIDTH];
+	int size; /* width and height of the lightmap pages */
+
+	/* the top of the allocated texels, left to right */
+	lmskyline_t skyline[MAX_LIGHTMAP_SIZE];
+	int numskyline;
 
 	/* the lightmap texture data needs to be kept in
 	   main memory so texsubimage can update properly */
-	byte lightmap_buffer[4 * BLOCK_WIDTH * BLOCK_HEIGHT];
+	byte *lightmap_buffer;
+
+	/* copies of the static pages. lightmaps whose styles
+	   changed are rebuilt in there, then the changed part
+	   of each page is uploaded at once */
+	byte *pages[MAX_LIGHTMAPS];
 } gllightmapstate_t;
 
 extern glconfig_t gl_config;
@@ -75,6 +75,7 @@ typedef struct glpoly_s
 	struct  glpoly_s *chain;
 	int numverts;
 	int flags; /* for SURF_UNDERWATER (not needed anymore?) */
+	int firstvert; /* in the world geometry, -1 if not there */
 	float verts[4][VERTEXSIZE]; /* variable sized (xyz s1t1 s2t2) */
 } glpoly_t;
 
@@ -146,6 +147,22 @@ typedef struct mleaf_s
 	int nummarksurfaces;
 } mleaf_t;
 
+/* Alias model as one indexed triangle list, built from the glcmds
+   at load time. Every distinct pair of frame vertex and texture
+   coordinate becomes one mesh vertex, and each frame's vertexes are
+   stored again in mesh vertex order. */
+#define MAX_MESH_VERTS 4096
+#define ALIAS_HUNK_SIZE 0x400000
+
+typedef struct
+{
+	int numverts;
+	int numindexes;
+	float *st;                  /* numverts pairs */
+	unsigned short *indexes;
+	dtrivertx_t *verts;         /* numverts for each frame */
+} maliasmesh_t;
+
 /* Whole model */
 typedef enum {mod_bad, mod_brush, mod_sprite, mod_alias} modtype_t;
 
@@ -209,6 +226,7 @@ typedef struct model_s
 
 	/* for alias models and skins */
 	image_t *skins[MAX_MD2SKINS];
+	maliasmesh_t *mesh; /* NULL if the glcmds didn't fit */
 
 	int extradatasize;
 	void *extradata;
@@ -222,7 +240,7 @@ byte *Mod_ClusterPVS(int cluster, model_t *model);
 
 void Mod_Modellist_f(void);
 
-void *Hunk_Begin(int maxsize);
+void *Hunk_Begin(int maxsize, const char *name);
 void *Hunk_Alloc(int size);
 int Hunk_End(void);
 void Hunk_Free(void *base);
@@ -174,6 +174,8 @@ R_Bind(int texnum)
 
 	gl_state.currenttextures[gl_state.currenttmu] = texnum;
 	glBindTexture(GL_TEXTURE_2D, texnum);
+
+	c_texture_binds++;
 }
 
 void
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Job pool of the refresh. R_RunJobs() hands numbered jobs to the
+ * render thread and gl_threads - 1 workers and returns when all of
+ * them are done. Jobs must not touch OpenGL, they only compute into
+ * memory the render thread uploads afterwards.
+ *
+ * =======================================================================
+ */
+
+#include "header/local.h"
+
+#define MAX_JOB_THREADS 16
+
+static void *r_jobthreads[MAX_JOB_THREADS];
+static int r_numjobthreads;
+static void *r_jobmutex;
+static void *r_jobcond; /* new jobs to run */
+static void *r_jobdonecond; /* all jobs done */
+static int r_jobgeneration;
+static qboolean r_jobquit;
+
+static rjobfunc_t r_jobfunc;
+static int r_numjobs;
+static int r_nextjob; /* next job to take */
+static int r_jobbusy; /* threads running jobs right now */
+
+/*
+ * Runs jobs until all are taken.
+ * Called with r_jobmutex held.
+ */
+static void
+R_TakeJobs(void)
+{
+	int job;
+
+	r_jobbusy++;
+
+	while (r_nextjob < r_numjobs)
+	{
+		job = r_nextjob++;
+
+		Sys_UnlockMutex(r_jobmutex);
+		r_jobfunc(job);
+		Sys_LockMutex(r_jobmutex);
+	}
+
+	if (!--r_jobbusy)
+	{
+		Sys_BroadcastCond(r_jobdonecond);
+	}
+}
+
+static void
+R_JobWorker(void *arg)
+{
+	int generation;
+	char name[32];
+
+	generation = 0;
+
+	Com_sprintf(name, sizeof(name), "r_jobs %i", (int)(size_t)arg);
+	Prof_ThreadName(name);
+
+	Sys_LockMutex(r_jobmutex);
+
+	while (1)
+	{
+		while (!r_jobquit && (generation == r_jobgeneration))
+		{
+			Sys_WaitCond(r_jobcond, r_jobmutex);
+		}
+
+		if (r_jobquit)
+		{
+			break;
+		}
+
+		generation = r_jobgeneration;
+		R_TakeJobs();
+	}
+
+	Sys_UnlockMutex(r_jobmutex);
+
+	Prof_ThreadExit();
+}
+
+void
+R_ShutdownJobs(void)
+{
+	int i;
+
+	if (!r_numjobthreads)
+	{
+		return;
+	}
+
+	Sys_LockMutex(r_jobmutex);
+	r_jobquit = true;
+	Sys_BroadcastCond(r_jobcond);
+	Sys_UnlockMutex(r_jobmutex);
+
+	for (i = 1; i < r_numjobthreads; i++)
+	{
+		Sys_WaitThread(r_jobthreads[i]);
+	}
+
+	Sys_DestroyCond(r_jobdonecond);
+	Sys_DestroyCond(r_jobcond);
+	Sys_DestroyMutex(r_jobmutex);
+
+	r_numjobthreads = 0;
+	r_jobquit = false;
+}
+
+static void
+R_StartJobs(int count)
+{
+	int i;
+
+	R_ShutdownJobs();
+
+	if (count < 2)
+	{
+		return;
+	}
+
+	r_jobmutex = Sys_CreateMutex();
+	r_jobcond = Sys_CreateCond();
+	r_jobdonecond = Sys_CreateCond();
+
+	/* slot 0 is the render thread */
+	for (i = 1; i < count; i++)
+	{
+		r_jobthreads[i] = Sys_CreateThread(R_JobWorker, (void *)(size_t)i);
+
+		if (r_jobthreads[i] == NULL)
+		{
+			break;
+		}
+	}
+
+	r_numjobthreads = i;
+
+	if (i < count)
+	{
+		/* keep what we got, and don't retry every frame */
+		VID_Printf(PRINT_ALL, "R_StartJobs: couldn't create thread %i.\n", i);
+		Cvar_SetValue("gl_threads", i);
+
+		if (i < 2)
+		{
+			R_ShutdownJobs();
+		}
+	}
+}
+
+/*
+ * Calls func for each job number from 0 to numjobs - 1,
+ * spread over all threads, and waits for them to finish
+ */
+void
+R_RunJobs(rjobfunc_t func, int numjobs)
+{
+	int threads, i;
+
+	threads = (int)gl_threads->value;
+	threads = threads < 1 ? 1 : (threads > MAX_JOB_THREADS ? MAX_JOB_THREADS : threads);
+
+	if (threads != (r_numjobthreads ? r_numjobthreads : 1))
+	{
+		R_StartJobs(threads);
+	}
+
+	/* waking the workers isn't worth it for one job */
+	if (!r_numjobthreads || (numjobs < 2))
+	{
+		for (i = 0; i < numjobs; i++)
+		{
+			func(i);
+		}
+
+		return;
+	}
+
+	Sys_LockMutex(r_jobmutex);
+
+	r_jobfunc = func;
+	r_numjobs = numjobs;
+	r_nextjob = 0;
+	r_jobgeneration++;
+	Sys_BroadcastCond(r_jobcond);
+
+	R_TakeJobs();
+
+	while (r_jobbusy)
+	{
+		Sys_WaitCond(r_jobdonecond, r_jobmutex);
+	}
+
+	Sys_UnlockMutex(r_jobmutex);
+}
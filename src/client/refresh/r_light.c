@@ -32,7 +32,6 @@ int r_dlightframecount;
 vec3_t pointcolor;
 cplane_t *lightplane; /* used as shadow plane */
 vec3_t lightspot;
-static float s_blocklights[34 * 34 * 3];
 
 void
 R_RenderDlight(dlight_t *light)
@@ -377,8 +376,8 @@ R_LightPoint(vec3_t p, vec3_t color)
 	VectorScale(color, gl_modulate->value, color);
 }
 
-void
-R_AddDynamicLights(msurface_t *surf)
+static void
+R_AddDynamicLights(msurface_t *surf, float *blocklights)
 {
 	int lnum;
 	int sd, td;
@@ -430,7 +429,7 @@ R_AddDynamicLights(msurface_t *surf)
 		local[1] = DotProduct(impact,
 				   tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
 
-		pfBL = s_blocklights;
+		pfBL = blocklights;
 
 		for (t = 0, ftacc = 0; t < tmax; t++, ftacc += 16)
 		{
@@ -484,9 +483,12 @@ R_SetCacheState(msurface_t *surf)
 }
 
 /*
- * Combine and scale multiple lightmaps into the floating format in blocklights
+ * Combine and scale multiple lightmaps into the floating format in blocklights.
+ * Only reads the refdef and the surface, so lightmaps can be built in parallel.
+ * Returns false for surfaces without a lightmap, the caller reports that,
+ * since this may run on a job thread.
  */
-void
+qboolean
 R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 {
 	int smax, tmax;
@@ -496,20 +498,21 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	float scale[4];
 	int nummaps;
 	float *bl;
+	float blocklights[34 * 34 * 3];
 
 	if (surf->texinfo->flags &
 		(SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP))
 	{
-		VID_Error(ERR_DROP, "R_BuildLightMap called for non-lit surface");
+		return false;
 	}
 
 	smax = (surf->extents[0] >> 4) + 1;
 	tmax = (surf->extents[1] >> 4) + 1;
 	size = smax * tmax;
 
-	if (size > (sizeof(s_blocklights) >> 4))
+	if (size > (sizeof(blocklights) >> 4))
 	{
-		VID_Error(ERR_DROP, "Bad s_blocklights size");
+		return false;
 	}
 
 	/* set to full bright if no light data */
@@ -517,7 +520,7 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	{
 		for (i = 0; i < size * 3; i++)
 		{
-			s_blocklights[i] = 255;
+			blocklights[i] = 255;
 		}
 
 		goto store;
@@ -538,7 +541,7 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 
 		for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
 		{
-			bl = s_blocklights;
+			bl = blocklights;
 
 			for (i = 0; i < 3; i++)
 			{
@@ -574,11 +577,11 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	{
 		int maps;
 
-		memset(s_blocklights, 0, sizeof(s_blocklights[0]) * size * 3);
+		memset(blocklights, 0, sizeof(blocklights[0]) * size * 3);
 
 		for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
 		{
-			bl = s_blocklights;
+			bl = blocklights;
 
 			for (i = 0; i < 3; i++)
 			{
@@ -614,13 +617,13 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	/* add all the dynamic lights */
 	if (surf->dlightframe == r_framecount)
 	{
-		R_AddDynamicLights(surf);
+		R_AddDynamicLights(surf, blocklights);
 	}
 
 store:
 
 	stride -= (smax << 2);
-	bl = s_blocklights;
+	bl = blocklights;
 
 	for (i = 0; i < tmax; i++, dest += stride)
 	{
@@ -688,5 +691,7 @@ store:
 			dest += 4;
 		}
 	}
+
+	return true;
 }
 
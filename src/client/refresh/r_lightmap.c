@@ -29,12 +29,15 @@
 extern gllightmapstate_t gl_lms;
 
 void R_SetCacheState(msurface_t *surf);
-void R_BuildLightMap(msurface_t *surf, byte *dest, int stride);
+qboolean R_BuildLightMap(msurface_t *surf, byte *dest, int stride);
 
 void
 LM_InitBlock(void)
 {
-	memset(gl_lms.allocated, 0, sizeof(gl_lms.allocated));
+	gl_lms.skyline[0].x = 0;
+	gl_lms.skyline[0].y = 0;
+	gl_lms.skyline[0].width = gl_lms.size;
+	gl_lms.numskyline = 1;
 }
 
 void
@@ -60,15 +63,15 @@ LM_UploadBlock(qboolean dynamic)
 	{
 		int i;
 
-		for (i = 0; i < BLOCK_WIDTH; i++)
+		for (i = 0; i < gl_lms.numskyline; i++)
 		{
-			if (gl_lms.allocated[i] > height)
+			if (gl_lms.skyline[i].y > height)
 			{
-				height = gl_lms.allocated[i];
+				height = gl_lms.skyline[i].y;
 			}
 		}
 
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BLOCK_WIDTH,
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, gl_lms.size,
 				height, GL_LIGHTMAP_FORMAT, GL_UNSIGNED_BYTE,
 				gl_lms.lightmap_buffer);
 	}
@@ -76,9 +79,23 @@ LM_UploadBlock(qboolean dynamic)
 	{
 		gl_lms.internal_format = GL_LIGHTMAP_FORMAT;
 		glTexImage2D(GL_TEXTURE_2D, 0, gl_lms.internal_format,
-				BLOCK_WIDTH, BLOCK_HEIGHT, 0, GL_LIGHTMAP_FORMAT,
+				gl_lms.size, gl_lms.size, 0, GL_LIGHTMAP_FORMAT,
 				GL_UNSIGNED_BYTE, gl_lms.lightmap_buffer);
 
+		if (!gl_lms.pages[texture])
+		{
+			gl_lms.pages[texture] = malloc(gl_lms.size * gl_lms.size * LIGHTMAP_BYTES);
+
+			if (!gl_lms.pages[texture])
+			{
+				VID_Error(ERR_FATAL, "LM_UploadBlock: couldn't allocate page %i",
+						texture);
+			}
+		}
+
+		memcpy(gl_lms.pages[texture], gl_lms.lightmap_buffer,
+				gl_lms.size * gl_lms.size * LIGHTMAP_BYTES);
+
 		if (++gl_lms.current_lightmap_texture == MAX_LIGHTMAPS)
 		{
 			VID_Error(ERR_DROP,
@@ -88,49 +105,90 @@ LM_UploadBlock(qboolean dynamic)
 }
 
 /*
- * returns a texture number and the position inside it
+ * returns a texture number and the position inside it.
+ * the block is put at the lowest spot of the skyline,
+ * the leftmost if there are several, and the skyline
+ * is raised over it.
  */
 qboolean
 LM_AllocBlock(int w, int h, int *x, int *y)
 {
-	int i, j;
-	int best, best2;
+	lmskyline_t *sky;
+	int i, j, top, right;
+	int best, bestindex;
 
-	best = BLOCK_HEIGHT;
+	sky = gl_lms.skyline;
+	best = gl_lms.size;
+	bestindex = -1;
 
-	for (i = 0; i < BLOCK_WIDTH - w; i++)
+	for (i = 0; i < gl_lms.numskyline && sky[i].x + w <= gl_lms.size; i++)
 	{
-		best2 = 0;
+		/* the block rests on the highest segment below it */
+		top = 0;
+		right = sky[i].x + w;
 
-		for (j = 0; j < w; j++)
+		for (j = i; j < gl_lms.numskyline && sky[j].x < right; j++)
 		{
-			if (gl_lms.allocated[i + j] >= best)
-			{
-				break;
-			}
-
-			if (gl_lms.allocated[i + j] > best2)
+			if (sky[j].y > top)
 			{
-				best2 = gl_lms.allocated[i + j];
+				top = sky[j].y;
 			}
 		}
 
-		if (j == w)
+		if ((top + h <= gl_lms.size) && (top < best))
 		{
-			/* this is a valid spot */
-			*x = i;
-			*y = best = best2;
+			best = top;
+			bestindex = i;
 		}
 	}
 
-	if (best + h > BLOCK_HEIGHT)
+	if (bestindex == -1)
 	{
 		return false;
 	}
 
-	for (i = 0; i < w; i++)
+	*x = sky[bestindex].x;
+	*y = best;
+
+	/* cut the segments covered by the block */
+	right = *x + w;
+
+	for (j = bestindex; j < gl_lms.numskyline &&
+		 sky[j].x + sky[j].width <= right; j++)
+	{
+	}
+
+	if ((j < gl_lms.numskyline) && (sky[j].x < right))
 	{
-		gl_lms.allocated[*x + i] = best + h;
+		sky[j].width -= right - sky[j].x;
+		sky[j].x = right;
+	}
+
+	/* and replace them with the top of the block */
+	memmove(&sky[bestindex + 1], &sky[j],
+			(gl_lms.numskyline - j) * sizeof(lmskyline_t));
+	gl_lms.numskyline += 1 - (j - bestindex);
+
+	sky[bestindex].x = *x;
+	sky[bestindex].y = best + h;
+	sky[bestindex].width = w;
+
+	/* merge with neighbours of the same height */
+	if ((bestindex + 1 < gl_lms.numskyline) &&
+		(sky[bestindex + 1].y == sky[bestindex].y))
+	{
+		sky[bestindex].width += sky[bestindex + 1].width;
+		memmove(&sky[bestindex + 1], &sky[bestindex + 2],
+				(gl_lms.numskyline - bestindex - 2) * sizeof(lmskyline_t));
+		gl_lms.numskyline--;
+	}
+
+	if ((bestindex > 0) && (sky[bestindex - 1].y == sky[bestindex].y))
+	{
+		sky[bestindex - 1].width += sky[bestindex].width;
+		memmove(&sky[bestindex], &sky[bestindex + 1],
+				(gl_lms.numskyline - bestindex - 1) * sizeof(lmskyline_t));
+		gl_lms.numskyline--;
 	}
 
 	return true;
@@ -157,6 +215,7 @@ LM_BuildPolygonFromSurface(msurface_t *fa)
 		   (lnumverts - 4) * VERTEXSIZE * sizeof(float));
 	poly->next = fa->polys;
 	poly->flags = fa->flags;
+	poly->firstvert = -1;
 	fa->polys = poly;
 	poly->numverts = lnumverts;
 
@@ -191,13 +250,13 @@ LM_BuildPolygonFromSurface(msurface_t *fa)
 		s -= fa->texturemins[0];
 		s += fa->light_s * 16;
 		s += 8;
-		s /= BLOCK_WIDTH * 16; /* fa->texinfo->texture->width; */
+		s /= gl_lms.size * 16; /* fa->texinfo->texture->width; */
 
 		t = DotProduct(vec, fa->texinfo->vecs[1]) + fa->texinfo->vecs[1][3];
 		t -= fa->texturemins[1];
 		t += fa->light_t * 16;
 		t += 8;
-		t /= BLOCK_HEIGHT * 16; /* fa->texinfo->texture->height; */
+		t /= gl_lms.size * 16; /* fa->texinfo->texture->height; */
 
 		poly->verts[i][5] = s;
 		poly->verts[i][6] = t;
@@ -206,7 +265,7 @@ LM_BuildPolygonFromSurface(msurface_t *fa)
 	poly->numverts = lnumverts;
 }
 
-void
+static void
 LM_CreateSurfaceLightmap(msurface_t *surf)
 {
 	int smax, tmax;
@@ -235,20 +294,113 @@ LM_CreateSurfaceLightmap(msurface_t *surf)
 	surf->lightmaptexturenum = gl_lms.current_lightmap_texture;
 
 	base = gl_lms.lightmap_buffer;
-	base += (surf->light_t * BLOCK_WIDTH + surf->light_s) * LIGHTMAP_BYTES;
+	base += (surf->light_t * gl_lms.size + surf->light_s) * LIGHTMAP_BYTES;
 
 	R_SetCacheState(surf);
-	R_BuildLightMap(surf, base, BLOCK_WIDTH * LIGHTMAP_BYTES);
+
+	if (!R_BuildLightMap(surf, base, gl_lms.size * LIGHTMAP_BYTES))
+	{
+		VID_Error(ERR_DROP, "LM_CreateSurfaceLightmap: surface isn't lit or too large");
+	}
+}
+
+static int
+LM_SortByHeight(const void *a, const void *b)
+{
+	msurface_t *sa, *sb;
+
+	sa = *(msurface_t **)a;
+	sb = *(msurface_t **)b;
+
+	/* tallest first, then widest */
+	if (sa->extents[1] != sb->extents[1])
+	{
+		return sb->extents[1] - sa->extents[1];
+	}
+
+	if (sa->extents[0] != sb->extents[0])
+	{
+		return sb->extents[0] - sa->extents[0];
+	}
+
+	/* keep the map's order otherwise */
+	return (sa > sb) - (sa < sb);
+}
+
+/*
+ * Packs the lightmaps of all lit surfaces of a model,
+ * sorted by height, so each page fills up in rows
+ */
+void
+LM_CreateSurfaceLightmaps(model_t *m)
+{
+	msurface_t **surfs;
+	int i, count;
+
+	surfs = malloc(m->numsurfaces * sizeof(msurface_t *));
+
+	if (!surfs)
+	{
+		VID_Error(ERR_FATAL, "LM_CreateSurfaceLightmaps: couldn't allocate %i surfaces",
+				m->numsurfaces);
+	}
+
+	for (i = 0, count = 0; i < m->numsurfaces; i++)
+	{
+		if (!(m->surfaces[i].texinfo->flags &
+			  (SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP)))
+		{
+			surfs[count++] = &m->surfaces[i];
+		}
+	}
+
+	qsort(surfs, count, sizeof(msurface_t *), LM_SortByHeight);
+
+	for (i = 0; i < count; i++)
+	{
+		LM_CreateSurfaceLightmap(surfs[i]);
+	}
+
+	free(surfs);
 }
 
 void
 LM_BeginBuildingLightmaps(model_t *m)
 {
 	static lightstyle_t lightstyles[MAX_LIGHTSTYLES];
-	int i;
-	unsigned dummy[128 * 128];
+	int i, size, maxsize;
+
+	/* the page size only changes with the map, the
+	   texture coordinates of the polygons depend on it */
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxsize);
+	maxsize = maxsize < MAX_LIGHTMAP_SIZE ? maxsize : MAX_LIGHTMAP_SIZE;
+
+	for (size = BLOCK_WIDTH; size * 2 <= gl_lightmapsize->value &&
+		 size * 2 <= maxsize; size *= 2)
+	{
+	}
+
+	if (size != gl_lms.size)
+	{
+		for (i = 0; i < MAX_LIGHTMAPS; i++)
+		{
+			free(gl_lms.pages[i]);
+			gl_lms.pages[i] = NULL;
+		}
 
-	memset(gl_lms.allocated, 0, sizeof(gl_lms.allocated));
+		free(gl_lms.lightmap_buffer);
+		gl_lms.lightmap_buffer = malloc(size * size * LIGHTMAP_BYTES);
+
+		if (!gl_lms.lightmap_buffer)
+		{
+			VID_Error(ERR_FATAL, "LM_BeginBuildingLightmaps: couldn't allocate %ix%i lightmaps",
+					size, size);
+		}
+
+		gl_lms.size = size;
+	}
+
+	LM_InitBlock();
 
 	r_framecount = 1; /* no dlightcache */
 
@@ -278,13 +430,15 @@ LM_BeginBuildingLightmaps(model_t *m)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexImage2D(GL_TEXTURE_2D, 0, gl_lms.internal_format,
-			BLOCK_WIDTH, BLOCK_HEIGHT, 0, GL_LIGHTMAP_FORMAT,
-			GL_UNSIGNED_BYTE, dummy);
+			gl_lms.size, gl_lms.size, 0, GL_LIGHTMAP_FORMAT,
+			GL_UNSIGNED_BYTE, NULL);
 }
 
 void
 LM_EndBuildingLightmaps(void)
 {
 	LM_UploadBlock(false);
-}
 
+	VID_Printf(PRINT_DEVELOPER, "Lightmaps: %i pages of %ix%i\n",
+			gl_lms.current_lightmap_texture - 1, gl_lms.size, gl_lms.size);
+}
@@ -91,6 +91,12 @@ cvar_t *gl_particle_att_c;
 
 cvar_t *gl_palettedtexture;
 cvar_t *gl_pointparameters;
+cvar_t *gl_vbo;
+cvar_t *gl_batchworld;
+cvar_t *gl_batchmodels;
+cvar_t *gl_threads;
+cvar_t *gl_lightmapsize;
+cvar_t *gl_simd;
 
 cvar_t *gl_drawbuffer;
 cvar_t *gl_lightmap;
@@ -1072,6 +1078,12 @@ R_RenderView(refdef_t *fd)
 	{
 		c_brush_polys = 0;
 		c_alias_polys = 0;
+		c_alias_drawcalls = 0;
+		c_world_drawcalls = 0;
+		c_lightmap_builds = 0;
+		c_lightmap_usec = 0;
+		c_lightmap_uploads = 0;
+		c_texture_binds = 0;
 	}
 
 	R_PushDlights();
@@ -1103,9 +1115,10 @@ R_RenderView(refdef_t *fd)
 
 	if (gl_speeds->value)
 	{
-		VID_Printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps\n",
-				c_brush_polys, c_alias_polys, c_visible_textures,
-				c_visible_lightmaps);
+		VID_Printf(PRINT_ALL, "%4i wpoly %4i epoly %i edraws %i tex %i lmaps %i binds %i draws %i us %i lmbuilds %i us %i lmuploads\n",
+				c_brush_polys, c_alias_polys, c_alias_drawcalls, c_visible_textures,
+				c_visible_lightmaps, c_texture_binds, c_world_drawcalls,
+				c_world_usec, c_lightmap_builds, c_lightmap_usec, c_lightmap_uploads);
 	}
 
 	switch (gl_state.stereo_mode) {
@@ -1236,6 +1249,12 @@ R_Register(void)
 
 	gl_palettedtexture = Cvar_Get("gl_palettedtexture", "0", CVAR_ARCHIVE);
 	gl_pointparameters = Cvar_Get("gl_pointparameters", "1", CVAR_ARCHIVE);
+	gl_vbo = Cvar_Get("gl_vbo", "1", CVAR_ARCHIVE);
+	gl_batchworld = Cvar_Get("gl_batchworld", "1", CVAR_ARCHIVE);
+	gl_batchmodels = Cvar_Get("gl_batchmodels", "1", CVAR_ARCHIVE);
+	gl_threads = Cvar_Get("gl_threads", "4", CVAR_ARCHIVE);
+	gl_lightmapsize = Cvar_Get("gl_lightmapsize", "1024", CVAR_ARCHIVE);
+	gl_simd = Cvar_Get("gl_simd", "1", 0);
 
 	gl_drawbuffer = Cvar_Get("gl_drawbuffer", "GL_BACK", 0);
 	gl_swapinterval = Cvar_Get("gl_swapinterval", "1", CVAR_ARCHIVE);
@@ -1261,6 +1280,7 @@ R_Register(void)
 	Cmd_AddCommand("screenshot", R_ScreenShot);
 	Cmd_AddCommand("modellist", Mod_Modellist_f);
 	Cmd_AddCommand("gl_strings", R_Strings);
+	Cmd_AddCommand("gl_lerptest", R_LerpTest_f);
 }
 
 qboolean
@@ -1507,6 +1527,39 @@ R_Init(void *hinstance, void *hWnd)
 
 	// ----
 
+	/* Vertex buffer objects */
+	VID_Printf(PRINT_ALL, " - Vertex buffer objects: ");
+
+	if (strstr(gl_config.extensions_string, "GL_ARB_vertex_buffer_object"))
+	{
+		qglBindBufferARB = (void (APIENTRY *)(GLenum, GLuint))GLimp_GetProcAddress("glBindBufferARB");
+		qglDeleteBuffersARB = (void (APIENTRY *)(GLsizei, const GLuint *))GLimp_GetProcAddress("glDeleteBuffersARB");
+		qglGenBuffersARB = (void (APIENTRY *)(GLsizei, GLuint *))GLimp_GetProcAddress("glGenBuffersARB");
+		qglBufferDataARB = (void (APIENTRY *)(GLenum, ptrdiff_t, const GLvoid *, GLenum))
+				GLimp_GetProcAddress("glBufferDataARB");
+	}
+
+	gl_config.vbo = false;
+
+	if (gl_vbo->value)
+	{
+		if (qglBindBufferARB && qglDeleteBuffersARB && qglGenBuffersARB && qglBufferDataARB)
+		{
+			gl_config.vbo = true;
+			VID_Printf(PRINT_ALL, "Okay\n");
+		}
+		else
+		{
+			VID_Printf(PRINT_ALL, "Failed\n");
+		}
+	}
+	else
+	{
+		VID_Printf(PRINT_ALL, "Disabled\n");
+	}
+
+	// ----
+
 	R_SetDefaultState();
 
 	R_InitImages();
@@ -1524,7 +1577,9 @@ R_Shutdown(void)
 	Cmd_RemoveCommand("screenshot");
 	Cmd_RemoveCommand("imagelist");
 	Cmd_RemoveCommand("gl_strings");
+	Cmd_RemoveCommand("gl_lerptest");
 
+	R_ShutdownJobs();
 	Mod_FreeAll();
 
 	R_ShutdownImages();
@@ -26,6 +26,13 @@
 
 #include "header/local.h"
 
+#if defined(__SSE2__)
+ #include <emmintrin.h>
+ #define R_MESH_KERNEL "SSE2"
+#else
+ #define R_MESH_KERNEL "scalar"
+#endif
+
 #define NUMVERTEXNORMALS 162
 #define SHADEDOT_QUANT 16
 
@@ -39,28 +46,28 @@ float r_avertexnormal_dots[SHADEDOT_QUANT][256] =
 ;
 
 typedef float vec4_t[4];
-static vec4_t s_lerped[MAX_VERTS];
+static vec4_t s_lerped[MAX_MESH_VERTS];
+static vec4_t s_shaded[MAX_MESH_VERTS]; /* rgba of each vertex */
+static vec3_t s_shadowverts[MAX_MESH_VERTS];
+int c_alias_drawcalls;
 vec3_t shadevector;
 float shadelight[3];
 float *shadedots = r_avertexnormal_dots[0];
 extern vec3_t lightspot;
 extern qboolean have_stencil;
 
-void
-R_LerpVerts(int nverts, dtrivertx_t *v, dtrivertx_t *ov,
-		dtrivertx_t *verts, float *lerp, float move[3],
-		float frontv[3], float backv[3])
+static void
+R_LerpVertsScalar(int nverts, const dtrivertx_t *v, const dtrivertx_t *ov,
+		float *lerp, const float *move, const float *frontv,
+		const float *backv, qboolean shell)
 {
 	int i;
 
-	if (currententity->flags &
-		(RF_SHELL_RED | RF_SHELL_GREEN |
-		 RF_SHELL_BLUE | RF_SHELL_DOUBLE |
-		 RF_SHELL_HALF_DAM))
+	if (shell)
 	{
 		for (i = 0; i < nverts; i++, v++, ov++, lerp += 4)
 		{
-			float *normal = r_avertexnormals[verts[i].lightnormalindex];
+			float *normal = r_avertexnormals[v->lightnormalindex];
 
 			lerp[0] = move[0] + ov->v[0] * backv[0] + v->v[0] * frontv[0] +
 					  normal[0] * POWERSUIT_SCALE;
@@ -81,6 +88,165 @@ R_LerpVerts(int nverts, dtrivertx_t *v, dtrivertx_t *ov,
 	}
 }
 
+static void
+R_ShadeVertsScalar(int nverts, const dtrivertx_t *v, float *colors,
+		const float *dots, const float *light, float alpha)
+{
+	int i;
+	float l;
+
+	for (i = 0; i < nverts; i++, v++, colors += 4)
+	{
+		l = dots[v->lightnormalindex];
+
+		colors[0] = l * light[0];
+		colors[1] = l * light[1];
+		colors[2] = l * light[2];
+		colors[3] = alpha;
+	}
+}
+
+#if defined(__SSE2__)
+/*
+ * Four vertexes per step. A dtrivertx_t is four bytes, so one
+ * load brings in four of them, which are widened to one float
+ * vector each. The fourth lane holds the normal index and is
+ * multiplied away by zero. The operations are done in the same
+ * order as in the scalar code, so the results are bit identical.
+ */
+static void
+R_LerpVertsSSE2(int nverts, const dtrivertx_t *v, const dtrivertx_t *ov,
+		float *lerp, const float *move, const float *frontv,
+		const float *backv, qboolean shell)
+{
+	__m128i zero, front, back, lo, hi, oldlo, oldhi;
+	__m128 m, fv, bv, scale, p[4];
+	const float *normal;
+	int i, j;
+
+	zero = _mm_setzero_si128();
+	m = _mm_setr_ps(move[0], move[1], move[2], 0);
+	fv = _mm_setr_ps(frontv[0], frontv[1], frontv[2], 0);
+	bv = _mm_setr_ps(backv[0], backv[1], backv[2], 0);
+	scale = _mm_set1_ps(POWERSUIT_SCALE);
+
+	for (i = 0; i + 4 <= nverts; i += 4)
+	{
+		front = _mm_loadu_si128((const __m128i *)(v + i));
+		back = _mm_loadu_si128((const __m128i *)(ov + i));
+
+		lo = _mm_unpacklo_epi8(front, zero);
+		hi = _mm_unpackhi_epi8(front, zero);
+		oldlo = _mm_unpacklo_epi8(back, zero);
+		oldhi = _mm_unpackhi_epi8(back, zero);
+
+		p[0] = _mm_add_ps(_mm_add_ps(m,
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(oldlo, zero)), bv)),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), fv));
+		p[1] = _mm_add_ps(_mm_add_ps(m,
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(oldlo, zero)), bv)),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), fv));
+		p[2] = _mm_add_ps(_mm_add_ps(m,
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(oldhi, zero)), bv)),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), fv));
+		p[3] = _mm_add_ps(_mm_add_ps(m,
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(oldhi, zero)), bv)),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), fv));
+
+		for (j = 0; j < 4; j++)
+		{
+			if (shell)
+			{
+				normal = r_avertexnormals[v[i + j].lightnormalindex];
+				p[j] = _mm_add_ps(p[j], _mm_mul_ps(_mm_setr_ps(normal[0],
+								normal[1], normal[2], 0), scale));
+			}
+
+			_mm_storeu_ps(lerp + (i + j) * 4, p[j]);
+		}
+	}
+
+	R_LerpVertsScalar(nverts - i, v + i, ov + i, lerp + i * 4,
+			move, frontv, backv, shell);
+}
+
+/*
+ * The shade is looked up per vertex, the
+ * three products are done in one multiply
+ */
+static void
+R_ShadeVertsSSE2(int nverts, const dtrivertx_t *v, float *colors,
+		const float *dots, const float *light, float alpha)
+{
+	__m128 l, rgbmask, a;
+	int i;
+
+	l = _mm_setr_ps(light[0], light[1], light[2], 0);
+	rgbmask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	a = _mm_setr_ps(0, 0, 0, alpha);
+
+	for (i = 0; i < nverts; i++, v++, colors += 4)
+	{
+		_mm_storeu_ps(colors, _mm_or_ps(_mm_and_ps(_mm_mul_ps(
+								_mm_set1_ps(dots[v->lightnormalindex]), l),
+						rgbmask), a));
+	}
+}
+#endif
+
+/*
+ * Interpolates the vertexes of two frames into
+ * lerp, which has four floats per vertex
+ */
+static void
+R_LerpVerts(int nverts, const dtrivertx_t *v, const dtrivertx_t *ov,
+		float *lerp, const float *move, const float *frontv,
+		const float *backv, qboolean shell, qboolean simd)
+{
+#if defined(__SSE2__)
+	if (simd)
+	{
+		R_LerpVertsSSE2(nverts, v, ov, lerp, move, frontv, backv, shell);
+		return;
+	}
+#endif
+
+	R_LerpVertsScalar(nverts, v, ov, lerp, move, frontv, backv, shell);
+}
+
+/*
+ * Lights each vertex by its normal, rgba into colors
+ */
+static void
+R_ShadeVerts(int nverts, const dtrivertx_t *v, float *colors,
+		const float *dots, const float *light, float alpha, qboolean simd)
+{
+#if defined(__SSE2__)
+	if (simd)
+	{
+		R_ShadeVertsSSE2(nverts, v, colors, dots, light, alpha);
+		return;
+	}
+#endif
+
+	R_ShadeVertsScalar(nverts, v, colors, dots, light, alpha);
+}
+
+/*
+ * The indexed mesh of the current model, or NULL if
+ * it has to be drawn from its glcmds
+ */
+static maliasmesh_t *
+R_AliasMesh(void)
+{
+	if (!gl_batchmodels->value)
+	{
+		return NULL;
+	}
+
+	return currentmodel->mesh;
+}
+
 /*
  * Interpolates between two frames and origins
  */
@@ -89,7 +255,6 @@ R_DrawAliasFrameLerp(dmdl_t *paliashdr, float backlerp)
 {
     unsigned short total;
     GLenum type;
-	float l;
 	daliasframe_t *frame, *oldframe;
 	dtrivertx_t *v, *ov, *verts;
 	int *order;
@@ -100,7 +265,8 @@ R_DrawAliasFrameLerp(dmdl_t *paliashdr, float backlerp)
 	vec3_t frontv, backv;
 	int i;
 	int index_xyz;
-	float *lerp;
+	qboolean simd, shell;
+	maliasmesh_t *mesh;
 
 	frame = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames
 							  + currententity->frame * paliashdr->framesize);
@@ -151,9 +317,56 @@ R_DrawAliasFrameLerp(dmdl_t *paliashdr, float backlerp)
 		backv[i] = backlerp * oldframe->scale[i];
 	}
 
-	lerp = s_lerped[0];
+	simd = gl_simd->value != 0;
+	shell = (currententity->flags & (RF_SHELL_RED | RF_SHELL_GREEN |
+				RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM)) != 0;
+	mesh = R_AliasMesh();
+
+	if (mesh)
+	{
+		/* one lerp over the frame's stream, one draw */
+		v = mesh->verts + currententity->frame * mesh->numverts;
+		ov = mesh->verts + currententity->oldframe * mesh->numverts;
+
+		R_LerpVerts(mesh->numverts, v, ov, s_lerped[0], move, frontv, backv,
+				shell, simd);
+
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, sizeof(vec4_t), s_lerped);
+
+		if (currententity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE))
+		{
+			glColor4f(shadelight[0], shadelight[1], shadelight[2], alpha);
+		}
+		else
+		{
+			R_ShadeVerts(mesh->numverts, v, s_shaded[0], shadedots,
+					shadelight, alpha, simd);
+
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			glEnableClientState(GL_COLOR_ARRAY);
+			glTexCoordPointer(2, GL_FLOAT, 0, mesh->st);
+			glColorPointer(4, GL_FLOAT, 0, s_shaded);
+		}
+
+		glDrawElements(GL_TRIANGLES, mesh->numindexes, GL_UNSIGNED_SHORT,
+				mesh->indexes);
+		c_alias_drawcalls++;
+
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_COLOR_ARRAY);
+	}
+	else
+	{
+		R_LerpVerts(paliashdr->num_xyz, v, ov, s_lerped[0], move, frontv, backv,
+				shell, simd);
 
-	R_LerpVerts(paliashdr->num_xyz, v, ov, verts, lerp, move, frontv, backv);
+		if (!(currententity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE)))
+		{
+			R_ShadeVerts(paliashdr->num_xyz, verts, s_shaded[0], shadedots,
+					shadelight, alpha, simd);
+		}
 
 		while (1)
 		{
@@ -214,13 +427,9 @@ R_DrawAliasFrameLerp(dmdl_t *paliashdr, float backlerp)
 					index_xyz = order[2];
 					order += 3;
 
-					/* normals and vertexes come from the frame list */
-					l = shadedots[verts[index_xyz].lightnormalindex];
-
-					clr[index_clr++] = l * shadelight[0];
-					clr[index_clr++] = l * shadelight[1];
-					clr[index_clr++] = l * shadelight[2];
-					clr[index_clr++] = alpha;
+					/* colors and vertexes come from the frame list */
+					memcpy(clr + index_clr, s_shaded[index_xyz], sizeof(vec4_t));
+					index_clr += 4;
 
 					vtx[index_vtx++] = s_lerped[index_xyz][0];
 					vtx[index_vtx++] = s_lerped[index_xyz][1];
@@ -237,11 +446,13 @@ R_DrawAliasFrameLerp(dmdl_t *paliashdr, float backlerp)
 			glTexCoordPointer(2, GL_FLOAT, 0, tex);
 			glColorPointer(4, GL_FLOAT, 0, clr);
 			glDrawArrays(type, 0, total);
+			c_alias_drawcalls++;
 
 			glDisableClientState(GL_VERTEX_ARRAY);
 			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 			glDisableClientState(GL_COLOR_ARRAY);
 		}
+	}
 
 	if (currententity->flags &
 		(RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE |
@@ -259,7 +470,8 @@ R_DrawAliasShadow(dmdl_t *paliashdr, int posenum)
 	int *order;
 	vec3_t point;
 	float height = 0, lheight;
-	int count;
+	int count, i;
+	maliasmesh_t *mesh;
 
 	lheight = currententity->origin[2] - lightspot[2];
 	order = (int *)((byte *)paliashdr + paliashdr->ofs_glcmds);
@@ -273,54 +485,80 @@ R_DrawAliasShadow(dmdl_t *paliashdr, int posenum)
 		glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
 	}
 
-	while (1)
-	{
-		/* get the vertex count and primitive type */
-		count = *order++;
+	mesh = R_AliasMesh();
 
-		if (!count)
+	if (mesh)
+	{
+		for (i = 0; i < mesh->numverts; i++)
 		{
-			break; /* done */
-		}
+			memcpy(point, s_lerped[i], sizeof(point));
 
-		if (count < 0)
-		{
-			count = -count;
-			
-            type = GL_TRIANGLE_FAN;
-		}
-		else
-		{
-            type = GL_TRIANGLE_STRIP;
+			s_shadowverts[i][0] = point[0] - shadevector[0] * (point[2] + lheight);
+			s_shadowverts[i][1] = point[1] - shadevector[1] * (point[2] + lheight);
+			s_shadowverts[i][2] = height;
 		}
 
-        total = count;
-        GLfloat vtx[3*total];
-        unsigned int index_vtx = 0;
+		glEnableClientState(GL_VERTEX_ARRAY);
 
-		do
+		glVertexPointer(3, GL_FLOAT, 0, s_shadowverts);
+		glDrawElements(GL_TRIANGLES, mesh->numindexes, GL_UNSIGNED_SHORT,
+				mesh->indexes);
+		c_alias_drawcalls++;
+
+		glDisableClientState(GL_VERTEX_ARRAY);
+	}
+	else
+	{
+		while (1)
 		{
-			/* normals and vertexes come from the frame list */
-			memcpy(point, s_lerped[order[2]], sizeof(point));
+			/* get the vertex count and primitive type */
+			count = *order++;
 
-			point[0] -= shadevector[0] * (point[2] + lheight);
-			point[1] -= shadevector[1] * (point[2] + lheight);
-			point[2] = height;
+			if (!count)
+			{
+				break; /* done */
+			}
 
-            vtx[index_vtx++] = point [ 0 ];
-            vtx[index_vtx++] = point [ 1 ];
-            vtx[index_vtx++] = point [ 2 ];
+			if (count < 0)
+			{
+				count = -count;
 
-			order += 3;
-		}
-		while (--count);
+				type = GL_TRIANGLE_FAN;
+			}
+			else
+			{
+				type = GL_TRIANGLE_STRIP;
+			}
 
-        glEnableClientState( GL_VERTEX_ARRAY );
+			total = count;
+			GLfloat vtx[3*total];
+			unsigned int index_vtx = 0;
+
+			do
+			{
+				/* normals and vertexes come from the frame list */
+				memcpy(point, s_lerped[order[2]], sizeof(point));
+
+				point[0] -= shadevector[0] * (point[2] + lheight);
+				point[1] -= shadevector[1] * (point[2] + lheight);
+				point[2] = height;
 
-        glVertexPointer( 3, GL_FLOAT, 0, vtx );
-        glDrawArrays( type, 0, total );
+				vtx[index_vtx++] = point [ 0 ];
+				vtx[index_vtx++] = point [ 1 ];
+				vtx[index_vtx++] = point [ 2 ];
 
-        glDisableClientState( GL_VERTEX_ARRAY );
+				order += 3;
+			}
+			while (--count);
+
+			glEnableClientState( GL_VERTEX_ARRAY );
+
+			glVertexPointer( 3, GL_FLOAT, 0, vtx );
+			glDrawArrays( type, 0, total );
+			c_alias_drawcalls++;
+
+			glDisableClientState( GL_VERTEX_ARRAY );
+		}
 	}
 
 	/* stencilbuffer shadows */
@@ -811,3 +1049,125 @@ R_DrawAliasModel(entity_t *e)
 	glColor4f(1, 1, 1, 1);
 }
 
+/*
+ * Lerps and shades random frames with the scalar code and the
+ * vector kernel, counts the vertexes where they differ and
+ * prints the time each one takes
+ */
+void
+R_LerpTest_f(void)
+{
+	dtrivertx_t *v, *ov;
+	vec4_t *results, *lerp;
+	float move[3], frontv[3], backv[3], light[3];
+	float backlerp, *dots;
+	int count, nverts, i, j, k;
+	int lerpbad, shadebad;
+	long long start, scalartime, kerneltime;
+
+	count = 1000;
+
+	if (Cmd_Argc() > 1)
+	{
+		count = (int)strtol(Cmd_Argv(1), (char **)NULL, 10);
+
+		if (count < 1)
+		{
+			count = 1;
+		}
+	}
+
+	/* not a multiple of four, so the tail is tested too */
+	nverts = MAX_VERTS - 3;
+
+	v = malloc(2 * nverts * sizeof(dtrivertx_t));
+	ov = v + nverts;
+	results = malloc(2 * nverts * sizeof(vec4_t));
+	lerp = results + nverts;
+
+	for (i = 0; i < 2 * nverts; i++)
+	{
+		v[i].v[0] = randk() & 255;
+		v[i].v[1] = randk() & 255;
+		v[i].v[2] = randk() & 255;
+		v[i].lightnormalindex = randk() % NUMVERTEXNORMALS;
+	}
+
+	backlerp = frandk();
+
+	for (i = 0; i < 3; i++)
+	{
+		move[i] = crandk() * 64;
+		frontv[i] = (1.0 - backlerp) * (0.1 + frandk());
+		backv[i] = backlerp * (0.1 + frandk());
+		light[i] = frandk() * 2;
+	}
+
+	dots = r_avertexnormal_dots[randk() & (SHADEDOT_QUANT - 1)];
+
+	lerpbad = 0;
+	shadebad = 0;
+
+	/* the shell offset is only added to the positions */
+	for (k = 0; k < 3; k++)
+	{
+		memset(results, 0, 2 * nverts * sizeof(vec4_t));
+
+		if (k < 2)
+		{
+			R_LerpVerts(nverts, v, ov, results[0], move, frontv, backv, k, false);
+			R_LerpVerts(nverts, v, ov, lerp[0], move, frontv, backv, k, true);
+		}
+		else
+		{
+			R_ShadeVerts(nverts, v, results[0], dots, light, 0.5, false);
+			R_ShadeVerts(nverts, v, lerp[0], dots, light, 0.5, true);
+		}
+
+		/* the lerp leaves the fourth float alone */
+		j = (k < 2) ? 3 : 4;
+
+		for (i = 0; i < nverts; i++)
+		{
+			if (memcmp(results[i], lerp[i], j * sizeof(float)))
+			{
+				if (k < 2)
+				{
+					lerpbad++;
+				}
+				else
+				{
+					shadebad++;
+				}
+			}
+		}
+	}
+
+	start = Sys_Microseconds();
+
+	for (i = 0; i < count; i++)
+	{
+		R_LerpVerts(nverts, v, ov, results[0], move, frontv, backv, false, false);
+		R_ShadeVerts(nverts, v, lerp[0], dots, light, 1.0, false);
+	}
+
+	scalartime = Sys_Microseconds() - start;
+	start = Sys_Microseconds();
+
+	for (i = 0; i < count; i++)
+	{
+		R_LerpVerts(nverts, v, ov, results[0], move, frontv, backv, false, true);
+		R_ShadeVerts(nverts, v, lerp[0], dots, light, 1.0, true);
+	}
+
+	kerneltime = Sys_Microseconds() - start;
+
+	VID_Printf(PRINT_ALL, "%i vertexes: %i lerp mismatches, %i shade mismatches\n",
+			nverts, lerpbad, shadebad);
+	VID_Printf(PRINT_ALL, "scalar: %.2f ns/vertex, %s: %.2f ns/vertex\n",
+			scalartime * 1000.0 / ((double)count * nverts), R_MESH_KERNEL,
+			kerneltime * 1000.0 / ((double)count * nverts));
+
+	free(results);
+	free(v);
+}
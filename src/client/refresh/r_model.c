@@ -41,7 +41,7 @@ void Mod_LoadBrushModel(model_t *mod, void *buffer);
 void LoadMD2(model_t *mod, void *buffer);
 model_t *Mod_LoadModel(model_t *mod, qboolean crash);
 void LM_BuildPolygonFromSurface(msurface_t *fa);
-void LM_CreateSurfaceLightmap(msurface_t *surf);
+void LM_CreateSurfaceLightmaps(model_t *m);
 void LM_EndBuildingLightmaps(void);
 void LM_BeginBuildingLightmaps(model_t *m);
 
@@ -236,7 +236,7 @@ Mod_ForName(char *name, qboolean crash)
 
 	strcpy(mod->name, name);
 
-	/* load the file */
+	/* load the file, the loaders only read from it */
 	modfilelen = FS_LoadFile(mod->name, (void **)&buf);
 
 	if (!buf)
@@ -256,17 +256,17 @@ Mod_ForName(char *name, qboolean crash)
 	switch (LittleLong(*(unsigned *)buf))
 	{
 		case IDALIASHEADER:
-			loadmodel->extradata = Hunk_Begin(0x200000);
+			loadmodel->extradata = Hunk_Begin(ALIAS_HUNK_SIZE, mod->name);
 			LoadMD2(mod, buf);
 			break;
 
 		case IDSPRITEHEADER:
-			loadmodel->extradata = Hunk_Begin(0x10000);
+			loadmodel->extradata = Hunk_Begin(0x10000, mod->name);
 			LoadSP2(mod, buf);
 			break;
 
 		case IDBSPHEADER:
-			loadmodel->extradata = Hunk_Begin(0x1000000);
+			loadmodel->extradata = Hunk_Begin(0x1000000, mod->name);
 			Mod_LoadBrushModel(mod, buf);
 			break;
 
@@ -580,8 +580,6 @@ Mod_LoadFaces(lump_t *l)
 
 	currentmodel = loadmodel;
 
-	LM_BeginBuildingLightmaps(loadmodel);
-
 	for (surfnum = 0; surfnum < count; surfnum++, in++, out++)
 	{
 		out->firstedge = LittleLong(in->firstedge);
@@ -640,21 +638,21 @@ Mod_LoadFaces(lump_t *l)
 
 			R_SubdivideSurface(out); /* cut up polygon for warps */
 		}
+	}
 
-		/* create lightmaps and polygons */
-		if (!(out->texinfo->flags &
-			  (SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP)))
-		{
-			LM_CreateSurfaceLightmap(out);
-		}
+	/* create lightmaps and polygons, the polygons
+	   need the place of their surface's lightmap */
+	LM_BeginBuildingLightmaps(loadmodel);
+	LM_CreateSurfaceLightmaps(loadmodel);
+	LM_EndBuildingLightmaps();
 
+	for (surfnum = 0, out = loadmodel->surfaces; surfnum < count; surfnum++, out++)
+	{
 		if (!(out->texinfo->flags & SURF_WARP))
 		{
 			LM_BuildPolygonFromSurface(out);
 		}
 	}
-
-	LM_EndBuildingLightmaps();
 }
 
 void
@@ -880,7 +878,7 @@ void
 Mod_LoadBrushModel(model_t *mod, void *buffer)
 {
 	int i;
-	dheader_t *header;
+	dheader_t header;
 	mmodel_t *bm;
 
 	loadmodel->type = mod_brush;
@@ -890,9 +888,7 @@ Mod_LoadBrushModel(model_t *mod, void *buffer)
 		VID_Error(ERR_DROP, "Loaded a brush model after the world");
 	}
 
-	header = (dheader_t *)buffer;
-
-	i = LittleLong(header->version);
+	i = LittleLong(((dheader_t *)buffer)->version);
 
 	if (i != BSPVERSION)
 	{
@@ -900,27 +896,29 @@ Mod_LoadBrushModel(model_t *mod, void *buffer)
 				mod->name, i, BSPVERSION);
 	}
 
-	/* swap all the lumps */
-	mod_base = (byte *)header;
+	/* swap all the lumps into a copy of the header,
+	   the file itself may be mapped read only */
+	mod_base = (byte *)buffer;
 
 	for (i = 0; i < sizeof(dheader_t) / 4; i++)
 	{
-		((int *)header)[i] = LittleLong(((int *)header)[i]);
+		((int *)&header)[i] = LittleLong(((int *)buffer)[i]);
 	}
 
 	/* load into heap */
-	Mod_LoadVertexes(&header->lumps[LUMP_VERTEXES]);
-	Mod_LoadEdges(&header->lumps[LUMP_EDGES]);
-	Mod_LoadSurfedges(&header->lumps[LUMP_SURFEDGES]);
-	Mod_LoadLighting(&header->lumps[LUMP_LIGHTING]);
-	Mod_LoadPlanes(&header->lumps[LUMP_PLANES]);
-	Mod_LoadTexinfo(&header->lumps[LUMP_TEXINFO]);
-	Mod_LoadFaces(&header->lumps[LUMP_FACES]);
-	Mod_LoadMarksurfaces(&header->lumps[LUMP_LEAFFACES]);
-	Mod_LoadVisibility(&header->lumps[LUMP_VISIBILITY]);
-	Mod_LoadLeafs(&header->lumps[LUMP_LEAFS]);
-	Mod_LoadNodes(&header->lumps[LUMP_NODES]);
-	Mod_LoadSubmodels(&header->lumps[LUMP_MODELS]);
+	Mod_LoadVertexes(&header.lumps[LUMP_VERTEXES]);
+	Mod_LoadEdges(&header.lumps[LUMP_EDGES]);
+	Mod_LoadSurfedges(&header.lumps[LUMP_SURFEDGES]);
+	Mod_LoadLighting(&header.lumps[LUMP_LIGHTING]);
+	Mod_LoadPlanes(&header.lumps[LUMP_PLANES]);
+	Mod_LoadTexinfo(&header.lumps[LUMP_TEXINFO]);
+	Mod_LoadFaces(&header.lumps[LUMP_FACES]);
+	Mod_LoadMarksurfaces(&header.lumps[LUMP_LEAFFACES]);
+	Mod_LoadVisibility(&header.lumps[LUMP_VISIBILITY]);
+	Mod_LoadLeafs(&header.lumps[LUMP_LEAFS]);
+	Mod_LoadNodes(&header.lumps[LUMP_NODES]);
+	Mod_LoadSubmodels(&header.lumps[LUMP_MODELS]);
+	R_BuildWorldGeometry(mod);
 	mod->numframes = 2; /* regular and alternate animation */
 
 	/* set up the submodels */
@@ -958,6 +956,11 @@ Mod_LoadBrushModel(model_t *mod, void *buffer)
 void
 Mod_Free(model_t *mod)
 {
+	if (mod->type == mod_brush)
+	{
+		R_FreeWorldGeometry();
+	}
+
 	Hunk_Free(mod->extradata);
 	memset(mod, 0, sizeof(*mod));
 }
@@ -29,17 +29,62 @@
 
 int c_visible_lightmaps;
 int c_visible_textures;
+int c_world_drawcalls;
+int c_world_usec;
+int c_lightmap_builds;
+int c_lightmap_usec;
+int c_lightmap_uploads;
+int c_texture_binds;
 static vec3_t modelorg; /* relative to viewpoint */
 msurface_t *r_alpha_surfaces;
 
 gllightmapstate_t gl_lms;
 
+/* the polys of all world surfaces that aren't warped,
+   in one vertex array. surfaces sharing a texture or
+   a lightmap are collected into one index list and
+   drawn with a single call. */
+typedef struct
+{
+	GLuint vbo;         /* 0 if drawn from client memory */
+	float *verts;       /* VERTEXSIZE floats per vertex */
+	int numverts;
+
+	GLuint *indexes;    /* the batch being collected */
+	int numindexes;
+} glworldgeo_t;
+
+static glworldgeo_t gl_worldgeo;
+
+/* lightmaps to rebuild before they are blended. they are
+   built in parallel into staging memory, then uploaded */
+typedef struct
+{
+	msurface_t *surf;
+	int offset; /* into the staging memory, if dynamic */
+} lightmapjob_t;
+
+typedef struct
+{
+	lightmapjob_t *jobs;
+	int numjobs;
+	int maxjobs;
+	int firstdynamic; /* the jobs before are built into their pages */
+	qboolean failed; /* set by the jobs, a surface had no lightmap */
+
+	byte *staging; /* LIGHTMAP_BYTES per texel */
+	int stagingsize;
+	int stagingused;
+} gllightmapjobs_t;
+
+static gllightmapjobs_t gl_lmjobs;
+
 void LM_InitBlock(void);
 void LM_UploadBlock(qboolean dynamic);
 qboolean LM_AllocBlock(int w, int h, int *x, int *y);
 
 void R_SetCacheState(msurface_t *surf);
-void R_BuildLightMap(msurface_t *surf, byte *dest, int stride);
+qboolean R_BuildLightMap(msurface_t *surf, byte *dest, int stride);
 
 /*
  * Returns the proper texture for a given time and base texture
@@ -81,6 +126,8 @@ R_DrawGLPoly(glpoly_t *p)
 
     glDisableClientState( GL_VERTEX_ARRAY );
     glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+
+	c_world_drawcalls++;
 }
 
 void
@@ -121,6 +168,8 @@ R_DrawGLFlowingPoly(msurface_t *fa)
 
     glDisableClientState( GL_VERTEX_ARRAY );
     glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+
+	c_world_drawcalls++;
 }
 
 void
@@ -204,6 +253,8 @@ R_DrawGLPolyChain(glpoly_t *p, float soffset, float toffset)
 
             glDisableClientState( GL_VERTEX_ARRAY );
             glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+
+			c_world_drawcalls++;
 		}
 	}
 	else
@@ -235,8 +286,394 @@ R_DrawGLPolyChain(glpoly_t *p, float soffset, float toffset)
 
             glDisableClientState( GL_VERTEX_ARRAY );
             glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+
+			c_world_drawcalls++;
+		}
+	}
+}
+
+/*
+ * Packs the polys of a freshly loaded map into the world
+ * geometry, in a vertex buffer object if there are any
+ */
+void
+R_BuildWorldGeometry(model_t *mod)
+{
+	msurface_t *surf;
+	glpoly_t *p;
+	int i, numverts, numindexes;
+
+	R_FreeWorldGeometry();
+
+	numverts = 0;
+	numindexes = 0;
+
+	for (i = 0, surf = mod->surfaces; i < mod->numsurfaces; i++, surf++)
+	{
+		if (surf->flags & SURF_DRAWTURB)
+		{
+			continue;
+		}
+
+		for (p = surf->polys; p; p = p->next)
+		{
+			numverts += p->numverts;
+			numindexes += (p->numverts - 2) * 3;
+		}
+	}
+
+	if (!numverts)
+	{
+		return;
+	}
+
+	gl_worldgeo.verts = malloc(numverts * VERTEXSIZE * sizeof(float));
+	gl_worldgeo.indexes = malloc(numindexes * sizeof(GLuint));
+
+	if (!gl_worldgeo.verts || !gl_worldgeo.indexes)
+	{
+		/* everything is drawn poly by poly */
+		R_FreeWorldGeometry();
+		return;
+	}
+
+	for (i = 0, surf = mod->surfaces; i < mod->numsurfaces; i++, surf++)
+	{
+		if (surf->flags & SURF_DRAWTURB)
+		{
+			continue;
+		}
+
+		for (p = surf->polys; p; p = p->next)
+		{
+			p->firstvert = gl_worldgeo.numverts;
+			memcpy(gl_worldgeo.verts + p->firstvert * VERTEXSIZE, p->verts,
+					p->numverts * VERTEXSIZE * sizeof(float));
+			gl_worldgeo.numverts += p->numverts;
+		}
+	}
+
+	if (gl_config.vbo)
+	{
+		qglGenBuffersARB(1, &gl_worldgeo.vbo);
+		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_worldgeo.vbo);
+		qglBufferDataARB(GL_ARRAY_BUFFER_ARB,
+				gl_worldgeo.numverts * VERTEXSIZE * sizeof(float),
+				gl_worldgeo.verts, GL_STATIC_DRAW_ARB);
+		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+		/* the driver has its own copy now */
+		free(gl_worldgeo.verts);
+		gl_worldgeo.verts = NULL;
+	}
+}
+
+void
+R_FreeWorldGeometry(void)
+{
+	if (gl_worldgeo.vbo)
+	{
+		qglDeleteBuffersARB(1, &gl_worldgeo.vbo);
+	}
+
+	free(gl_worldgeo.verts);
+	free(gl_worldgeo.indexes);
+
+	memset(&gl_worldgeo, 0, sizeof(gl_worldgeo));
+}
+
+/*
+ * Polys of the world geometry can be batched,
+ * the others are drawn one by one
+ */
+static qboolean
+R_CanBatch(glpoly_t *p)
+{
+	return gl_batchworld->value && gl_worldgeo.indexes && (p->firstvert >= 0);
+}
+
+static void
+R_AddPolyToBatch(glpoly_t *p)
+{
+	GLuint *index;
+	int i;
+
+	index = gl_worldgeo.indexes + gl_worldgeo.numindexes;
+
+	/* the triangle fan as triangles */
+	for (i = 2; i < p->numverts; i++)
+	{
+		*index++ = p->firstvert;
+		*index++ = p->firstvert + i - 1;
+		*index++ = p->firstvert + i;
+	}
+
+	gl_worldgeo.numindexes += (p->numverts - 2) * 3;
+}
+
+/*
+ * Draws the batch with the texture coordinates
+ * at texcoords, 3 for the texture or 5 for the
+ * lightmap, and starts the next one
+ */
+static void
+R_DrawBatch(int texcoords)
+{
+	byte *base;
+
+	if (!gl_worldgeo.numindexes)
+	{
+		return;
+	}
+
+	if (gl_worldgeo.vbo)
+	{
+		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_worldgeo.vbo);
+		base = NULL;
+	}
+	else
+	{
+		base = (byte *)gl_worldgeo.verts;
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	glVertexPointer(3, GL_FLOAT, VERTEXSIZE * sizeof(GLfloat), base);
+	glTexCoordPointer(2, GL_FLOAT, VERTEXSIZE * sizeof(GLfloat),
+			base + texcoords * sizeof(GLfloat));
+	glDrawElements(GL_TRIANGLES, gl_worldgeo.numindexes, GL_UNSIGNED_INT,
+			gl_worldgeo.indexes);
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	if (gl_worldgeo.vbo)
+	{
+		qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	}
+
+	c_world_drawcalls++;
+	gl_worldgeo.numindexes = 0;
+}
+
+static void
+R_QueueLightmap(msurface_t *surf, qboolean dynamic)
+{
+	lightmapjob_t *job;
+	int smax, tmax;
+
+	if (gl_lmjobs.numjobs == gl_lmjobs.maxjobs)
+	{
+		gl_lmjobs.maxjobs = gl_lmjobs.maxjobs ? gl_lmjobs.maxjobs * 2 : 256;
+		gl_lmjobs.jobs = realloc(gl_lmjobs.jobs,
+				gl_lmjobs.maxjobs * sizeof(lightmapjob_t));
+
+		if (!gl_lmjobs.jobs)
+		{
+			VID_Error(ERR_FATAL, "R_QueueLightmap: couldn't allocate %i jobs",
+					gl_lmjobs.maxjobs);
 		}
 	}
+
+	smax = (surf->extents[0] >> 4) + 1;
+	tmax = (surf->extents[1] >> 4) + 1;
+
+	job = &gl_lmjobs.jobs[gl_lmjobs.numjobs++];
+	job->surf = surf;
+	job->offset = gl_lmjobs.stagingused;
+
+	if (dynamic)
+	{
+		gl_lmjobs.stagingused += smax * tmax * LIGHTMAP_BYTES;
+	}
+}
+
+/*
+ * Runs on the job threads, so only R_BuildLightMap()
+ * may be called. Errors are reported by the render
+ * thread once all jobs are done.
+ */
+static void
+R_BuildQueuedLightmap(int job)
+{
+	msurface_t *surf;
+	byte *dest;
+	int stride;
+
+	surf = gl_lmjobs.jobs[job].surf;
+
+	if (job < gl_lmjobs.firstdynamic)
+	{
+		/* surfaces of a page don't overlap, so
+		   they can be built there in parallel */
+		stride = gl_lms.size * LIGHTMAP_BYTES;
+		dest = gl_lms.pages[surf->lightmaptexturenum] +
+			surf->light_t * stride + surf->light_s * LIGHTMAP_BYTES;
+	}
+	else
+	{
+		stride = ((surf->extents[0] >> 4) + 1) * LIGHTMAP_BYTES;
+		dest = gl_lmjobs.staging + gl_lmjobs.jobs[job].offset;
+	}
+
+	if (!R_BuildLightMap(surf, dest, stride))
+	{
+		gl_lmjobs.failed = true;
+	}
+}
+
+/*
+ * Copies a built lightmap into the dynamic block
+ */
+static void
+R_CopyQueuedLightmap(int job, byte *dest)
+{
+	msurface_t *surf;
+	byte *src;
+	int smax, tmax, t;
+
+	surf = gl_lmjobs.jobs[job].surf;
+	src = gl_lmjobs.staging + gl_lmjobs.jobs[job].offset;
+
+	smax = (surf->extents[0] >> 4) + 1;
+	tmax = (surf->extents[1] >> 4) + 1;
+
+	for (t = 0; t < tmax; t++)
+	{
+		memcpy(dest, src, smax * LIGHTMAP_BYTES);
+
+		src += smax * LIGHTMAP_BYTES;
+		dest += gl_lms.size * LIGHTMAP_BYTES;
+	}
+}
+
+/*
+ * Builds all lightmaps that changed since the last frame
+ * at once. Those whose lightstyles changed are built into
+ * their pages, and each page gets one upload of the part
+ * that changed. If dynamic the dynamically lit surfaces
+ * are built, too, and the job of the first is returned.
+ * R_BlendLightmaps copies them into the dynamic block and
+ * clears the queue.
+ */
+static int
+R_UpdateQueuedLightmaps(qboolean dynamic)
+{
+	static int dirty[MAX_LIGHTMAPS][4]; /* x, y, right, bottom */
+	msurface_t *surf;
+	int i, smax, tmax, firstdynamic;
+	int *rect;
+	long long start;
+
+	/* the surfaces whose lightstyles changed
+	   were queued by R_UpdateSurfaceLightmap */
+	firstdynamic = gl_lmjobs.numjobs;
+
+	if (dynamic)
+	{
+		for (surf = gl_lms.lightmap_surfaces[0];
+			 surf != 0;
+			 surf = surf->lightmapchain)
+		{
+			R_QueueLightmap(surf, true);
+		}
+	}
+
+	if (gl_lmjobs.stagingused > gl_lmjobs.stagingsize)
+	{
+		gl_lmjobs.stagingsize = gl_lmjobs.stagingused * 2;
+		gl_lmjobs.staging = realloc(gl_lmjobs.staging, gl_lmjobs.stagingsize);
+
+		if (!gl_lmjobs.staging)
+		{
+			VID_Error(ERR_FATAL, "R_UpdateQueuedLightmaps: couldn't allocate %i bytes",
+					gl_lmjobs.stagingsize);
+		}
+	}
+
+	if (gl_lmjobs.numjobs)
+	{
+		PROF_BEGIN("R_BuildLightMaps");
+		start = Sys_Microseconds();
+
+		gl_lmjobs.firstdynamic = firstdynamic;
+		R_RunJobs(R_BuildQueuedLightmap, gl_lmjobs.numjobs);
+
+		c_lightmap_usec += Sys_Microseconds() - start;
+		c_lightmap_builds += gl_lmjobs.numjobs;
+		PROF_END();
+
+		if (gl_lmjobs.failed)
+		{
+			gl_lmjobs.failed = false;
+			gl_lmjobs.numjobs = 0;
+			gl_lmjobs.stagingused = 0;
+
+			VID_Error(ERR_DROP, "R_UpdateQueuedLightmaps: surface isn't lit or too large");
+		}
+	}
+
+	if (firstdynamic)
+	{
+		for (i = 0; i < firstdynamic; i++)
+		{
+			surf = gl_lmjobs.jobs[i].surf;
+
+			smax = (surf->extents[0] >> 4) + 1;
+			tmax = (surf->extents[1] >> 4) + 1;
+
+			R_SetCacheState(surf);
+
+			rect = dirty[surf->lightmaptexturenum];
+
+			if (!rect[2])
+			{
+				rect[0] = surf->light_s;
+				rect[1] = surf->light_t;
+				rect[2] = surf->light_s + smax;
+				rect[3] = surf->light_t + tmax;
+				continue;
+			}
+
+			rect[0] = surf->light_s < rect[0] ? surf->light_s : rect[0];
+			rect[1] = surf->light_t < rect[1] ? surf->light_t : rect[1];
+			rect[2] = surf->light_s + smax > rect[2] ? surf->light_s + smax : rect[2];
+			rect[3] = surf->light_t + tmax > rect[3] ? surf->light_t + tmax : rect[3];
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, gl_lms.size);
+
+		for (i = 1; i < gl_lms.current_lightmap_texture; i++)
+		{
+			rect = dirty[i];
+
+			if (!rect[2])
+			{
+				continue;
+			}
+
+			R_Bind(gl_state.lightmap_textures + i);
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect[0], rect[1],
+					rect[2] - rect[0], rect[3] - rect[1], GL_LIGHTMAP_FORMAT,
+					GL_UNSIGNED_BYTE, gl_lms.pages[i] +
+					(rect[1] * gl_lms.size + rect[0]) * LIGHTMAP_BYTES);
+
+			c_lightmap_uploads++;
+			rect[2] = 0;
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	}
+
+	if (!dynamic)
+	{
+		gl_lmjobs.numjobs = 0;
+		gl_lmjobs.stagingused = 0;
+	}
+
+	return firstdynamic;
 }
 
 /*
@@ -246,9 +683,14 @@ R_DrawGLPolyChain(glpoly_t *p, float soffset, float toffset)
 void
 R_BlendLightmaps(void)
 {
-	int i;
+	int i, job;
+	qboolean dynamic;
 	msurface_t *surf, *newdrawsurf = 0;
 
+	dynamic = gl_dynamic->value && !gl_fullbright->value &&
+		r_worldmodel->lightdata;
+	job = R_UpdateQueuedLightmaps(dynamic);
+
 	/* don't bother if we're set to fullbright */
 	if (gl_fullbright->value)
 	{
@@ -309,14 +751,23 @@ R_BlendLightmaps(void)
 						glTexEnvi(GL_TEXTURE_ENV, GL_RGB_SCALE_EXT, gl_overbrightbits->value);
 					}
 
-					R_DrawGLPolyChain(surf->polys, 0, 0);
+					if (R_CanBatch(surf->polys))
+					{
+						R_AddPolyToBatch(surf->polys);
+					}
+					else
+					{
+						R_DrawGLPolyChain(surf->polys, 0, 0);
+					}
 				}
 			}
+
+			R_DrawBatch(5);
 		}
 	}
 
 	/* render dynamic lightmaps */
-	if (gl_dynamic->value)
+	if (dynamic)
 	{
 		LM_InitBlock();
 
@@ -342,10 +793,10 @@ R_BlendLightmaps(void)
 			if (LM_AllocBlock(smax, tmax, &surf->dlight_s, &surf->dlight_t))
 			{
 				base = gl_lms.lightmap_buffer;
-				base += (surf->dlight_t * BLOCK_WIDTH +
+				base += (surf->dlight_t * gl_lms.size +
 						surf->dlight_s) * LIGHTMAP_BYTES;
 
-				R_BuildLightMap(surf, base, BLOCK_WIDTH * LIGHTMAP_BYTES);
+				R_CopyQueuedLightmap(job++, base);
 			}
 			else
 			{
@@ -369,8 +820,8 @@ R_BlendLightmaps(void)
 						}
 
 						R_DrawGLPolyChain(drawsurf->polys,
-								(drawsurf->light_s - drawsurf->dlight_s) * (1.0 / 128.0),
-								(drawsurf->light_t - drawsurf->dlight_t) * (1.0 / 128.0));
+								(drawsurf->light_s - drawsurf->dlight_s) / (float)gl_lms.size,
+								(drawsurf->light_t - drawsurf->dlight_t) / (float)gl_lms.size);
 					}
 				}
 
@@ -388,10 +839,10 @@ R_BlendLightmaps(void)
 				}
 
 				base = gl_lms.lightmap_buffer;
-				base += (surf->dlight_t * BLOCK_WIDTH +
+				base += (surf->dlight_t * gl_lms.size +
 						surf->dlight_s) * LIGHTMAP_BYTES;
 
-				R_BuildLightMap(surf, base, BLOCK_WIDTH * LIGHTMAP_BYTES);
+				R_CopyQueuedLightmap(job++, base);
 			}
 		}
 
@@ -413,10 +864,13 @@ R_BlendLightmaps(void)
 				}
 
 				R_DrawGLPolyChain(surf->polys,
-						(surf->light_s - surf->dlight_s) * (1.0 / 128.0),
-						(surf->light_t - surf->dlight_t) * (1.0 / 128.0));
+						(surf->light_s - surf->dlight_s) / (float)gl_lms.size,
+						(surf->light_t - surf->dlight_t) / (float)gl_lms.size);
 			}
 		}
+
+		gl_lmjobs.numjobs = 0;
+		gl_lmjobs.stagingused = 0;
 	}
 
 	/* restore state */
@@ -425,12 +879,12 @@ R_BlendLightmaps(void)
 	glDepthMask(1);
 }
 
+static void R_UpdateSurfaceLightmap(msurface_t *fa);
+
 void
 R_RenderBrushPoly(msurface_t *fa)
 {
-	int maps;
 	image_t *image;
-	qboolean is_dynamic = false;
 
 	c_brush_polys++;
 
@@ -486,6 +940,19 @@ R_RenderBrushPoly(msurface_t *fa)
 		R_DrawGLPoly(fa->polys);
 	}
 
+	R_UpdateSurfaceLightmap(fa);
+}
+
+/*
+ * Updates the lightmap of a surface if its lightstyles
+ * changed and adds it to the chain of its lightmap
+ */
+static void
+R_UpdateSurfaceLightmap(msurface_t *fa)
+{
+	int maps;
+	qboolean is_dynamic = false;
+
 	/* check for lightmap modification */
 	for (maps = 0; maps < MAXLIGHTMAPS && fa->styles[maps] != 255; maps++)
 	{
@@ -518,19 +985,8 @@ R_RenderBrushPoly(msurface_t *fa)
 			 (fa->styles[maps] == 0)) &&
 			  (fa->dlightframe != r_framecount))
 		{
-			unsigned temp[34 * 34];
-			int smax, tmax;
-
-			smax = (fa->extents[0] >> 4) + 1;
-			tmax = (fa->extents[1] >> 4) + 1;
-
-			R_BuildLightMap(fa, (void *)temp, smax * 4);
-			R_SetCacheState(fa);
-
-			R_Bind(gl_state.lightmap_textures + fa->lightmaptexturenum);
-
-			glTexSubImage2D(GL_TEXTURE_2D, 0, fa->light_s, fa->light_t,
-					smax, tmax, GL_LIGHTMAP_FORMAT, GL_UNSIGNED_BYTE, temp);
+			/* rebuilt in R_UpdateQueuedLightmaps */
+			R_QueueLightmap(fa, false);
 
 			fa->lightmapchain = gl_lms.lightmap_surfaces[fa->lightmaptexturenum];
 			gl_lms.lightmap_surfaces[fa->lightmaptexturenum] = fa;
@@ -635,7 +1091,26 @@ R_DrawTextureChains(void)
 
 		for ( ; s; s = s->texturechain)
 		{
-			R_RenderBrushPoly(s);
+			if ((s->flags & SURF_DRAWTURB) ||
+				(s->texinfo->flags & SURF_FLOWING) ||
+				!R_CanBatch(s->polys))
+			{
+				R_RenderBrushPoly(s);
+			}
+			else
+			{
+				c_brush_polys++;
+				R_AddPolyToBatch(s->polys);
+				R_UpdateSurfaceLightmap(s);
+			}
+		}
+
+		/* warped surfaces leave another texture environment */
+		if (gl_worldgeo.numindexes)
+		{
+			R_Bind(image->texnum);
+			R_TexEnv(GL_REPLACE);
+			R_DrawBatch(3);
 		}
 
 		image->texturechain = NULL;
@@ -705,6 +1180,8 @@ R_DrawInlineBModel(void)
 	}
 	else
 	{
+		R_UpdateQueuedLightmaps(false);
+
 		glDisable(GL_BLEND);
 		glColor4f(1, 1, 1, 1);
 		R_TexEnv(GL_REPLACE);
@@ -931,6 +1408,7 @@ void
 R_DrawWorld(void)
 {
 	entity_t ent;
+	long long start;
 
 	if (!gl_drawworld->value)
 	{
@@ -956,6 +1434,9 @@ R_DrawWorld(void)
 	glColor4f(1, 1, 1, 1);
 	memset(gl_lms.lightmap_surfaces, 0, sizeof(gl_lms.lightmap_surfaces));
 
+	PROF_BEGIN("R_DrawWorld");
+	start = Sys_Microseconds();
+
 	R_ClearSkyBox();
 	R_RecursiveWorldNode(r_worldmodel->nodes);
 	R_DrawTextureChains();
@@ -963,6 +1444,9 @@ R_DrawWorld(void)
 	R_DrawSkyBox();
 	R_DrawTriangleOutlines();
 
+	c_world_usec = (int)(Sys_Microseconds() - start);
+	PROF_END();
+
 	currententity = NULL;
 }
 
@@ -209,6 +209,7 @@ R_SubdividePolygon(int numverts, float *verts)
 	/* add a point in the center to help keep warp valid */
 	poly = Hunk_Alloc(sizeof(glpoly_t) + ((numverts - 4) + 2) * VERTEXSIZE * sizeof(float));
 	poly->next = warpface->polys;
+	poly->firstvert = -1;
 	warpface->polys = poly;
 	poly->numverts = numverts + 2;
 	VectorClear(total);
@@ -329,6 +330,8 @@ R_EmitWaterPolys(msurface_t *fa)
 
         glDisableClientState( GL_VERTEX_ARRAY );
         glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+
+		c_world_drawcalls++;
 	}
 }
 
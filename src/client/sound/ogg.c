@@ -347,8 +347,9 @@ OGG_LoadPlaylist(char *playlist)
 	int i;		  /* Loop counter. */
 	int size;     /* Length of buffer and strings. */
 
-	/* Open playlist. */
-	if ((size = FS_LoadFile(va("%s/%s.lst", OGG_DIR, 
+	/* Open playlist. strtok() writes into the buffer,
+	   so it mustn't be a read only mapping. */
+	if ((size = FS_LoadFileWritable(va("%s/%s.lst", OGG_DIR, 
 				  ogg_playlist->string), (void **)&buffer)) < 0)
 	{
 		Com_Printf("OGG_LoadPlaylist: could not open playlist: %s.\n",
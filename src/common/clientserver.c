@@ -30,6 +30,9 @@
 
 #define MAXPRINTMSG 4096
 
+#define PRINT_QUEUE_SIZE 256 /* slots, power of two */
+#define PRINT_QUEUE_MSGSIZE 512
+
 FILE *logfile;
 cvar_t *logfile_active;  /* 1 = buffer log, 2 = flush after each print */
 jmp_buf abortframe; /* an ERR_DROP occured, exit the entire frame */
@@ -40,6 +43,26 @@ static char *rd_buffer;
 static int rd_buffersize;
 static void (*rd_flush)(int target, char *buffer);
 
+/* prints of other threads wait in a ring until
+   the main thread takes them out. a slot can be
+   written once its sequence equals the position
+   it is claimed for and read once it's one more.
+   a long message is published by its first slot,
+   which holds the number of slots it takes */
+typedef struct
+{
+	unsigned sequence;
+	int count;
+	char text[PRINT_QUEUE_MSGSIZE];
+} printslot_t;
+
+static printslot_t print_queue[PRINT_QUEUE_SIZE];
+static unsigned print_head; /* next slot claimed by a thread */
+static unsigned print_tail; /* next slot printed by the main thread */
+static unsigned print_dropped;
+static qboolean print_queueinit;
+static __thread qboolean print_mainthread;
+
 void
 Com_BeginRedirect(int target, char *buffer, int buffersize, void (*flush))
 {
@@ -67,32 +90,9 @@ Com_EndRedirect(void)
 	rd_flush = NULL;
 }
 
-/*
- * Both client and server can use this, and it will output
- * to the apropriate place.
- */
-void
-Com_Printf(char *fmt, ...)
+static void
+Com_PrintMessage(char *msg)
 {
-	va_list argptr;
-	char msg[MAXPRINTMSG];
-
-	va_start(argptr, fmt);
-	vsnprintf(msg, MAXPRINTMSG, fmt, argptr);
-	va_end(argptr);
-
-	if (rd_target)
-	{
-		if ((strlen(msg) + strlen(rd_buffer)) > (rd_buffersize - 1))
-		{
-			rd_flush(rd_target, rd_buffer);
-			*rd_buffer = 0;
-		}
-
-		strcat(rd_buffer, msg);
-		return;
-	}
-
 #ifndef DEDICATED_ONLY
 	Con_Print(msg);
 #endif
@@ -132,6 +132,184 @@ Com_Printf(char *fmt, ...)
 	}
 }
 
+/*
+ * Makes the calling thread the main thread, which
+ * prints right away. Other threads queue their prints.
+ */
+void
+Com_InitPrintQueue(void)
+{
+	int i;
+
+	for (i = 0; i < PRINT_QUEUE_SIZE; i++)
+	{
+		print_queue[i].sequence = i;
+	}
+
+	print_mainthread = true;
+	print_queueinit = true;
+}
+
+static void
+Com_QueuePrint(const char *msg)
+{
+	printslot_t *slot;
+	unsigned pos;
+	size_t len;
+	int count;
+	int diff;
+	int i;
+
+	len = strlen(msg);
+
+	/* long messages take several slots, claimed together
+	   so that other threads can't queue between the parts */
+	count = len ? (len + PRINT_QUEUE_MSGSIZE - 2) / (PRINT_QUEUE_MSGSIZE - 1) : 1;
+
+	pos = __atomic_load_n(&print_head, __ATOMIC_RELAXED);
+
+	while (1)
+	{
+		slot = &print_queue[pos & (PRINT_QUEUE_SIZE - 1)];
+		diff = (int)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0)
+		{
+			/* the main thread frees slots in order, so
+			   if the last one is free all of them are */
+			slot = &print_queue[(pos + count - 1) & (PRINT_QUEUE_SIZE - 1)];
+			diff = (int)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) -
+					(pos + count - 1));
+		}
+
+		if (diff == 0)
+		{
+			/* on failure pos is updated to the current head */
+			if (__atomic_compare_exchange_n(&print_head, &pos, pos + count,
+						true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			/* full, the main thread is busy, drop
+			   the whole message instead of a part */
+			__atomic_fetch_add(&print_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n(&print_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	/* the first slot is published last, so the main
+	   thread takes the message as a whole */
+	for (i = count - 1; i >= 0; i--)
+	{
+		slot = &print_queue[(pos + i) & (PRINT_QUEUE_SIZE - 1)];
+
+		Q_strlcpy(slot->text, msg + i * (PRINT_QUEUE_MSGSIZE - 1),
+				sizeof(slot->text));
+		slot->count = i ? 0 : count;
+
+		__atomic_store_n(&slot->sequence, pos + i + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * Prints what other threads queued, called
+ * by the main thread
+ */
+void
+Com_FlushPrints(void)
+{
+	printslot_t *slot;
+	unsigned dropped;
+	char msg[64];
+	int count;
+	int i;
+
+	if (!print_queueinit)
+	{
+		return;
+	}
+
+	while (1)
+	{
+		slot = &print_queue[print_tail & (PRINT_QUEUE_SIZE - 1)];
+
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != print_tail + 1)
+		{
+			break;
+		}
+
+		/* the other slots of the message were
+		   published before its first one */
+		count = slot->count;
+
+		for (i = 0; i < count; i++)
+		{
+			slot = &print_queue[(print_tail + i) & (PRINT_QUEUE_SIZE - 1)];
+			Com_PrintMessage(slot->text);
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			slot = &print_queue[print_tail & (PRINT_QUEUE_SIZE - 1)];
+			__atomic_store_n(&slot->sequence, print_tail + PRINT_QUEUE_SIZE,
+					__ATOMIC_RELEASE);
+			print_tail++;
+		}
+	}
+
+	if ((dropped = __atomic_exchange_n(&print_dropped, 0, __ATOMIC_RELAXED)))
+	{
+		Com_sprintf(msg, sizeof(msg), "%u prints of other threads dropped.\n",
+				dropped);
+		Com_PrintMessage(msg);
+	}
+}
+
+/*
+ * Both client and server can use this, and it will output
+ * to the apropriate place. Threads other than the main
+ * thread only queue the message.
+ */
+void
+Com_Printf(char *fmt, ...)
+{
+	va_list argptr;
+	char msg[MAXPRINTMSG];
+
+	va_start(argptr, fmt);
+	vsnprintf(msg, MAXPRINTMSG, fmt, argptr);
+	va_end(argptr);
+
+	if (print_queueinit && !print_mainthread)
+	{
+		Com_QueuePrint(msg);
+		return;
+	}
+
+	if (rd_target)
+	{
+		if ((strlen(msg) + strlen(rd_buffer)) > (rd_buffersize - 1))
+		{
+			rd_flush(rd_target, rd_buffer);
+			*rd_buffer = 0;
+		}
+
+		strcat(rd_buffer, msg);
+		return;
+	}
+
+	/* keep the order with prints of other threads */
+	Com_FlushPrints();
+	Com_PrintMessage(msg);
+}
+
 /*
  * A Com_Printf that only shows up if the "developer" cvar is set
  */
@@ -197,6 +375,9 @@ Com_Error(int code, char *fmt, ...)
 	vsnprintf(msg, MAXPRINTMSG, fmt, argptr);
 	va_end(argptr);
 
+	/* a load that failed won't finish its timing */
+	FS_StopLoadTiming();
+
 	if (code == ERR_DISCONNECT)
 	{
 #ifndef DEDICATED_ONLY
@@ -31,22 +31,31 @@
 #define MAX_ALIAS_NAME 32
 #define ALIAS_LOOP_COUNT 16
 
+/* commands and aliases are hashed case insensitive,
+   the lists themselves stay for ordered iteration */
+#define CMD_HASH_SIZE 512
+
 typedef struct cmd_function_s
 {
 	struct cmd_function_s *next;
+	struct cmd_function_s *hash_next;
 	char *name;
 	xcommand_t function;
 } cmd_function_t;
 
 static cmd_function_t *cmd_functions; /* possible commands to execute */
+static cmd_function_t *cmd_hash[CMD_HASH_SIZE];
 
 typedef struct cmdalias_s
 {
 	struct cmdalias_s *next;
+	struct cmdalias_s *hash_next;
 	char name[MAX_ALIAS_NAME];
 	char *value;
 } cmdalias_t;
 
+static cmdalias_t *cmd_aliashash[CMD_HASH_SIZE];
+
 char retval[256];
 int alias_count; /* for detecting runaway loops */
 cmdalias_t *cmd_alias;
@@ -60,6 +69,27 @@ sizebuf_t cmd_text;
 byte cmd_text_buf[8192];
 char defer_text_buf[8192];
 
+/* text queued by other threads */
+typedef struct cmdqueued_s
+{
+	struct cmdqueued_s *next;
+	char text[1];
+} cmdqueued_t;
+
+static cmdqueued_t *cmd_queue; /* newest first */
+static cmdqueued_t *cmd_pending; /* taken off cmd_queue, oldest first */
+
+/* cmd_queuetest state, only touched by the main thread
+   except for queuetest_count, which is set before the
+   threads are started */
+#define QUEUETEST_MAX_THREADS 16
+
+static int queuetest_threads;
+static int queuetest_count;
+static int queuetest_next[QUEUETEST_MAX_THREADS];
+static int queuetest_received;
+static int queuetest_errors;
+
 /*
  * Causes execution of the remainder of the command buffer to be delayed
  * until next frame.  This allows commands like: bind g "impulse 5 ;
@@ -96,6 +126,77 @@ Cbuf_AddText(char *text)
 	SZ_Write(&cmd_text, text, strlen(text));
 }
 
+/*
+ * Adds command text at the end of the buffer, like Cbuf_AddText(),
+ * but may be called from any thread. The text is pushed onto a
+ * lock-free stack, the next Cbuf_Execute() on the main thread moves
+ * it into the buffer.
+ */
+void
+Cbuf_QueueText(char *text)
+{
+	cmdqueued_t *q;
+	size_t l;
+
+	l = strlen(text);
+
+	if (!(q = malloc(sizeof(cmdqueued_t) + l)))
+	{
+		return;
+	}
+
+	memcpy(q->text, text, l + 1);
+	q->next = __atomic_load_n(&cmd_queue, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&cmd_queue, &q->next, q, true,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+	}
+}
+
+/*
+ * Moves queued text into the command buffer, oldest
+ * first. What doesn't fit stays pending for the next
+ * Cbuf_Execute().
+ */
+static void
+Cbuf_AddQueued(void)
+{
+	cmdqueued_t *q, *next, *prev, **tail;
+
+	if (__atomic_load_n(&cmd_queue, __ATOMIC_RELAXED))
+	{
+		q = __atomic_exchange_n(&cmd_queue, NULL, __ATOMIC_ACQUIRE);
+
+		/* back into the order it was queued in */
+		prev = NULL;
+
+		while (q)
+		{
+			next = q->next;
+			q->next = prev;
+			prev = q;
+			q = next;
+		}
+
+		for (tail = &cmd_pending; *tail; tail = &(*tail)->next)
+		{
+		}
+
+		*tail = prev;
+	}
+
+	while (cmd_pending &&
+		   (cmd_text.cursize + strlen(cmd_pending->text) < cmd_text.maxsize))
+	{
+		q = cmd_pending;
+		cmd_pending = q->next;
+
+		Cbuf_AddText(q->text);
+		free(q);
+	}
+}
+
 /*
  * Adds command text immediately after the current command
  * Adds a \n to the text
@@ -175,6 +276,8 @@ Cbuf_Execute(void)
 
 	alias_count = 0; /* don't allow infinite alias loops */
 
+	Cbuf_AddQueued();
+
 	while (cmd_text.cursize)
 	{
 		/* find a \n or ; line break */
@@ -405,6 +508,141 @@ Cmd_Echo_f(void)
 	Com_Printf("\n");
 }
 
+static void
+Cmd_QueueTestThread(void *arg)
+{
+	char text[64];
+	int thread;
+	int i;
+
+	thread = (int)(size_t)arg;
+
+	for (i = 0; i < queuetest_count; i++)
+	{
+		Com_sprintf(text, sizeof(text), "cmd_queuecheck %i %i\n", thread, i);
+		Cbuf_QueueText(text);
+	}
+}
+
+/*
+ * Queues commands from several threads at once with
+ * Cbuf_QueueText(). cmd_queuecheck counts them as they
+ * run and reports lost or reordered ones.
+ */
+void
+Cmd_QueueTest_f(void)
+{
+	void *threads[QUEUETEST_MAX_THREADS];
+	int i;
+
+	if (queuetest_received < queuetest_threads * queuetest_count)
+	{
+		Com_Printf("cmd_queuetest: still running.\n");
+		return;
+	}
+
+	queuetest_threads = (Cmd_Argc() > 1) ? (int)strtol(Cmd_Argv(1), NULL, 10) : 4;
+	queuetest_count = (Cmd_Argc() > 2) ? (int)strtol(Cmd_Argv(2), NULL, 10) : 1000;
+
+	if ((queuetest_threads < 1) || (queuetest_threads > QUEUETEST_MAX_THREADS) ||
+		(queuetest_count < 1))
+	{
+		Com_Printf("usage: cmd_queuetest [threads 1-%i] [commands per thread]\n",
+				QUEUETEST_MAX_THREADS);
+		queuetest_threads = 0;
+		return;
+	}
+
+	memset(queuetest_next, 0, sizeof(queuetest_next));
+	queuetest_received = 0;
+	queuetest_errors = 0;
+
+	for (i = 0; i < queuetest_threads; i++)
+	{
+		threads[i] = Sys_CreateThread(Cmd_QueueTestThread, (void *)(size_t)i);
+
+		if (threads[i] == NULL)
+		{
+			Com_Printf("cmd_queuetest: couldn't create thread %i.\n", i);
+			break;
+		}
+	}
+
+	/* the commands run from the next Cbuf_Execute() on */
+	queuetest_threads = i;
+
+	for (i = 0; i < queuetest_threads; i++)
+	{
+		Sys_WaitThread(threads[i]);
+	}
+}
+
+void
+Cmd_QueueCheck_f(void)
+{
+	int thread, i;
+
+	thread = (int)strtol(Cmd_Argv(1), NULL, 10);
+	i = (int)strtol(Cmd_Argv(2), NULL, 10);
+
+	if ((thread < 0) || (thread >= queuetest_threads) ||
+		(queuetest_received >= queuetest_threads * queuetest_count))
+	{
+		return;
+	}
+
+	if (i != queuetest_next[thread])
+	{
+		queuetest_errors++;
+	}
+
+	queuetest_next[thread] = i + 1;
+	queuetest_received++;
+
+	if (queuetest_received == queuetest_threads * queuetest_count)
+	{
+		Com_Printf("cmd_queuetest: %i commands from %i threads, %i out of order.\n",
+				queuetest_received, queuetest_threads, queuetest_errors);
+	}
+}
+
+static cmd_function_t *
+Cmd_FindCommand(char *cmd_name, qboolean nocase)
+{
+	cmd_function_t *cmd;
+
+	cmd = cmd_hash[Q_strcasehash(cmd_name) & (CMD_HASH_SIZE - 1)];
+
+	for ( ; cmd; cmd = cmd->hash_next)
+	{
+		if (nocase ? !Q_strcasecmp(cmd_name, cmd->name) :
+			!strcmp(cmd_name, cmd->name))
+		{
+			return cmd;
+		}
+	}
+
+	return NULL;
+}
+
+static cmdalias_t *
+Cmd_FindAlias(char *name, qboolean nocase)
+{
+	cmdalias_t *a;
+
+	a = cmd_aliashash[Q_strcasehash(name) & (CMD_HASH_SIZE - 1)];
+
+	for ( ; a; a = a->hash_next)
+	{
+		if (nocase ? !Q_strcasecmp(name, a->name) : !strcmp(name, a->name))
+		{
+			return a;
+		}
+	}
+
+	return NULL;
+}
+
 /*
  * Creates a new command that executes
  * a command string (possibly ; seperated)
@@ -416,6 +654,7 @@ Cmd_Alias_f(void)
 	char cmd[1024];
 	int i, c;
 	char *s;
+	unsigned hash;
 
 	if (Cmd_Argc() == 1)
 	{
@@ -438,23 +677,23 @@ Cmd_Alias_f(void)
 	}
 
 	/* if the alias already exists, reuse it */
-	for (a = cmd_alias; a; a = a->next)
+	a = Cmd_FindAlias(s, false);
+
+	if (a)
 	{
-		if (!strcmp(s, a->name))
-		{
-			Z_Free(a->value);
-			break;
-		}
+		Z_Free(a->value);
 	}
-
-	if (!a)
+	else
 	{
 		a = Z_Malloc(sizeof(cmdalias_t));
 		a->next = cmd_alias;
 		cmd_alias = a;
-	}
+		strcpy(a->name, s);
 
-	strcpy(a->name, s);
+		hash = Q_strcasehash(a->name) & (CMD_HASH_SIZE - 1);
+		a->hash_next = cmd_aliashash[hash];
+		cmd_aliashash[hash] = a;
+	}
 
 	/* copy the rest of the command line */
 	cmd[0] = 0; /* start out with a null string */
@@ -681,6 +920,7 @@ Cmd_AddCommand(char *cmd_name, xcommand_t function)
 {
 	cmd_function_t *cmd;
 	cmd_function_t **pos;
+	unsigned hash;
 
 	/* fail if the command is a variable name */
 	if (Cvar_VariableString(cmd_name)[0])
@@ -689,19 +929,20 @@ Cmd_AddCommand(char *cmd_name, xcommand_t function)
 	}
 
 	/* fail if the command already exists */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if (Cmd_FindCommand(cmd_name, false))
 	{
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			Com_Printf("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Com_Printf("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = Z_Malloc(sizeof(cmd_function_t));
 	cmd->name = cmd_name;
 	cmd->function = function;
 
+	hash = Q_strcasehash(cmd_name) & (CMD_HASH_SIZE - 1);
+	cmd->hash_next = cmd_hash[hash];
+	cmd_hash[hash] = cmd;
+
 	/* link the command in */
 	pos = &cmd_functions;
 	while (*pos && strcmp((*pos)->name, cmd->name) < 0)
@@ -732,6 +973,16 @@ Cmd_RemoveCommand(char *cmd_name)
 		if (!strcmp(cmd_name, cmd->name))
 		{
 			*back = cmd->next;
+
+			back = &cmd_hash[Q_strcasehash(cmd_name) & (CMD_HASH_SIZE - 1)];
+
+			while (*back != cmd)
+			{
+				back = &(*back)->hash_next;
+			}
+
+			*back = cmd->hash_next;
+
 			Z_Free(cmd);
 			return;
 		}
@@ -743,17 +994,7 @@ Cmd_RemoveCommand(char *cmd_name)
 qboolean
 Cmd_Exists(char *cmd_name)
 {
-	cmd_function_t *cmd;
-
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
-	{
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			return true;
-		}
-	}
-
-	return false;
+	return Cmd_FindCommand(cmd_name, false) != NULL;
 }
 
 int
@@ -780,20 +1021,14 @@ Cmd_CompleteCommand(char *partial)
 	}
 
 	/* check for exact match */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if ((cmd = Cmd_FindCommand(partial, false)))
 	{
-		if (!strcmp(partial, cmd->name))
-		{
-			return cmd->name;
-		}
+		return cmd->name;
 	}
 
-	for (a = cmd_alias; a; a = a->next)
+	if ((a = Cmd_FindAlias(partial, false)))
 	{
-		if (!strcmp(partial, a->name))
-		{
-			return a->name;
-		}
+		return a->name;
 	}
 
 	for (cvar = cvar_vars; cvar; cvar = cvar->next)
@@ -889,25 +1124,12 @@ Cmd_CompleteCommand(char *partial)
 qboolean
 Cmd_IsComplete(char *command)
 {
-	cmd_function_t *cmd;
-	cmdalias_t *a;
 	cvar_t *cvar;
 
 	/* check for exact match */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if (Cmd_FindCommand(command, false) || Cmd_FindAlias(command, false))
 	{
-		if (!strcmp(command, cmd->name))
-		{
-			return true;
-		}
-	}
-
-	for (a = cmd_alias; a; a = a->next)
-	{
-		if (!strcmp(command, a->name))
-		{
-			return true;
-		}
+		return true;
 	}
 
 	for (cvar = cvar_vars; cvar; cvar = cvar->next)
@@ -948,38 +1170,32 @@ Cmd_ExecuteString(char *text)
 	}
 
 	/* check functions */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if ((cmd = Cmd_FindCommand(cmd_argv[0], true)))
 	{
-		if (!Q_strcasecmp(cmd_argv[0], cmd->name))
+		if (!cmd->function)
 		{
-			if (!cmd->function)
-			{
-				/* forward to server command */
-				Cmd_ExecuteString(va("cmd %s", text));
-			}
-			else
-			{
-				cmd->function();
-			}
-
-			return;
+			/* forward to server command */
+			Cmd_ExecuteString(va("cmd %s", text));
 		}
+		else
+		{
+			cmd->function();
+		}
+
+		return;
 	}
 
 	/* check alias */
-	for (a = cmd_alias; a; a = a->next)
+	if ((a = Cmd_FindAlias(cmd_argv[0], true)))
 	{
-		if (!Q_strcasecmp(cmd_argv[0], a->name))
+		if (++alias_count == ALIAS_LOOP_COUNT)
 		{
-			if (++alias_count == ALIAS_LOOP_COUNT)
-			{
-				Com_Printf("ALIAS_LOOP_COUNT\n");
-				return;
-			}
-
-			Cbuf_InsertText(a->value);
+			Com_Printf("ALIAS_LOOP_COUNT\n");
 			return;
 		}
+
+		Cbuf_InsertText(a->value);
+		return;
 	}
 
 	/* check cvars */
@@ -1019,5 +1235,7 @@ Cmd_Init(void)
 	Cmd_AddCommand("echo", Cmd_Echo_f);
 	Cmd_AddCommand("alias", Cmd_Alias_f);
 	Cmd_AddCommand("wait", Cmd_Wait_f);
+	Cmd_AddCommand("cmd_queuetest", Cmd_QueueTest_f);
+	Cmd_AddCommand("cmd_queuecheck", Cmd_QueueCheck_f);
 }
 
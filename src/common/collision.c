@@ -27,6 +27,26 @@
 
 #include "header/common.h"
 
+#if defined(__SSE2__)
+ #include <emmintrin.h>
+ #define CM_KERNEL "SSE2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define CM_NEON
+ #define CM_KERNEL "NEON"
+#else
+ #define CM_KERNEL "scalar"
+#endif
+
+/* groups of four brush sides, packed as a structure
+   of arrays so that the clip kernels can evaluate
+   four planes at once. Unused lanes get a zero normal
+   and a positive distance, they never clip anything. */
+#define MAX_MAP_PACKEDSIDES ((MAX_MAP_BRUSHSIDES + 6) / 4 + MAX_MAP_BRUSHES + 1)
+
+/* per frame trace cache, must be a power of two */
+#define TRACE_CACHE_SIZE 1024
+
 typedef struct
 {
 	cplane_t	*plane;
@@ -53,9 +73,26 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
+	int			firstpackedside; /* index into map_packedsides */
 	int			checkcount;	/* to avoid repeated testings */
 } cbrush_t;
 
+typedef struct
+{
+	float		normal[3][4];
+	float		dist[4];
+} cpackedsides_t;
+
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			headnode;
+	int			brushmask;
+	int			framenum; /* entry is valid if it equals trace_cacheframe */
+	trace_t		trace;
+} ctracecache_t;
+
 typedef struct
 {
 	int		numareaportals;
@@ -68,9 +105,11 @@ byte *cmod_base;
 byte map_visibility[MAX_MAP_VISIBILITY];
 byte pvsrow[MAX_MAP_LEAFS / 8];
 byte phsrow[MAX_MAP_LEAFS / 8];
+byte nullrow[MAX_MAP_LEAFS / 8]; /* never written */
 carea_t	map_areas[MAX_MAP_AREAS];
 cbrush_t map_brushes[MAX_MAP_BRUSHES];
 cbrushside_t map_brushsides[MAX_MAP_BRUSHSIDES];
+cpackedsides_t map_packedsides[MAX_MAP_PACKEDSIDES];
 char map_name[MAX_QPATH];
 char map_entitystring[MAX_MAP_ENTSTRING];
 cbrush_t *box_brush;
@@ -78,8 +117,12 @@ cleaf_t	*box_leaf;
 cleaf_t	map_leafs[MAX_MAP_LEAFS];
 cmodel_t map_cmodels[MAX_MAP_MODELS];
 cnode_t	map_nodes[MAX_MAP_NODES+6]; /* extra for box hull */
+cpackedsides_t *box_packedsides;
 cplane_t *box_planes;
 cplane_t map_planes[MAX_MAP_PLANES+6]; /* extra for box hull */
+cvar_t *cm_simd;
+cvar_t *cm_tracecache;
+cvar_t *cm_viscache;
 cvar_t *map_noareas;
 dareaportal_t map_areaportals[MAX_MAP_AREAPORTALS];
 dvis_t *map_vis = (dvis_t *)map_visibility;
@@ -87,10 +130,6 @@ int box_headnode;
 int	checkcount;
 int	emptyleaf, solidleaf;
 int	floodvalid;
-float *leaf_mins, *leaf_maxs;
-int leaf_count, leaf_maxcount;
-int *leaf_list;
-int leaf_topnode;
 int	numareaportals;
 int numareas = 1;
 int	numbrushes;
@@ -101,15 +140,26 @@ int	numentitychars;
 int	numleafbrushes;
 int numleafs = 1; /* allow leaf funcs to be called without a map */
 int	numnodes;
+int	numpackedsides;
 int	numplanes;
 int	numtexinfo;
 int	numvisibility;
+
+/* decompressed PVS rows followed by the PHS rows */
+byte *map_viscache;
+int map_visrowbytes;
+int map_viscachesize;
+
 int trace_contents;
 mapsurface_t map_surfaces[MAX_MAP_TEXINFO];
 mapsurface_t nullsurface;
 qboolean portalopen[MAX_MAP_AREAPORTALS];
 qboolean trace_ispoint; /* optimized case */
+qboolean trace_packed; /* use the packed brush sides */
 trace_t trace_trace;
+ctracecache_t trace_cache[TRACE_CACHE_SIZE];
+int trace_cacheframe = 1;
+int trace_cachelookups, trace_cachehits;
 unsigned short	map_leafbrushes[MAX_MAP_LEAFBRUSHES];
 vec3_t trace_start, trace_end;
 vec3_t trace_mins, trace_maxs;
@@ -119,6 +169,9 @@ vec3_t trace_extents;
 int		c_pointcontents;
 int		c_traces, c_brush_traces;
 #endif
+
+static void CM_FreeVisCache(void);
+static void CM_BuildVisCache(void);
  
 /* 1/32 epsilon to keep floating point happy */
 #define DIST_EPSILON (0.03125f)
@@ -405,6 +458,14 @@ CM_HeadnodeForBox(vec3_t mins, vec3_t maxs)
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
+	/* side i of the box brush uses plane i * 2 + (i & 1) */
+	box_packedsides[0].dist[0] = maxs[0];
+	box_packedsides[0].dist[1] = -mins[0];
+	box_packedsides[0].dist[2] = maxs[1];
+	box_packedsides[0].dist[3] = -mins[1];
+	box_packedsides[1].dist[0] = maxs[2];
+	box_packedsides[1].dist[1] = -mins[2];
+
 	return box_headnode;
 }
 
@@ -460,11 +521,19 @@ CM_PointLeafnum(vec3_t p)
 }
 
 /*
- * Fills in a list of all the leafs touched
+ * Fills in a list of all the leafs touched. The state is kept
+ * on the stack, the server builds client frames in parallel.
  */
-
-void
-CM_BoxLeafnums_r(int nodenum)
+typedef struct
+{
+	float *mins, *maxs;
+	int *list;
+	int count, maxcount;
+	int topnode;
+} leafnums_t;
+
+static void
+CM_BoxLeafnums_r(leafnums_t *ln, int nodenum)
 {
 	cplane_t *plane;
 	cnode_t *node;
@@ -474,18 +543,18 @@ CM_BoxLeafnums_r(int nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (ln->count >= ln->maxcount)
 			{
 				return;
 			}
 
-			leaf_list[leaf_count++] = -1 - nodenum;
+			ln->list[ln->count++] = -1 - nodenum;
 			return;
 		}
 
 		node = &map_nodes[nodenum];
 		plane = node->plane;
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+		s = BOX_ON_PLANE_SIDE(ln->mins, ln->maxs, plane);
 
 		if (s == 1)
 		{
@@ -500,12 +569,12 @@ CM_BoxLeafnums_r(int nodenum)
 		else
 		{
 			/* go down both */
-			if (leaf_topnode == -1)
+			if (ln->topnode == -1)
 			{
-				leaf_topnode = nodenum;
+				ln->topnode = nodenum;
 			}
 
-			CM_BoxLeafnums_r(node->children[0]);
+			CM_BoxLeafnums_r(ln, node->children[0]);
 			nodenum = node->children[1];
 		}
 	}
@@ -515,22 +584,24 @@ int
 CM_BoxLeafnums_headnode(vec3_t mins, vec3_t maxs, int *list,
 		int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	leafnums_t ln;
 
-	leaf_topnode = -1;
+	ln.list = list;
+	ln.count = 0;
+	ln.maxcount = listsize;
+	ln.mins = mins;
+	ln.maxs = maxs;
 
-	CM_BoxLeafnums_r(headnode);
+	ln.topnode = -1;
+
+	CM_BoxLeafnums_r(&ln, headnode);
 
 	if (topnode)
 	{
-		*topnode = leaf_topnode;
+		*topnode = ln.topnode;
 	}
 
-	return leaf_count;
+	return ln.count;
 }
 
 int
@@ -792,6 +863,297 @@ CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 	trace->contents = brush->contents;
 }
 
+/*
+ * Computes the distances of p1 and p2 to four packed brush
+ * sides, with the planes pushed out for mins/maxs unless
+ * this is a point trace. The arithmetic is done in the same
+ * order as in CM_ClipBoxToBrush, so the results are bit
+ * identical. Returns a mask of the lanes that have both
+ * points in front of the plane with d2 >= d1.
+ */
+static int
+CM_PackedSideDistances(const cpackedsides_t *sides, const vec3_t p1,
+		const vec3_t p2, const vec3_t mins, const vec3_t maxs,
+		qboolean ispoint, float *d1, float *d2)
+{
+#if defined(__SSE2__)
+	__m128 nx, ny, nz, dist, zero, m, ox, oy, oz, v1, v2;
+
+	nx = _mm_loadu_ps(sides->normal[0]);
+	ny = _mm_loadu_ps(sides->normal[1]);
+	nz = _mm_loadu_ps(sides->normal[2]);
+	dist = _mm_loadu_ps(sides->dist);
+	zero = _mm_setzero_ps();
+
+	if (!ispoint)
+	{
+		m = _mm_cmplt_ps(nx, zero);
+		ox = _mm_or_ps(_mm_and_ps(m, _mm_set1_ps(maxs[0])),
+				_mm_andnot_ps(m, _mm_set1_ps(mins[0])));
+		m = _mm_cmplt_ps(ny, zero);
+		oy = _mm_or_ps(_mm_and_ps(m, _mm_set1_ps(maxs[1])),
+				_mm_andnot_ps(m, _mm_set1_ps(mins[1])));
+		m = _mm_cmplt_ps(nz, zero);
+		oz = _mm_or_ps(_mm_and_ps(m, _mm_set1_ps(maxs[2])),
+				_mm_andnot_ps(m, _mm_set1_ps(mins[2])));
+
+		dist = _mm_sub_ps(dist, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx),
+						_mm_mul_ps(oy, ny)), _mm_mul_ps(oz, nz)));
+	}
+
+	v1 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(p1[0]), nx),
+					_mm_mul_ps(_mm_set1_ps(p1[1]), ny)),
+				_mm_mul_ps(_mm_set1_ps(p1[2]), nz)), dist);
+	v2 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(p2[0]), nx),
+					_mm_mul_ps(_mm_set1_ps(p2[1]), ny)),
+				_mm_mul_ps(_mm_set1_ps(p2[2]), nz)), dist);
+
+	_mm_storeu_ps(d1, v1);
+	_mm_storeu_ps(d2, v2);
+
+	return _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(v1, zero),
+				_mm_cmpge_ps(v2, v1)));
+#elif defined(CM_NEON)
+	float32x4_t nx, ny, nz, dist, zero, v1, v2;
+	uint32x4_t m;
+	uint32_t lanes[4];
+
+	nx = vld1q_f32(sides->normal[0]);
+	ny = vld1q_f32(sides->normal[1]);
+	nz = vld1q_f32(sides->normal[2]);
+	dist = vld1q_f32(sides->dist);
+	zero = vdupq_n_f32(0);
+
+	if (!ispoint)
+	{
+		float32x4_t ox, oy, oz;
+
+		ox = vbslq_f32(vcltq_f32(nx, zero), vdupq_n_f32(maxs[0]),
+				vdupq_n_f32(mins[0]));
+		oy = vbslq_f32(vcltq_f32(ny, zero), vdupq_n_f32(maxs[1]),
+				vdupq_n_f32(mins[1]));
+		oz = vbslq_f32(vcltq_f32(nz, zero), vdupq_n_f32(maxs[2]),
+				vdupq_n_f32(mins[2]));
+
+		dist = vsubq_f32(dist, vaddq_f32(vaddq_f32(vmulq_f32(ox, nx),
+						vmulq_f32(oy, ny)), vmulq_f32(oz, nz)));
+	}
+
+	v1 = vsubq_f32(vaddq_f32(vaddq_f32(
+					vmulq_f32(vdupq_n_f32(p1[0]), nx),
+					vmulq_f32(vdupq_n_f32(p1[1]), ny)),
+				vmulq_f32(vdupq_n_f32(p1[2]), nz)), dist);
+	v2 = vsubq_f32(vaddq_f32(vaddq_f32(
+					vmulq_f32(vdupq_n_f32(p2[0]), nx),
+					vmulq_f32(vdupq_n_f32(p2[1]), ny)),
+				vmulq_f32(vdupq_n_f32(p2[2]), nz)), dist);
+
+	vst1q_f32(d1, v1);
+	vst1q_f32(d2, v2);
+
+	m = vandq_u32(vcgtq_f32(v1, zero), vcgeq_f32(v2, v1));
+	vst1q_u32(lanes, m);
+
+	return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+#else
+	int i, j;
+	int mask;
+	float dist;
+	vec3_t ofs;
+
+	mask = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		dist = sides->dist[i];
+
+		if (!ispoint)
+		{
+			for (j = 0; j < 3; j++)
+			{
+				ofs[j] = sides->normal[j][i] < 0 ? maxs[j] : mins[j];
+			}
+
+			dist -= ofs[0] * sides->normal[0][i] + ofs[1] * sides->normal[1][i] +
+				ofs[2] * sides->normal[2][i];
+		}
+
+		d1[i] = (p1[0] * sides->normal[0][i] + p1[1] * sides->normal[1][i] +
+				p1[2] * sides->normal[2][i]) - dist;
+		d2[i] = (p2[0] * sides->normal[0][i] + p2[1] * sides->normal[1][i] +
+				p2[2] * sides->normal[2][i]) - dist;
+
+		if ((d1[i] > 0) && (d2[i] >= d1[i]))
+		{
+			mask |= 1 << i;
+		}
+	}
+
+	return mask;
+#endif
+}
+
+/*
+ * Same as CM_ClipBoxToBrush, but works on the packed
+ * brush sides four at a time.
+ */
+static void
+CM_ClipBoxToPackedBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
+		vec3_t p2, trace_t *trace, cbrush_t *brush)
+{
+	int i, l;
+	cplane_t *clipplane;
+	float enterfrac, leavefrac;
+	float d1[4], d2[4];
+	qboolean getout, startout;
+	float f;
+	cbrushside_t *leadside;
+	cpackedsides_t *sides;
+
+	enterfrac = -1;
+	leavefrac = 1;
+	clipplane = NULL;
+
+	if (!brush->numsides)
+	{
+		return;
+	}
+
+#ifndef DEDICATED_ONLY
+	c_brush_traces++;
+#endif
+
+	getout = false;
+	startout = false;
+	leadside = NULL;
+	sides = &map_packedsides[brush->firstpackedside];
+
+	for (i = 0; i < brush->numsides; i += 4, sides++)
+	{
+		/* if completely in front of a face, no intersection */
+		if (CM_PackedSideDistances(sides, p1, p2, mins, maxs,
+					trace_ispoint, d1, d2))
+		{
+			return;
+		}
+
+		for (l = 0; l < 4; l++)
+		{
+			if (d2[l] > 0)
+			{
+				getout = true; /* endpoint is not in solid */
+			}
+
+			if (d1[l] > 0)
+			{
+				startout = true;
+			}
+
+			if ((d1[l] <= 0) && (d2[l] <= 0))
+			{
+				continue;
+			}
+
+			/* crosses face */
+			if (d1[l] > d2[l])
+			{
+				/* enter */
+				f = (d1[l] - DIST_EPSILON) / (d1[l] - d2[l]);
+
+				if (f > enterfrac)
+				{
+					enterfrac = f;
+					leadside = &map_brushsides[brush->firstbrushside + i + l];
+					clipplane = leadside->plane;
+				}
+			}
+
+			else
+			{
+				/* leave */
+				f = (d1[l] + DIST_EPSILON) / (d1[l] - d2[l]);
+
+				if (f < leavefrac)
+				{
+					leavefrac = f;
+				}
+			}
+		}
+	}
+
+	if (!startout)
+	{
+		/* original point was inside brush */
+		trace->startsolid = true;
+
+		if (!getout)
+		{
+			trace->allsolid = true;
+		}
+
+		return;
+	}
+
+	if (enterfrac < leavefrac)
+	{
+		if ((enterfrac > -1) && (enterfrac < trace->fraction))
+		{
+			if (enterfrac < 0)
+			{
+				enterfrac = 0;
+			}
+
+			if (clipplane == NULL)
+			{
+				Com_Error(ERR_FATAL, "clipplane was NULL!\n");
+			}
+
+			trace->fraction = enterfrac;
+			trace->plane = *clipplane;
+			trace->surface = &(leadside->surface->c);
+			trace->contents = brush->contents;
+		}
+	}
+}
+
+/*
+ * Same as CM_TestBoxInBrush, but works on the packed
+ * brush sides four at a time.
+ */
+static void
+CM_TestBoxInPackedBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
+		trace_t *trace, cbrush_t *brush)
+{
+	int i;
+	float d1[4], d2[4];
+	cpackedsides_t *sides;
+
+	if (!brush->numsides)
+	{
+		return;
+	}
+
+	sides = &map_packedsides[brush->firstpackedside];
+
+	for (i = 0; i < brush->numsides; i += 4, sides++)
+	{
+		/* with p2 == p1 the mask holds all
+		   lanes with the point in front */
+		if (CM_PackedSideDistances(sides, p1, p1, mins, maxs,
+					false, d1, d2))
+		{
+			return;
+		}
+	}
+
+	/* inside this brush */
+	trace->startsolid = trace->allsolid = true;
+	trace->fraction = 0;
+	trace->contents = brush->contents;
+}
+
 void
 CM_TraceToLeaf(int leafnum)
 {
@@ -825,8 +1187,17 @@ CM_TraceToLeaf(int leafnum)
 			continue;
 		}
 
-		CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start,
-				trace_end, &trace_trace, b);
+		if (trace_packed)
+		{
+			CM_ClipBoxToPackedBrush(trace_mins, trace_maxs, trace_start,
+					trace_end, &trace_trace, b);
+		}
+
+		else
+		{
+			CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start,
+					trace_end, &trace_trace, b);
+		}
 
 		if (!trace_trace.fraction)
 		{
@@ -868,7 +1239,17 @@ CM_TestInLeaf(int leafnum)
 			continue;
 		}
 
-		CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start, &trace_trace, b);
+		if (trace_packed)
+		{
+			CM_TestBoxInPackedBrush(trace_mins, trace_maxs, trace_start,
+					&trace_trace, b);
+		}
+
+		else
+		{
+			CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start,
+					&trace_trace, b);
+		}
 
 		if (!trace_trace.fraction)
 		{
@@ -1010,17 +1391,14 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
-trace_t
-CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
-		int headnode, int brushmask)
+static trace_t
+CM_BoxTraceUncached(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+		int headnode, int brushmask, qboolean packed)
 {
 	int i;
 
 	checkcount++; /* for multi-check avoidance */
-
-#ifndef DEDICATED_ONLY
-	c_traces++; /* for statistics, may be zeroed */
-#endif
+	trace_packed = packed;
 
 	/* fill in a default trace */
 	memset(&trace_trace, 0, sizeof(trace_trace));
@@ -1108,6 +1486,87 @@ CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 	return trace_trace;
 }
 
+/*
+ * Hashes the trace inputs snapped to the 1/8 unit grid
+ * used by the network protocol. The hash only selects
+ * the slot, hits are verified against the exact inputs.
+ */
+static int
+CM_TraceCacheSlot(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+		int headnode, int brushmask)
+{
+	unsigned hash;
+	int i;
+
+	hash = (unsigned)headnode * 31 + (unsigned)brushmask;
+
+	for (i = 0; i < 3; i++)
+	{
+		hash = hash * 31 + (unsigned)(int)(start[i] * 8);
+		hash = hash * 31 + (unsigned)(int)(end[i] * 8);
+		hash = hash * 31 + (unsigned)(int)(mins[i] * 8);
+		hash = hash * 31 + (unsigned)(int)(maxs[i] * 8);
+	}
+
+	hash ^= hash >> 16;
+
+	return hash & (TRACE_CACHE_SIZE - 1);
+}
+
+trace_t
+CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+		int headnode, int brushmask)
+{
+	ctracecache_t *entry;
+
+#ifndef DEDICATED_ONLY
+	c_traces++; /* for statistics, may be zeroed */
+#endif
+
+	/* the box hull changes with every CM_HeadnodeForBox,
+	   everything else is static for the map */
+	if (!cm_tracecache->value || !numnodes || (headnode == box_headnode))
+	{
+		return CM_BoxTraceUncached(start, end, mins, maxs, headnode,
+				brushmask, cm_simd->value != 0);
+	}
+
+	trace_cachelookups++;
+
+	entry = &trace_cache[CM_TraceCacheSlot(start, end, mins, maxs,
+			headnode, brushmask)];
+
+	if ((entry->framenum == trace_cacheframe) &&
+		(entry->headnode == headnode) && (entry->brushmask == brushmask) &&
+		VectorCompare(entry->start, start) && VectorCompare(entry->end, end) &&
+		VectorCompare(entry->mins, mins) && VectorCompare(entry->maxs, maxs))
+	{
+		trace_cachehits++;
+		return entry->trace;
+	}
+
+	entry->trace = CM_BoxTraceUncached(start, end, mins, maxs, headnode,
+			brushmask, cm_simd->value != 0);
+	entry->framenum = trace_cacheframe;
+	entry->headnode = headnode;
+	entry->brushmask = brushmask;
+	VectorCopy(start, entry->start);
+	VectorCopy(end, entry->end);
+	VectorCopy(mins, entry->mins);
+	VectorCopy(maxs, entry->maxs);
+
+	return entry->trace;
+}
+
+/*
+ * Invalidates all cached traces. Called once per frame.
+ */
+void
+CM_ClearTraceCache(void)
+{
+	trace_cacheframe++;
+}
+
 /*
  * Handles offseting and rotation of the end points for moving and
  * rotating entities
@@ -1533,6 +1992,59 @@ CMod_LoadBrushSides(lump_t *l)
 	}
 }
 
+/*
+ * Copies the planes of all brushes, including the box
+ * brush, into the four wide layout used by the clip kernels.
+ */
+void
+CMod_PackBrushSides(void)
+{
+	int i, j, k;
+	cbrush_t *brush;
+	cplane_t *plane;
+	cpackedsides_t *out;
+
+	numpackedsides = 0;
+
+	for (i = 0, brush = map_brushes; i <= numbrushes; i++, brush++)
+	{
+		if (numpackedsides + (brush->numsides + 3) / 4 > MAX_MAP_PACKEDSIDES)
+		{
+			Com_Error(ERR_DROP, "Map has too many brush sides");
+		}
+
+		brush->firstpackedside = numpackedsides;
+		out = &map_packedsides[numpackedsides];
+
+		for (j = 0; j < brush->numsides; j += 4, out++)
+		{
+			for (k = 0; k < 4; k++)
+			{
+				if (j + k < brush->numsides)
+				{
+					plane = map_brushsides[brush->firstbrushside + j + k].plane;
+					out->normal[0][k] = plane->normal[0];
+					out->normal[1][k] = plane->normal[1];
+					out->normal[2][k] = plane->normal[2];
+					out->dist[k] = plane->dist;
+				}
+
+				else
+				{
+					out->normal[0][k] = 0;
+					out->normal[1][k] = 0;
+					out->normal[2][k] = 0;
+					out->dist[k] = 1;
+				}
+			}
+
+			numpackedsides++;
+		}
+	}
+
+	box_packedsides = &map_packedsides[box_brush->firstpackedside];
+}
+
 void
 CMod_LoadAreas(lump_t *l)
 {
@@ -1651,6 +2163,7 @@ CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 	}
 
 	/* free old stuff */
+	CM_FreeVisCache();
 	numplanes = 0;
 	numnodes = 0;
 	numleafs = 0;
@@ -1712,6 +2225,9 @@ CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 	FS_FreeFile(buf);
 
 	CM_InitBoxHull();
+	CMod_PackBrushSides();
+	CM_ClearTraceCache();
+	CM_BuildVisCache();
 
 	memset(portalopen, 0, sizeof(portalopen));
 	FloodAreaConnections();
@@ -1840,14 +2356,141 @@ CM_DecompressVis(byte *in, byte *out)
 	while (out_p - out < row);
 }
 
+static void
+CM_FreeVisCache(void)
+{
+	if (map_viscache)
+	{
+		Z_Free(map_viscache);
+	}
+
+	map_viscache = NULL;
+	map_viscachesize = 0;
+}
+
+/*
+ * Decompresses all PVS and PHS rows up front, as long as they
+ * fit into cm_viscache kilobytes. Rows are padded to whole
+ * words, so that CM_OrVis() can merge them without a tail.
+ */
+static void
+CM_BuildVisCache(void)
+{
+	int i, size;
+
+	CM_FreeVisCache();
+
+	map_visrowbytes = ((numclusters + 31) >> 5) << 2;
+	size = numclusters * map_visrowbytes * 2;
+
+	if (!numvisibility || !size)
+	{
+		return;
+	}
+
+	if (size > cm_viscache->value * 1024)
+	{
+		Com_DPrintf("PVS/PHS cache: %i KB needed, cm_viscache is %i KB\n",
+				size >> 10, (int)cm_viscache->value);
+		return;
+	}
+
+	map_viscache = Z_Malloc(size);
+	map_viscachesize = size;
+
+	for (i = 0; i < numclusters; i++)
+	{
+		CM_DecompressVis(map_visibility +
+				LittleLong(map_vis->bitofs[i][DVIS_PVS]),
+				map_viscache + i * map_visrowbytes);
+		CM_DecompressVis(map_visibility +
+				LittleLong(map_vis->bitofs[i][DVIS_PHS]),
+				map_viscache + (numclusters + i) * map_visrowbytes);
+	}
+
+	Com_DPrintf("PVS/PHS cache: %i clusters, %i KB\n",
+			numclusters, size >> 10);
+}
+
+static void
+CM_VisInfo_f(void)
+{
+	if (!map_name[0])
+	{
+		Com_Printf("No map loaded.\n");
+		return;
+	}
+
+	Com_Printf("%s: %i clusters, %i bytes compressed vis\n",
+			map_name, numclusters, numvisibility);
+
+	if (map_viscache)
+	{
+		Com_Printf("PVS/PHS cache: %i bytes per row, %i bytes\n",
+				map_visrowbytes, map_viscachesize);
+	}
+	else
+	{
+		Com_Printf("PVS/PHS cache: not in use\n");
+	}
+}
+
+/*
+ * dst |= src for size bytes, size must be a multiple of 4
+ */
+void
+CM_OrVis(byte *dst, const byte *src, int size)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	for ( ; i + 16 <= size; i += 16)
+	{
+		_mm_storeu_si128((__m128i *)(dst + i),
+				_mm_or_si128(_mm_loadu_si128((__m128i *)(dst + i)),
+					_mm_loadu_si128((const __m128i *)(src + i))));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for ( ; i + 16 <= size; i += 16)
+	{
+		vst1q_u8(dst + i, vorrq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+	}
+#endif
+
+	for ( ; i < size; i += 4)
+	{
+		*(unsigned *)(dst + i) |= *(const unsigned *)(src + i);
+	}
+}
+
+/*
+ * With the cache the rows are only read, so
+ * CM_ClusterPVS/PHS are safe to call from threads.
+ */
+qboolean
+CM_VisCached(void)
+{
+	return map_viscache != NULL;
+}
+
 byte *
 CM_ClusterPVS(int cluster)
 {
-	if (cluster == -1)
+	if ((cluster == -1) && map_viscache)
+	{
+		return nullrow;
+	}
+
+	else if (cluster == -1)
 	{
 		memset(pvsrow, 0, (numclusters + 7) >> 3);
 	}
 
+	else if (map_viscache)
+	{
+		return map_viscache + cluster * map_visrowbytes;
+	}
+
 	else
 	{
 		CM_DecompressVis(map_visibility +
@@ -1860,11 +2503,21 @@ CM_ClusterPVS(int cluster)
 byte *
 CM_ClusterPHS(int cluster)
 {
-	if (cluster == -1)
+	if ((cluster == -1) && map_viscache)
+	{
+		return nullrow;
+	}
+
+	else if (cluster == -1)
 	{
 		memset(phsrow, 0, (numclusters + 7) >> 3);
 	}
 
+	else if (map_viscache)
+	{
+		return map_viscache + (numclusters + cluster) * map_visrowbytes;
+	}
+
 	else
 	{
 		CM_DecompressVis(map_visibility +
@@ -1874,3 +2527,154 @@ CM_ClusterPHS(int cluster)
 	return phsrow;
 }
 
+
+static qboolean
+CM_TracesEqual(trace_t *a, trace_t *b)
+{
+	return (a->allsolid == b->allsolid) && (a->startsolid == b->startsolid) &&
+		   (a->fraction == b->fraction) && VectorCompare(a->endpos, b->endpos) &&
+		   VectorCompare(a->plane.normal, b->plane.normal) &&
+		   (a->plane.dist == b->plane.dist) && (a->surface == b->surface) &&
+		   (a->contents == b->contents);
+}
+
+/*
+ * Fires random traces through the loaded map and checks
+ * that the packed kernel and the trace cache return the
+ * same results as the plain scalar code.
+ */
+static void
+CM_TraceTest_f(void)
+{
+	static vec3_t boxes[3][2] = {
+		{{0, 0, 0}, {0, 0, 0}},
+		{{-16, -16, -24}, {16, 16, 32}},
+		{{-15, -15, -15}, {15, 15, 15}}
+	};
+	int count, i, j;
+	int kernelbad, cachebad;
+	int lookups, hits;
+	long long start, scalartime, packedtime;
+	vec3_t *points;
+	trace_t *results;
+	trace_t tr;
+	float *mins, *maxs;
+	int mask;
+
+	if (!numnodes)
+	{
+		Com_Printf("No map loaded.\n");
+		return;
+	}
+
+	count = 10000;
+
+	if (Cmd_Argc() > 1)
+	{
+		count = (int)strtol(Cmd_Argv(1), (char **)NULL, 10);
+
+		if (count < 1)
+		{
+			count = 1;
+		}
+	}
+
+	points = Z_Malloc(count * 2 * sizeof(vec3_t));
+	results = Z_Malloc(count * sizeof(trace_t));
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			points[i * 2][j] = map_cmodels[0].mins[j] + frandk() *
+				(map_cmodels[0].maxs[j] - map_cmodels[0].mins[j]);
+			points[i * 2 + 1][j] = map_cmodels[0].mins[j] + frandk() *
+				(map_cmodels[0].maxs[j] - map_cmodels[0].mins[j]);
+		}
+
+		/* every fourth one is a position test */
+		if (!(i & 3))
+		{
+			VectorCopy(points[i * 2], points[i * 2 + 1]);
+		}
+	}
+
+#define TEST_ARGS(n) points[(n) * 2], points[(n) * 2 + 1], \
+		boxes[(n) % 3][0], boxes[(n) % 3][1], 0, \
+		((n) & 1) ? MASK_SHOT : MASK_PLAYERSOLID
+
+	start = Sys_Microseconds();
+
+	for (i = 0; i < count; i++)
+	{
+		results[i] = CM_BoxTraceUncached(TEST_ARGS(i), false);
+	}
+
+	scalartime = Sys_Microseconds() - start;
+
+	kernelbad = 0;
+	start = Sys_Microseconds();
+
+	for (i = 0; i < count; i++)
+	{
+		tr = CM_BoxTraceUncached(TEST_ARGS(i), true);
+
+		if (!CM_TracesEqual(&tr, &results[i]))
+		{
+			kernelbad++;
+		}
+	}
+
+	packedtime = Sys_Microseconds() - start;
+
+	/* every trace twice, the second one should come
+	   out of the cache if it wasn't evicted */
+	cachebad = 0;
+	lookups = trace_cachelookups;
+	hits = trace_cachehits;
+	CM_ClearTraceCache();
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < 2; j++)
+		{
+			mins = boxes[i % 3][0];
+			maxs = boxes[i % 3][1];
+			mask = (i & 1) ? MASK_SHOT : MASK_PLAYERSOLID;
+
+			tr = CM_BoxTrace(points[i * 2], points[i * 2 + 1], mins, maxs,
+					0, mask);
+
+			if (!CM_TracesEqual(&tr, &results[i]))
+			{
+				cachebad++;
+			}
+		}
+	}
+
+	CM_ClearTraceCache();
+
+#undef TEST_ARGS
+
+	Com_Printf("%i traces: %i kernel mismatches, %i cache mismatches\n",
+			count, kernelbad, cachebad);
+	Com_Printf("scalar: %.3f us/trace, %s: %.3f us/trace\n",
+			(double)scalartime / count, CM_KERNEL, (double)packedtime / count);
+	Com_Printf("cache: %i hits in %i lookups during test, %i in %i total\n",
+			trace_cachehits - hits, trace_cachelookups - lookups,
+			trace_cachehits, trace_cachelookups);
+
+	Z_Free(results);
+	Z_Free(points);
+}
+
+void
+CM_Init(void)
+{
+	cm_simd = Cvar_Get("cm_simd", "1", 0);
+	cm_tracecache = Cvar_Get("cm_tracecache", "1", 0);
+	cm_viscache = Cvar_Get("cm_viscache", "16384", 0);
+
+	Cmd_AddCommand("cm_tracetest", CM_TraceTest_f);
+	Cmd_AddCommand("cm_visinfo", CM_VisInfo_f);
+}
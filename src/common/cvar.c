@@ -28,6 +28,13 @@
 
 cvar_t *cvar_vars;
 
+/* open addressed index into cvar_vars, cvar_t is shared
+   with the game so it can't carry a hash chain. cvars
+   are never removed, so the table only ever grows */
+static cvar_t **cvar_hash;
+static int cvar_hashsize;
+static int cvar_count;
+
 static qboolean
 Cvar_InfoValidate(char *s)
 {
@@ -53,18 +60,67 @@ static cvar_t *
 Cvar_FindVar(const char *var_name)
 {
 	cvar_t *var;
+	unsigned i;
 
-	for (var = cvar_vars; var; var = var->next)
+	if (!cvar_hashsize)
+	{
+		return NULL;
+	}
+
+	i = Q_strcasehash(var_name) & (cvar_hashsize - 1);
+
+	while ((var = cvar_hash[i]))
 	{
 		if (!strcmp(var_name, var->name))
 		{
 			return var;
 		}
+
+		i = (i + 1) & (cvar_hashsize - 1);
 	}
 
 	return NULL;
 }
 
+static void
+Cvar_HashVar(cvar_t *var)
+{
+	cvar_t *v;
+	unsigned i;
+
+	/* keep the table at most half full */
+	if ((cvar_count + 1) * 2 > cvar_hashsize)
+	{
+		cvar_hashsize = cvar_hashsize ? cvar_hashsize * 2 : 512;
+		cvar_count = 0;
+
+		if (cvar_hash)
+		{
+			Z_Free(cvar_hash);
+		}
+
+		cvar_hash = Z_Malloc(cvar_hashsize * sizeof(*cvar_hash));
+
+		for (v = cvar_vars; v; v = v->next)
+		{
+			if (v != var)
+			{
+				Cvar_HashVar(v);
+			}
+		}
+	}
+
+	i = Q_strcasehash(var->name) & (cvar_hashsize - 1);
+
+	while (cvar_hash[i])
+	{
+		i = (i + 1) & (cvar_hashsize - 1);
+	}
+
+	cvar_hash[i] = var;
+	cvar_count++;
+}
+
 float
 Cvar_VariableValue(char *var_name)
 {
@@ -185,6 +241,8 @@ Cvar_Get(char *var_name, char *var_value, int flags)
 	var->next = *pos;
 	*pos = var;
 
+	Cvar_HashVar(var);
+
 	var->flags = flags;
 
 	return var;
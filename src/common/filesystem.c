@@ -25,6 +25,9 @@
  * =======================================================================
  */
 
+#include <ctype.h>
+#include <sys/stat.h>
+
 #include "header/common.h"
 #include "../common/header/glob.h"
 
@@ -32,9 +35,23 @@
  #include "unzip/unzip.h"
 #endif
 
+#ifndef _WIN32
+ #include <sys/mman.h>
+ #define FS_MMAP
+#endif
+
 #define MAX_HANDLES 512
 #define MAX_PAKS 100
 
+/* Number of buckets in the pack file index. Must be a power of two. */
+#define FS_HASH_SIZE 8192
+
+/* Maximum number of files queued for prefetching. */
+#define MAX_PREFETCH 1024
+
+/* Maximum number of timed load phases. */
+#define MAX_LOAD_PHASES 16
+
 #ifdef SYSTEMWIDE
  #ifndef SYSTEMDIR
   #define SYSTEMDIR "/usr/share/games/quake2"
@@ -49,6 +66,10 @@ typedef struct
 #ifdef ZIP
 	unzFile *zip;        /* (file or zip) */
 #endif
+	struct fsPack_s *pack; /* Set if file or zip is owned by a pack. */
+	int offset;           /* Start of the file inside a PAK. */
+	int length;           /* Length of the file inside a PAK. */
+	int position;         /* Read position, relative to offset. */
 } fsHandle_t;
 
 typedef struct fsLink_s
@@ -59,24 +80,77 @@ typedef struct fsLink_s
 	struct fsLink_s *next;
 } fsLink_t;
 
-typedef struct
+/* A read only mapping of a PAK file. It may outlive its
+   pack if buffers handed out by FS_LoadFile() are still
+   referenced when the pack is unloaded. */
+typedef struct fsMapping_s
+{
+	byte *base;
+	size_t size;
+	int refs;          /* Buffers handed out and not yet freed. */
+	qboolean orphaned; /* The pack was unloaded. */
+	struct fsMapping_s *next;
+} fsMapping_t;
+
+typedef struct fsPackFile_s
 {
 	char name[MAX_QPATH];
 	int size;
 	int offset;     /* Ignored in PK3 files. */
+#ifdef ZIP
+	unz_file_pos zipPos; /* Central directory entry, PK3 only. */
+#endif
+	unsigned hash;  /* Case insensitive hash of name. */
+	struct fsPackFile_s *hashNext; /* Next file in the index bucket. */
+	struct fsPack_s *pack; /* Pack containing this file. */
 } fsPackFile_t;
 
-typedef struct
+typedef struct fsPack_s
 {
 	char name[MAX_OSPATH];
 	int numFiles;
 	FILE *pak;
+	fsMapping_t *mapping; /* PAK only, if fs_mmap is set. */
+	long long openTime; /* Nanoseconds fopen() or unzOpen() took at load. */
 #ifdef ZIP
 	unzFile *pk3;
+	qboolean pk3InUse; /* pk3 is currently lent to a handle. */
+	long long locateTime; /* Nanoseconds of an unzLocateFile() at load. */
 #endif
 	fsPackFile_t *files;
 } fsPack_t;
 
+typedef enum
+{
+	PREFETCH_QUEUED,
+	PREFETCH_RUNNING,
+	PREFETCH_DONE
+} fsPrefetchState_t;
+
+/* A file to be read ahead by the prefetch worker. Everything
+   the worker needs is copied in, it never touches the packs. */
+typedef struct
+{
+	fsPackFile_t *file; /* Key, never dereferenced by the worker. */
+	char packName[MAX_OSPATH];
+	byte *mapped;       /* Start of the file in a mapped PAK. */
+	qboolean zip;
+#ifdef ZIP
+	unz_file_pos zipPos;
+#endif
+	int offset;
+	int size;
+	fsPrefetchState_t state;
+	byte *data;         /* Decompressed PK3 file, malloc()ed. */
+} fsPrefetch_t;
+
+typedef struct
+{
+	char name[32];
+	long long start;
+	long long end;
+} fsLoadPhase_t;
+
 typedef struct fsSearchPath_s
 {
 	char path[MAX_OSPATH]; /* Only one used. */
@@ -113,6 +187,54 @@ fsPackTypes_t fs_packtypes[] = {
 #endif
 };
 
+/* Index of all files in all packs on the search path. Each
+   bucket is ordered by search path priority, highest first. */
+static fsPackFile_t *fs_hashTable[FS_HASH_SIZE];
+
+/* Lookup statistics, printed by fs_stats. */
+static int fs_lookups;
+static int fs_lookupHits;
+static int fs_lookupProbes;
+static int fs_pakOpensAvoided;
+#ifdef ZIP
+static int fs_zipOpensAvoided;
+static int fs_zipLocatesAvoided;
+#endif
+static long long fs_openTime;
+static long long fs_savedTime; /* Avoided opens and scans times their cost, in ns. */
+static int fs_mappedLoads;
+static long long fs_mappedBytes;
+static int fs_mappedUnaligned; /* Copied since they're not 4 byte aligned. */
+
+/* All live mappings, FS_FreeFile() searches them. */
+static fsMapping_t *fs_mappings;
+
+/* Set by FS_FOpenFile, the pack file that was opened. */
+static fsPackFile_t *fs_fileInPackFile;
+
+/* Prefetch queue, shared with the worker thread. Everything
+   below is protected by fs_prefetchMutex. */
+static fsPrefetch_t fs_prefetch[MAX_PREFETCH];
+static int fs_numPrefetch;     /* Files in the queue. */
+static int fs_nextPrefetch;    /* Next file for the worker. */
+static int fs_prefetchMemory;  /* Bytes of decompressed data held. */
+static int fs_prefetchLimit;   /* Upper bound for fs_prefetchMemory. */
+static int fs_prefetchWarmed;  /* Bytes read ahead. */
+static qboolean fs_prefetchQuit;
+static void *fs_prefetchMutex;
+static void *fs_prefetchCond;
+static void *fs_prefetchThread;
+
+/* Only touched by the main thread. */
+static int fs_prefetchQueued;
+static int fs_prefetchHits;
+static int fs_prefetchMisses;
+
+/* Load time measurement, printed by fs_loadtimes. */
+static fsLoadPhase_t fs_loadPhases[MAX_LOAD_PHASES];
+static int fs_numLoadPhases;
+static qboolean fs_loadTiming;
+
 char fs_gamedir[MAX_OSPATH];
 static char fs_currentGame[MAX_QPATH];
 
@@ -131,6 +253,9 @@ cvar_t *fs_basedir;
 cvar_t *fs_cddir;
 cvar_t *fs_gamedirvar;
 cvar_t *fs_debug;
+cvar_t *fs_mmap;
+cvar_t *fs_prefetchvar;
+cvar_t *fs_prefetchmem;
 
 fsHandle_t *FS_GetFileByHandle(fileHandle_t f);
 char *Sys_GetCurrentDirectory(void);
@@ -315,7 +440,19 @@ FS_FCloseFile(fileHandle_t f)
 
 	handle = FS_GetFileByHandle(f);
 
-	if (handle->file)
+	if (handle->pack)
+	{
+		/* Owned by the pack, it stays open
+		   until the pack is unloaded. */
+#ifdef ZIP
+		if (handle->zip)
+		{
+			unzCloseCurrentFile(handle->zip);
+			handle->pack->pk3InUse = false;
+		}
+#endif
+	}
+	else if (handle->file)
 	{
 		fclose(handle->file);
 	}
@@ -351,6 +488,208 @@ Developer_searchpath(int who)
 	return 0;
 }
 
+/*
+ * Case insensitive hash of a file name, matching the
+ * semantics of Q_stricmp().
+ */
+static unsigned
+FS_HashFileName(const char *name)
+{
+	unsigned hash;
+
+	hash = 0;
+
+	while (*name)
+	{
+		hash = hash * 31 + tolower((unsigned char)*name);
+		name++;
+	}
+
+	return hash;
+}
+
+/*
+ * Adds all files of a pack to the index. The pack is
+ * expected to have the highest priority of all packs
+ * already indexed, e.g. it's at the head of the search
+ * path. Files are inserted backwards so that the first
+ * of several equally named files in a pack wins, like
+ * it did with the linear search.
+ */
+static void
+FS_IndexPack(fsPack_t *pack)
+{
+	int i;
+	fsPackFile_t *file;
+	unsigned bucket;
+
+	for (i = pack->numFiles - 1; i >= 0; i--)
+	{
+		file = &pack->files[i];
+		bucket = file->hash & (FS_HASH_SIZE - 1);
+
+		file->pack = pack;
+		file->hashNext = fs_hashTable[bucket];
+		fs_hashTable[bucket] = file;
+	}
+}
+
+/*
+ * Rebuilds the index from scratch. Needed after packs
+ * were removed from the search path.
+ */
+static void
+FS_RebuildIndex(void)
+{
+	fsSearchPath_t *search;
+	fsPack_t **packs;
+	int numPacks;
+	int i;
+
+	memset(fs_hashTable, 0, sizeof(fs_hashTable));
+
+	numPacks = 0;
+
+	for (search = fs_searchPaths; search; search = search->next)
+	{
+		if (search->pack)
+		{
+			numPacks++;
+		}
+	}
+
+	if (numPacks == 0)
+	{
+		return;
+	}
+
+	/* Packs must be indexed from lowest to highest
+	   priority, but the search path is ordered the
+	   other way round. */
+	packs = malloc(numPacks * sizeof(fsPack_t *));
+
+	for (i = 0, search = fs_searchPaths; search; search = search->next)
+	{
+		if (search->pack)
+		{
+			packs[i++] = search->pack;
+		}
+	}
+
+	for (i = numPacks - 1; i >= 0; i--)
+	{
+		FS_IndexPack(packs[i]);
+	}
+
+	free(packs);
+}
+
+/*
+ * Returns the highest priority pack file matching name
+ * or NULL if it's in no pack. Only lookups by loaders
+ * are counted in the statistics.
+ */
+static fsPackFile_t *
+FS_FindInIndex(const char *name, qboolean stats)
+{
+	fsPackFile_t *file;
+	unsigned hash;
+	int probes;
+
+	hash = FS_HashFileName(name);
+	probes = 0;
+
+	for (file = fs_hashTable[hash & (FS_HASH_SIZE - 1)]; file; file = file->hashNext)
+	{
+		probes++;
+
+		if ((file->hash == hash) && (Q_stricmp(file->name, name) == 0))
+		{
+			break;
+		}
+	}
+
+	if (stats)
+	{
+		fs_lookups++;
+		fs_lookupProbes += probes;
+
+		if (file)
+		{
+			fs_lookupHits++;
+		}
+	}
+
+	return file;
+}
+
+/*
+ * Returns the pack file FS_FOpenFile() would open for
+ * name without opening it, or NULL if it's in no pack
+ * or a plain file in a directory before the pack
+ * overrides it.
+ */
+static fsPackFile_t *
+FS_FindPackFile(const char *name)
+{
+	char path[MAX_OSPATH];
+	fsPackFile_t *file;
+	fsSearchPath_t *search;
+	struct stat st;
+
+	file = FS_FindInIndex(name, false);
+
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	for (search = fs_searchPaths; search; search = search->next)
+	{
+		if (search->pack == file->pack)
+		{
+			break;
+		}
+
+		if (search->pack)
+		{
+			continue;
+		}
+
+		Com_sprintf(path, sizeof(path), "%s/%s", search->path, name);
+
+		if (stat(path, &st) == 0)
+		{
+			return NULL;
+		}
+
+		Q_strlwr(path);
+
+		if (stat(path, &st) == 0)
+		{
+			return NULL;
+		}
+	}
+
+	return file;
+}
+
+/*
+ * Adds a pack to the head of the search path.
+ */
+static void
+FS_AddPackToSearchPath(fsPack_t *pack)
+{
+	fsSearchPath_t *search;
+
+	search = Z_Malloc(sizeof(fsSearchPath_t));
+	search->pack = pack;
+	search->next = fs_searchPaths;
+	fs_searchPaths = search;
+
+	FS_IndexPack(pack);
+}
+
 /*
  * Finds the file in the search path. Returns filesize and an open FILE *. Used
  * for streaming data out of either a pak file or a seperate file.
@@ -361,9 +700,13 @@ FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 	char path[MAX_OSPATH];
 	fsHandle_t *handle;
 	fsPack_t *pack;
+	fsPackFile_t *packFile;
 	fsSearchPath_t *search;
-	int i;
+	long long start;
 
+	start = Sys_Microseconds();
+
+	fs_fileInPackFile = NULL;
 	file_from_pak = 0;
 #ifdef ZIP
 	file_from_pk3 = 0;
@@ -373,6 +716,11 @@ FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 	Q_strlcpy(handle->name, name, sizeof(handle->name));
 	handle->mode = FS_READ;
 
+	/* The index knows the first pack holding the file. All
+	   packs before it can be skipped, directories must still
+	   be searched since they aren't indexed. */
+	packFile = FS_FindInIndex(handle->name, true);
+
 	/* Search through the path, one element at a time. */
 	for (search = fs_searchPaths; search; search = search->next)
 	{
@@ -389,57 +737,89 @@ FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 		{
 			pack = search->pack;
 
-			for (i = 0; i < pack->numFiles; i++)
+			if (packFile && (packFile->pack == pack))
 			{
-				if (Q_stricmp(pack->files[i].name, handle->name) == 0)
-				{
-					/* Found it! */
-					Com_FilePath(pack->name, fs_fileInPath, sizeof(fs_fileInPath));
-					fs_fileInPack = true;
+				/* Found it! */
+				Com_FilePath(pack->name, fs_fileInPath, sizeof(fs_fileInPath));
+				fs_fileInPack = true;
+				fs_fileInPackFile = packFile;
 
-					if (fs_debug->value)
-					{
-						Com_Printf("FS_FOpenFile: '%s' (found in '%s').\n",
-								   handle->name, pack->name);
-					}
+				if (fs_debug->value)
+				{
+					Com_Printf("FS_FOpenFile: '%s' (found in '%s').\n",
+							   handle->name, pack->name);
+				}
 
-					if (pack->pak)
+				if (pack->pak)
+				{
+					/* PAK. All handles share the pack's FILE,
+					   FS_PackRead() does positioned reads. */
+					file_from_pak = 1;
+					handle->file = pack->pak;
+					handle->pack = pack;
+					handle->offset = packFile->offset;
+					handle->length = packFile->size;
+					handle->position = 0;
+
+					fs_pakOpensAvoided++;
+					fs_savedTime += pack->openTime;
+					fs_openTime += Sys_Microseconds() - start;
+
+					return packFile->size;
+				}
+#ifdef ZIP
+				else if (pack->pk3)
+				{
+					/* PK3 */
+					file_from_pk3 = 1;
+					Q_strlcpy(file_from_pk3_name, strrchr(pack->name, '/') + 1, sizeof(file_from_pk3_name));
+
+					/* The zip handle holds the decompression state,
+					   so it can't be shared by two open files. Lend
+					   the pack's handle if it's free, open another
+					   one otherwise. */
+					if (!pack->pk3InUse)
 					{
-						/* PAK */
-						file_from_pak = 1;
-						handle->file = fopen(pack->name, "rb");
-
-						if (handle->file)
-						{
-							fseek(handle->file, pack->files[i].offset, SEEK_SET);
-							return pack->files[i].size;
-						}
+						handle->zip = pack->pk3;
+						handle->pack = pack;
+						pack->pk3InUse = true;
+						fs_zipOpensAvoided++;
+						fs_savedTime += pack->openTime;
 					}
-#ifdef ZIP
-					else if (pack->pk3)
+					else
 					{
-						/* PK3 */
-						file_from_pk3 = 1;
-						Q_strlcpy(file_from_pk3_name, strrchr(pack->name, '/') + 1, sizeof(file_from_pk3_name));
 						handle->zip = unzOpen(pack->name);
+					}
 
-						if (handle->zip)
+					if (handle->zip)
+					{
+						/* Jump to the cached directory entry
+						   instead of rescanning the directory. */
+						if (unzGoToFilePos(handle->zip, &packFile->zipPos) == UNZ_OK)
 						{
-							if (unzLocateFile(handle->zip, handle->name, 2) == UNZ_OK)
+							if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
 							{
-								if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
-								{
-									return pack->files[i].size;
-								}
+								fs_zipLocatesAvoided++;
+								fs_savedTime += pack->locateTime;
+								fs_openTime += Sys_Microseconds() - start;
+
+								return packFile->size;
 							}
+						}
 
+						if (handle->pack)
+						{
+							pack->pk3InUse = false;
+						}
+						else
+						{
 							unzClose(handle->zip);
 						}
 					}
+				}
 #endif
 
-					Com_Error(ERR_FATAL, "Couldn't reopen '%s'", pack->name);
-				}
+				Com_Error(ERR_FATAL, "Couldn't reopen '%s'", pack->name);
 			}
 		}
 		else
@@ -472,6 +852,8 @@ FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 							   handle->name, search->path);
 				}
 
+				fs_openTime += Sys_Microseconds() - start;
+
 				return FS_FileLength(handle->file);
 			}
 		}
@@ -489,9 +871,43 @@ FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 	/* Couldn't open, so free the handle. */
 	memset(handle, 0, sizeof(*handle));
 	*f = 0;
+
+	fs_openTime += Sys_Microseconds() - start;
+
 	return -1;
 }
 
+/*
+ * Reads from a file inside a PAK. The FILE is shared by all
+ * handles into the pack, so every read is positioned at the
+ * handle's own offset and clamped to the file's length.
+ */
+static int
+FS_PackRead(fsHandle_t *handle, void *buffer, int size)
+{
+	int r;
+
+	if (size > handle->length - handle->position)
+	{
+		size = handle->length - handle->position;
+	}
+
+	if (size <= 0)
+	{
+		return 0;
+	}
+
+	if (fseek(handle->file, handle->offset + handle->position, SEEK_SET) != 0)
+	{
+		return -1;
+	}
+
+	r = fread(buffer, 1, size, handle->file);
+	handle->position += r;
+
+	return r;
+}
+
 /*
  * Properly handles partial reads.
  */
@@ -512,7 +928,11 @@ FS_Read(void *buffer, int size, fileHandle_t f)
 
 	while (remaining)
 	{
-		if (handle->file)
+		if (handle->pack && handle->file)
+		{
+			r = FS_PackRead(handle, buf, remaining);
+		}
+		else if (handle->file)
 		{
 			r = fread(buf, 1, remaining, handle->file);
 		}
@@ -544,100 +964,674 @@ FS_Read(void *buffer, int size, fileHandle_t f)
 		}
 		else if (r == -1)
 		{
-			Com_Error(ERR_FATAL,
-					"FS_Read: -1 bytes read from '%s'",
-					handle->name);
+			Com_Error(ERR_FATAL,
+					"FS_Read: -1 bytes read from '%s'",
+					handle->name);
+		}
+
+		remaining -= r;
+		buf += r;
+	}
+
+	return size;
+}
+
+/*
+ * Properly handles partial reads of size up to count times. No error if it
+ * can't read.
+ */
+int
+FS_FRead(void *buffer, int size, int count, fileHandle_t f)
+{
+	qboolean tried = false;    /* Tried to read from a CD. */
+	byte *buf;        /* Buffer. */
+	int loops;         /* Loop indicator. */
+	int r;         /* Number of bytes read. */
+	int remaining;         /* Remaining bytes. */
+	fsHandle_t *handle;  /* File handle. */
+
+	handle = FS_GetFileByHandle(f);
+
+	/* Read. */
+	loops = count;
+	buf = (byte *)buffer;
+
+	while (loops)
+	{
+		/* Read in chunks. */
+		remaining = size;
+
+		while (remaining)
+		{
+			if (handle->pack && handle->file)
+			{
+				r = FS_PackRead(handle, buf, remaining);
+			}
+			else if (handle->file)
+			{
+				r = fread(buf, 1, remaining, handle->file);
+			}
+#ifdef ZIP
+			else if (handle->zip)
+			{
+				r = unzReadCurrentFile(handle->zip, buf, remaining);
+			}
+#endif
+			else
+			{
+				return 0;
+			}
+
+			if (r == 0)
+			{
+				if (!tried)
+				{
+					/* Might tried to read from a CD. */
+					tried = true;
+				}
+				else
+				{
+					/* Already tried once. */
+					return size - remaining;
+				}
+			}
+			else if (r == -1)
+			{
+				Com_Error(ERR_FATAL,
+						"FS_FRead: -1 bytes read from '%s'",
+						handle->name);
+			}
+
+			remaining -= r;
+			buf += r;
+		}
+
+		loops--;
+	}
+
+	return size;
+}
+
+/*
+ * The prefetch worker. Reads files queued by FS_Prefetch()
+ * ahead of the synchronous loaders: PAK files are pulled
+ * into the page cache (or the pages of their mapping are
+ * touched), PK3 files are decompressed into memory, where
+ * FS_LoadFile() picks them up.
+ */
+static void
+FS_PrefetchWorker(void *arg)
+{
+	fsPrefetch_t *entry;
+	fsPrefetch_t job;
+	FILE *pak;
+	char pakName[MAX_OSPATH];
+#ifdef ZIP
+	unzFile zip;
+	char zipName[MAX_OSPATH];
+#endif
+	byte *scratch;
+	byte *data;
+	volatile byte sum;
+	qboolean decompress;
+	int remaining;
+	int r;
+	int i;
+
+	pak = NULL;
+	pakName[0] = '\0';
+#ifdef ZIP
+	zip = NULL;
+	zipName[0] = '\0';
+#endif
+	scratch = malloc(0x10000);
+	sum = 0;
+
+	Sys_LockMutex(fs_prefetchMutex);
+
+	while (!fs_prefetchQuit)
+	{
+		if (fs_nextPrefetch >= fs_numPrefetch)
+		{
+			/* Idle, don't keep the packs open. */
+			if (pak)
+			{
+				fclose(pak);
+				pak = NULL;
+				pakName[0] = '\0';
+			}
+#ifdef ZIP
+			if (zip)
+			{
+				unzClose(zip);
+				zip = NULL;
+				zipName[0] = '\0';
+			}
+#endif
+
+			Sys_WaitCond(fs_prefetchCond, fs_prefetchMutex);
+			continue;
+		}
+
+		entry = &fs_prefetch[fs_nextPrefetch++];
+
+		/* Loaded or canceled by the main thread. */
+		if (entry->state != PREFETCH_QUEUED)
+		{
+			continue;
+		}
+
+		entry->state = PREFETCH_RUNNING;
+		job = *entry;
+
+		decompress = job.zip && (fs_prefetchMemory + job.size <= fs_prefetchLimit);
+
+		if (decompress)
+		{
+			fs_prefetchMemory += job.size;
+		}
+
+		Sys_UnlockMutex(fs_prefetchMutex);
+
+		data = NULL;
+
+		if (job.mapped)
+		{
+			/* Fault the pages in. */
+			for (i = 0; i < job.size; i += 4096)
+			{
+				sum += job.mapped[i];
+			}
+		}
+		else if (!job.zip)
+		{
+			if (strcmp(pakName, job.packName) != 0)
+			{
+				if (pak)
+				{
+					fclose(pak);
+				}
+
+				pak = fopen(job.packName, "rb");
+				Q_strlcpy(pakName, job.packName, sizeof(pakName));
+			}
+
+			if (pak && (fseek(pak, job.offset, SEEK_SET) == 0))
+			{
+				remaining = job.size;
+
+				while (remaining > 0)
+				{
+					r = fread(scratch, 1, remaining < 0x10000 ? remaining : 0x10000, pak);
+
+					if (r <= 0)
+					{
+						break;
+					}
+
+					remaining -= r;
+				}
+			}
+		}
+#ifdef ZIP
+		else if (decompress)
+		{
+			if (strcmp(zipName, job.packName) != 0)
+			{
+				if (zip)
+				{
+					unzClose(zip);
+				}
+
+				zip = unzOpen(job.packName);
+				Q_strlcpy(zipName, job.packName, sizeof(zipName));
+			}
+
+			if (zip && (unzGoToFilePos(zip, &job.zipPos) == UNZ_OK) &&
+				(unzOpenCurrentFile(zip) == UNZ_OK))
+			{
+				data = malloc(job.size);
+
+				if (data && (unzReadCurrentFile(zip, data, job.size) != job.size))
+				{
+					free(data);
+					data = NULL;
+				}
+
+				unzCloseCurrentFile(zip);
+			}
+		}
+#endif
+
+		Sys_LockMutex(fs_prefetchMutex);
+
+		if (decompress && !data)
+		{
+			fs_prefetchMemory -= job.size;
+		}
+
+		fs_prefetchWarmed += job.size;
+		entry->data = data;
+		entry->state = PREFETCH_DONE;
+
+		Sys_BroadcastCond(fs_prefetchCond);
+	}
+
+	Sys_UnlockMutex(fs_prefetchMutex);
+
+	if (pak)
+	{
+		fclose(pak);
+	}
+#ifdef ZIP
+	if (zip)
+	{
+		unzClose(zip);
+	}
+#endif
+
+	free(scratch);
+}
+
+/*
+ * Queues a file for the prefetch worker. Only files in
+ * packs are considered, directories are fast enough.
+ */
+void
+FS_Prefetch(const char *name)
+{
+	fsPackFile_t *file;
+	fsPrefetch_t *entry;
+	int i;
+
+	if (!fs_prefetchvar || !fs_prefetchvar->value)
+	{
+		return;
+	}
+
+	/* Find out where the file comes from without opening
+	   it. It may be overridden by a plain file. */
+	file = FS_FindPackFile(name);
+
+	if ((file == NULL) || (file->size <= 0))
+	{
+		return;
+	}
+
+	if (fs_prefetchThread == NULL)
+	{
+		fs_prefetchMutex = Sys_CreateMutex();
+		fs_prefetchCond = Sys_CreateCond();
+		fs_prefetchThread = Sys_CreateThread(FS_PrefetchWorker, NULL);
+
+		if (fs_prefetchThread == NULL)
+		{
+			Sys_DestroyCond(fs_prefetchCond);
+			Sys_DestroyMutex(fs_prefetchMutex);
+
+			Com_Printf("FS_Prefetch: couldn't create worker thread.\n");
+			Cvar_Set("fs_prefetch", "0");
+			return;
+		}
+	}
+
+	Sys_LockMutex(fs_prefetchMutex);
+
+	fs_prefetchLimit = (int)fs_prefetchmem->value * 1024 * 1024;
+
+	for (i = 0; i < fs_numPrefetch; i++)
+	{
+		if (fs_prefetch[i].file == file)
+		{
+			Sys_UnlockMutex(fs_prefetchMutex);
+			return;
+		}
+	}
+
+	if (fs_numPrefetch == MAX_PREFETCH)
+	{
+		Sys_UnlockMutex(fs_prefetchMutex);
+		return;
+	}
+
+	entry = &fs_prefetch[fs_numPrefetch];
+	memset(entry, 0, sizeof(*entry));
+
+	entry->file = file;
+	entry->offset = file->offset;
+	entry->size = file->size;
+	entry->state = PREFETCH_QUEUED;
+	Q_strlcpy(entry->packName, file->pack->name, sizeof(entry->packName));
+
+	if (file->pack->mapping &&
+		((size_t)file->offset + file->size <= file->pack->mapping->size))
+	{
+		entry->mapped = file->pack->mapping->base + file->offset;
+	}
+
+#ifdef ZIP
+	if (file->pack->pk3)
+	{
+		entry->zip = true;
+		entry->zipPos = file->zipPos;
+	}
+#endif
+
+	fs_numPrefetch++;
+	fs_prefetchQueued++;
+
+	Sys_BroadcastCond(fs_prefetchCond);
+	Sys_UnlockMutex(fs_prefetchMutex);
+}
+
+/*
+ * Queues all models, sounds and images named in a
+ * configstring list. Expands the names the same way
+ * the client's loaders do.
+ */
+void
+FS_PrefetchConfigstrings(char configstrings[MAX_CONFIGSTRINGS][MAX_QPATH])
+{
+	char *name;
+	int i;
+
+	if (!fs_prefetchvar || !fs_prefetchvar->value)
+	{
+		return;
+	}
+
+	for (i = 1; i < MAX_MODELS && configstrings[CS_MODELS + i][0]; i++)
+	{
+		name = configstrings[CS_MODELS + i];
+
+		/* Inline and player weapon models. */
+		if ((name[0] != '*') && (name[0] != '#'))
+		{
+			FS_Prefetch(name);
+		}
+	}
+
+	for (i = 1; i < MAX_SOUNDS && configstrings[CS_SOUNDS + i][0]; i++)
+	{
+		name = configstrings[CS_SOUNDS + i];
+
+		/* Sexed sounds depend on the player model. */
+		if (name[0] == '#')
+		{
+			FS_Prefetch(name + 1);
+		}
+		else if (name[0] != '*')
+		{
+			FS_Prefetch(va("sound/%s", name));
+		}
+	}
+
+	for (i = 1; i < MAX_IMAGES && configstrings[CS_IMAGES + i][0]; i++)
+	{
+		name = configstrings[CS_IMAGES + i];
+
+		if ((name[0] == '/') || (name[0] == '\\'))
+		{
+			FS_Prefetch(name + 1);
+		}
+		else
+		{
+			FS_Prefetch(va("pics/%s.pcx", name));
+		}
+	}
+}
+
+/*
+ * Returns the worker's data for file, if any. Takes the
+ * file out of the queue. Must be free()d by the caller.
+ */
+static byte *
+FS_TakePrefetched(fsPackFile_t *file)
+{
+	fsPrefetch_t *entry;
+	byte *data;
+	qboolean hit;
+	int i;
+
+	data = NULL;
+	hit = false;
+
+	Sys_LockMutex(fs_prefetchMutex);
+
+	for (i = 0; i < fs_numPrefetch; i++)
+	{
+		entry = &fs_prefetch[i];
+
+		if (entry->file != file)
+		{
+			continue;
+		}
+
+		/* Not yet started. The caller loads it anyways,
+		   there's no need for the worker to do it again. */
+		if (entry->state == PREFETCH_QUEUED)
+		{
+			entry->state = PREFETCH_DONE;
+			entry->file = NULL;
+			break;
+		}
+
+		while (entry->state == PREFETCH_RUNNING)
+		{
+			Sys_WaitCond(fs_prefetchCond, fs_prefetchMutex);
+		}
+
+		data = entry->data;
+
+		if (data)
+		{
+			fs_prefetchMemory -= entry->size;
+		}
+
+		entry->data = NULL;
+		entry->file = NULL;
+		hit = true;
+		break;
+	}
+
+	Sys_UnlockMutex(fs_prefetchMutex);
+
+	/* A hit is a file the worker was done with
+	   (or working on) when it was needed. */
+	if (hit)
+	{
+		fs_prefetchHits++;
+	}
+	else
+	{
+		fs_prefetchMisses++;
+	}
+
+	return data;
+}
+
+/*
+ * Cancels all queued files, waits for the worker to go
+ * idle and frees everything it hasn't handed out. Must
+ * be called before packs are unloaded.
+ */
+void
+FS_PrefetchFlush(void)
+{
+	int i;
+
+	if (fs_prefetchThread == NULL)
+	{
+		return;
+	}
+
+	Sys_LockMutex(fs_prefetchMutex);
+
+	for (i = fs_nextPrefetch; i < fs_numPrefetch; i++)
+	{
+		fs_prefetch[i].state = PREFETCH_DONE;
+	}
+
+	fs_nextPrefetch = fs_numPrefetch;
+
+	for (i = 0; i < fs_numPrefetch; i++)
+	{
+		while (fs_prefetch[i].state == PREFETCH_RUNNING)
+		{
+			Sys_WaitCond(fs_prefetchCond, fs_prefetchMutex);
+		}
+
+		if (fs_prefetch[i].data)
+		{
+			free(fs_prefetch[i].data);
 		}
+	}
 
-		remaining -= r;
-		buf += r;
+	fs_numPrefetch = 0;
+	fs_nextPrefetch = 0;
+	fs_prefetchMemory = 0;
+
+	Sys_UnlockMutex(fs_prefetchMutex);
+}
+
+/*
+ * Flushes the queue and stops the worker thread.
+ */
+void
+FS_PrefetchShutdown(void)
+{
+	if (fs_prefetchThread == NULL)
+	{
+		return;
 	}
 
-	return size;
+	FS_PrefetchFlush();
+
+	Sys_LockMutex(fs_prefetchMutex);
+	fs_prefetchQuit = true;
+	Sys_BroadcastCond(fs_prefetchCond);
+	Sys_UnlockMutex(fs_prefetchMutex);
+
+	Sys_WaitThread(fs_prefetchThread);
+
+	Sys_DestroyCond(fs_prefetchCond);
+	Sys_DestroyMutex(fs_prefetchMutex);
+
+	fs_prefetchThread = NULL;
+	fs_prefetchQuit = false;
 }
 
 /*
- * Properly handles partial reads of size up to count times. No error if it
- * can't read.
+ * Starts timing a load, e.g. a map change. Each call
+ * of FS_LoadPhase() ends the current and starts a new
+ * phase. Nested starts are ignored, so the client can
+ * continue what a listen server started. Every way out
+ * of a load must call FS_StopLoadTiming(), errors too.
  */
-int
-FS_FRead(void *buffer, int size, int count, fileHandle_t f)
+void
+FS_StartLoadTiming(void)
 {
-	qboolean tried = false;    /* Tried to read from a CD. */
-	byte *buf;        /* Buffer. */
-	int loops;         /* Loop indicator. */
-	int r;         /* Number of bytes read. */
-	int remaining;         /* Remaining bytes. */
-	fsHandle_t *handle;  /* File handle. */
+	if (fs_loadTiming)
+	{
+		return;
+	}
 
-	handle = FS_GetFileByHandle(f);
+	fs_loadTiming = true;
+	fs_numLoadPhases = 0;
+	fs_prefetchQueued = 0;
+	fs_prefetchHits = 0;
+	fs_prefetchMisses = 0;
+	fs_prefetchWarmed = 0;
+}
 
-	/* Read. */
-	loops = count;
-	buf = (byte *)buffer;
+void
+FS_LoadPhase(const char *name)
+{
+	long long now;
 
-	while (loops)
+	if (!fs_loadTiming)
 	{
-		/* Read in chunks. */
-		remaining = size;
+		return;
+	}
 
-		while (remaining)
-		{
-			if (handle->file)
-			{
-				r = fread(buf, 1, remaining, handle->file);
-			}
-#ifdef ZIP
-			else if (handle->zip)
-			{
-				r = unzReadCurrentFile(handle->zip, buf, remaining);
-			}
-#endif
-			else
-			{
-				return 0;
-			}
+	now = Sys_Microseconds();
 
-			if (r == 0)
-			{
-				if (!tried)
-				{
-					/* Might tried to read from a CD. */
-					tried = true;
-				}
-				else
-				{
-					/* Already tried once. */
-					return size - remaining;
-				}
-			}
-			else if (r == -1)
-			{
-				Com_Error(ERR_FATAL,
-						"FS_FRead: -1 bytes read from '%s'",
-						handle->name);
-			}
+	if (fs_numLoadPhases > 0)
+	{
+		fs_loadPhases[fs_numLoadPhases - 1].end = now;
+	}
 
-			remaining -= r;
-			buf += r;
-		}
+	if (fs_numLoadPhases == MAX_LOAD_PHASES)
+	{
+		return;
+	}
 
-		loops--;
+	Q_strlcpy(fs_loadPhases[fs_numLoadPhases].name, name,
+			sizeof(fs_loadPhases[fs_numLoadPhases].name));
+	fs_loadPhases[fs_numLoadPhases].start = now;
+	fs_loadPhases[fs_numLoadPhases].end = now;
+	fs_numLoadPhases++;
+}
+
+void
+FS_StopLoadTiming(void)
+{
+	if (!fs_loadTiming)
+	{
+		return;
 	}
 
-	return size;
+	if (fs_numLoadPhases > 0)
+	{
+		fs_loadPhases[fs_numLoadPhases - 1].end = Sys_Microseconds();
+	}
+
+	fs_loadTiming = false;
+}
+
+void
+FS_LoadTimes_f(void)
+{
+	long long total;
+	int i;
+
+	if (fs_numLoadPhases == 0)
+	{
+		Com_Printf("No load timed yet.\n");
+		return;
+	}
+
+	total = 0;
+
+	for (i = 0; i < fs_numLoadPhases; i++)
+	{
+		Com_Printf("%-12s %8.2f ms\n", fs_loadPhases[i].name,
+				(fs_loadPhases[i].end - fs_loadPhases[i].start) / 1000.0f);
+		total += fs_loadPhases[i].end - fs_loadPhases[i].start;
+	}
+
+	Com_Printf("%-12s %8.2f ms%s\n", "total", total / 1000.0f,
+			fs_loadTiming ? " (still loading)" : "");
+	Com_Printf("Prefetch: %i files queued, %i KB read ahead, %i hits, %i misses.\n",
+			fs_prefetchQueued, fs_prefetchWarmed / 1024, fs_prefetchHits,
+			fs_prefetchMisses);
 }
 
 /*
  * Filename are reletive to the quake search path. A null buffer will just
- * return the file length without loading.
+ * return the file length without loading. If writable is false and the
+ * file is inside a memory mapped PAK, the returned buffer points into the
+ * mapping and must not be modified.
  */
-int
-FS_LoadFile(char *path, void **buffer)
+static int
+FS_LoadFileInternal(char *path, void **buffer, qboolean writable)
 {
 	byte *buf; /* Buffer. */
 	int size; /* File size. */
 	fileHandle_t f; /* File handle. */
+	fsHandle_t *handle; /* Handle of f. */
+	fsMapping_t *mapping; /* Mapping of the PAK. */
+	byte *prefetched; /* Data read ahead by the worker. */
 
 	buf = NULL;
 	size = FS_FOpenFile(path, &f, false);
@@ -658,24 +1652,185 @@ FS_LoadFile(char *path, void **buffer)
 		return size;
 	}
 
+	/* Zero copy: Hand out a pointer into the mapping. Loaders
+	   cast the buffer to structs of ints and floats, so files
+	   at unaligned offsets in the PAK are copied instead. */
+	handle = FS_GetFileByHandle(f);
+	mapping = handle->pack ? handle->pack->mapping : NULL;
+
+	if (!writable && mapping && (handle->file != NULL) &&
+		(handle->offset & 3))
+	{
+		fs_mappedUnaligned++;
+	}
+	else if (!writable && mapping && (handle->file != NULL) &&
+		((size_t)handle->offset + size <= mapping->size))
+	{
+		*buffer = mapping->base + handle->offset;
+		mapping->refs++;
+
+		fs_mappedLoads++;
+		fs_mappedBytes += size;
+
+		FS_FCloseFile(f);
+
+		return size;
+	}
+
 	buf = Z_Malloc(size);
 	*buffer = buf;
 
-	FS_Read(buf, size, f);
+	/* Maybe the worker has already decompressed it. */
+	prefetched = NULL;
+
+	if (fs_fileInPackFile && fs_numPrefetch)
+	{
+		prefetched = FS_TakePrefetched(fs_fileInPackFile);
+	}
+
+	if (prefetched)
+	{
+		memcpy(buf, prefetched, size);
+		free(prefetched);
+	}
+	else
+	{
+		FS_Read(buf, size, f);
+	}
+
 	FS_FCloseFile(f);
 
 	return size;
 }
 
+/*
+ * The returned buffer may be read only, see FS_LoadFileInternal().
+ */
+int
+FS_LoadFile(char *path, void **buffer)
+{
+	return FS_LoadFileInternal(path, buffer, false);
+}
+
+/*
+ * Like FS_LoadFile(), but the buffer is always a private
+ * copy. For loaders modifying the file in place.
+ */
+int
+FS_LoadFileWritable(char *path, void **buffer)
+{
+	return FS_LoadFileInternal(path, buffer, true);
+}
+
+#ifdef FS_MMAP
+/*
+ * Maps a PAK file read only into memory. Returns NULL if
+ * that's not possible, the pack falls back to reads.
+ */
+static fsMapping_t *
+FS_MapPAK(FILE *handle)
+{
+	fsMapping_t *mapping;
+	void *base;
+	int size;
+
+	size = FS_FileLength(handle);
+
+	if (size <= 0)
+	{
+		return NULL;
+	}
+
+	base = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(handle), 0);
+
+	if (base == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	mapping = Z_Malloc(sizeof(fsMapping_t));
+	mapping->base = base;
+	mapping->size = size;
+	mapping->next = fs_mappings;
+	fs_mappings = mapping;
+
+	return mapping;
+}
+
+static void
+FS_DestroyMapping(fsMapping_t *mapping)
+{
+	fsMapping_t **prev;
+
+	for (prev = &fs_mappings; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == mapping)
+		{
+			*prev = mapping->next;
+			break;
+		}
+	}
+
+	munmap(mapping->base, mapping->size);
+	Z_Free(mapping);
+}
+#endif
+
+/*
+ * Called when a pack is unloaded. The mapping stays
+ * alive until the last buffer into it is freed.
+ */
+static void
+FS_ReleaseMapping(fsMapping_t *mapping)
+{
+#ifdef FS_MMAP
+	if (mapping == NULL)
+	{
+		return;
+	}
+
+	if (mapping->refs > 0)
+	{
+		mapping->orphaned = true;
+		return;
+	}
+
+	FS_DestroyMapping(mapping);
+#endif
+}
+
 void
 FS_FreeFile(void *buffer)
 {
+#ifdef FS_MMAP
+	fsMapping_t *mapping;
+#endif
+
 	if (buffer == NULL)
 	{
 		FS_DPrintf("FS_FreeFile: NULL buffer.\n");
 		return;
 	}
 
+#ifdef FS_MMAP
+	/* Buffers pointing into a mapping aren't ours. */
+	for (mapping = fs_mappings; mapping; mapping = mapping->next)
+	{
+		if (((byte *)buffer >= mapping->base) &&
+			((byte *)buffer < mapping->base + mapping->size))
+		{
+			mapping->refs--;
+
+			if (mapping->orphaned && (mapping->refs == 0))
+			{
+				FS_DestroyMapping(mapping);
+			}
+
+			return;
+		}
+	}
+#endif
+
 	Z_Free(buffer);
 }
 
@@ -695,7 +1850,9 @@ FS_LoadPAK(const char *packPath)
 	fsPack_t *pack; /* PAK file. */
 	dpackheader_t header; /* PAK file header. */
 	dpackfile_t info[MAX_FILES_IN_PACK]; /* PAK info. */
+	long long start; /* For the cost of a reopen. */
 
+	start = Sys_Nanoseconds();
 	handle = fopen(packPath, "rb");
 
 	if (handle == NULL)
@@ -703,6 +1860,8 @@ FS_LoadPAK(const char *packPath)
 		return NULL;
 	}
 
+	start = Sys_Nanoseconds() - start;
+
 	fread(&header, 1, sizeof(dpackheader_t), handle);
 
 	if (LittleLong(header.ident) != IDPAKHEADER)
@@ -734,13 +1893,30 @@ FS_LoadPAK(const char *packPath)
 		Q_strlcpy(files[i].name, info[i].name, sizeof(files[i].name));
 		files[i].offset = LittleLong(info[i].filepos);
 		files[i].size = LittleLong(info[i].filelen);
+		files[i].hash = FS_HashFileName(files[i].name);
 	}
 
 	pack = Z_Malloc(sizeof(fsPack_t));
 	Q_strlcpy(pack->name, packPath, sizeof(pack->name));
 	pack->pak = handle;
+	pack->mapping = NULL;
+	pack->openTime = start;
+
+#ifdef FS_MMAP
+	if (fs_mmap && fs_mmap->value)
+	{
+		pack->mapping = FS_MapPAK(handle);
+
+		if (pack->mapping == NULL)
+		{
+			Com_Printf("FS_LoadPAK: couldn't map '%s', falling back to reads.\n",
+					packPath);
+		}
+	}
+#endif
 #ifdef ZIP
 	pack->pk3 = NULL;
+	pack->pk3InUse = false;
 #endif
 	pack->numFiles = numFiles;
 	pack->files = files;
@@ -769,7 +1945,10 @@ FS_LoadPK3(const char *packPath)
 	unzFile *handle; /* Zip file handle. */
 	unz_file_info info; /* Zip file info. */
 	unz_global_info global; /* Zip file global info. */
+	long long openTime; /* For the cost of a reopen. */
+	long long locateTime; /* For the cost of a directory scan. */
 
+	openTime = Sys_Nanoseconds();
 	handle = unzOpen(packPath);
 
 	if (handle == NULL)
@@ -777,6 +1956,8 @@ FS_LoadPK3(const char *packPath)
 		return NULL;
 	}
 
+	openTime = Sys_Nanoseconds() - openTime;
+
 	if (unzGetGlobalInfo(handle, &global) != UNZ_OK)
 	{
 		unzClose(handle);
@@ -805,14 +1986,26 @@ FS_LoadPK3(const char *packPath)
 		Q_strlcpy(files[i].name, fileName, sizeof(files[i].name));
 		files[i].offset = -1; /* Not used in ZIP files */
 		files[i].size = info.uncompressed_size;
+		unzGetFilePos(handle, &files[i].zipPos);
+		files[i].hash = FS_HashFileName(files[i].name);
 		i++;
 		status = unzGoToNextFile(handle);
 	}
 
+	/* A lookup by name scans the directory, on average
+	   up to the file in the middle. */
+	locateTime = Sys_Nanoseconds();
+	unzLocateFile(handle, files[i / 2].name, 2);
+	locateTime = Sys_Nanoseconds() - locateTime;
+
 	pack = Z_Malloc(sizeof(fsPack_t));
 	Q_strlcpy(pack->name, packPath, sizeof(pack->name));
 	pack->pak = NULL;
+	pack->mapping = NULL;
 	pack->pk3 = handle;
+	pack->pk3InUse = false;
+	pack->openTime = openTime;
+	pack->locateTime = locateTime;
 	pack->numFiles = numFiles;
 	pack->files = files;
 
@@ -877,10 +2070,7 @@ FS_AddGameDirectory(const char *dir)
 				continue;
 			}
 
-			search = Z_Malloc(sizeof(fsSearchPath_t));
-			search->pack = pack;
-			search->next = fs_searchPaths;
-			fs_searchPaths = search;
+			FS_AddPackToSearchPath(pack);
 		}
 	}
 
@@ -922,10 +2112,7 @@ FS_AddGameDirectory(const char *dir)
 				continue;
 			}
 
-			search = Z_Malloc(sizeof(fsSearchPath_t));
-			search->pack = pack;
-			search->next = fs_searchPaths;
-			fs_searchPaths = search;
+			FS_AddPackToSearchPath(pack);
 		}
 
 		FS_FreeList(list, nfiles);
@@ -977,7 +2164,7 @@ void FS_AddBinaryDirAsGameDirectory(const char* dir)
 	}
 	int len = snprintf(gdir, sizeof(gdir), "%s%s/", datadir, dir);
 
-	printf("Using binary dir %s to fetch paks\n", gdir);
+	Com_Printf("Using binary dir %s to fetch paks\n", gdir);
 
 	if ((len > 0) && (len < sizeof(gdir)) && (gdir[len - 1] == '/'))
 	{
@@ -1073,6 +2260,64 @@ FS_Path_f(void)
 #endif
 }
 
+void
+FS_Stats_f(void)
+{
+	int i;
+	int files;
+	int used;
+	int longest;
+	int length;
+	fsPackFile_t *file;
+
+	files = used = longest = 0;
+
+	for (i = 0; i < FS_HASH_SIZE; i++)
+	{
+		length = 0;
+
+		for (file = fs_hashTable[i]; file; file = file->hashNext)
+		{
+			length++;
+		}
+
+		if (length)
+		{
+			used++;
+		}
+
+		if (length > longest)
+		{
+			longest = length;
+		}
+
+		files += length;
+	}
+
+	Com_Printf("Index: %i files in %i of %i buckets, longest chain %i.\n",
+			files, used, FS_HASH_SIZE, longest);
+	Com_Printf("Lookups: %i (%i found in packs), %i probes.\n",
+			fs_lookups, fs_lookupHits, fs_lookupProbes);
+
+	if (fs_lookups)
+	{
+		Com_Printf("Average probe length: %.2f\n",
+				(float)fs_lookupProbes / fs_lookups);
+	}
+
+	Com_Printf("Reopens avoided: %i PAK", fs_pakOpensAvoided);
+#ifdef ZIP
+	Com_Printf(", %i PK3, %i directory scans", fs_zipOpensAvoided,
+			fs_zipLocatesAvoided);
+#endif
+	Com_Printf(".\n");
+
+	Com_Printf("Time spent opening files: %.2f ms, saved: %.2f ms\n",
+			fs_openTime / 1000.0f, fs_savedTime / 1000000.0f);
+	Com_Printf("Zero copy loads: %i (%lld bytes), %i unaligned ones copied.\n",
+			fs_mappedLoads, fs_mappedBytes, fs_mappedUnaligned);
+}
+
 /*
  * Sets the gamedir and path to a different directory.
  */
@@ -1095,16 +2340,31 @@ FS_SetGamedir(char *dir)
 		return;
 	}
 
+	/* The worker may be reading from the old packs. */
+	FS_PrefetchFlush();
+
 	/* Free up any current game dir info. */
 	while (fs_searchPaths != fs_baseSearchPaths)
 	{
 		if (fs_searchPaths->pack)
 		{
+			/* Handles into the pack share its FILE or zip
+			   handle, they must be closed beforehand. */
+			for (i = 0; i < MAX_HANDLES; i++)
+			{
+				if (fs_handles[i].pack == fs_searchPaths->pack)
+				{
+					FS_FCloseFile(i + 1);
+				}
+			}
+
 			if (fs_searchPaths->pack->pak)
 			{
 				fclose(fs_searchPaths->pack->pak);
 			}
 
+			FS_ReleaseMapping(fs_searchPaths->pack->mapping);
+
 #ifdef ZIP
 			if (fs_searchPaths->pack->pk3)
 			{
@@ -1121,6 +2381,9 @@ FS_SetGamedir(char *dir)
 		fs_searchPaths = next;
 	}
 
+	/* The removed packs must vanish from the index. */
+	FS_RebuildIndex();
+
 	/* Close open files for game dir. */
 	for (i = 0; i < MAX_HANDLES; i++)
 	{
@@ -1543,6 +2806,8 @@ FS_InitFilesystem(void)
 	Cmd_AddCommand("path", FS_Path_f);
 	Cmd_AddCommand("link", FS_Link_f);
 	Cmd_AddCommand("dir", FS_Dir_f);
+	Cmd_AddCommand("fs_stats", FS_Stats_f);
+	Cmd_AddCommand("fs_loadtimes", FS_LoadTimes_f);
 
 	/* basedir <path> Allows the game to run from outside the data tree.  */
 	fs_basedir = Cvar_Get("basedir",
@@ -1557,6 +2822,10 @@ FS_InitFilesystem(void)
 	   allow the game to run from outside the data tree. */
 	fs_cddir = Cvar_Get("cddir", "", CVAR_NOSET);
 
+	/* fs_mmap <0|1> Maps PAK files into memory and lets
+	   FS_LoadFile() return pointers into the mapping. */
+	fs_mmap = Cvar_Get("fs_mmap", "0", CVAR_NOSET);
+
 	if (fs_cddir->string[0] != '\0')
 	{
 		FS_AddGameDirectory(va("%s/" BASEDIRNAME, fs_cddir->string));
@@ -1565,6 +2834,11 @@ FS_InitFilesystem(void)
 	/* Debug flag. */
 	fs_debug = Cvar_Get("fs_debug", "0", 0);
 
+	/* fs_prefetch <0|1> Read map resources ahead in a worker
+	   thread, keeping up to fs_prefetchmem MB decompressed. */
+	fs_prefetchvar = Cvar_Get("fs_prefetch", "0", CVAR_ARCHIVE);
+	fs_prefetchmem = Cvar_Get("fs_prefetchmem", "64", CVAR_ARCHIVE);
+
 	/* Game directory. */
 	fs_gamedirvar = Cvar_Get("game", "", CVAR_LATCH | CVAR_SERVERINFO);
 
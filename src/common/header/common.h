@@ -158,6 +158,19 @@ void Info_Print(char *s);
 
 #define PROTOCOL_VERSION 34
 
+/* servers sending more than the original 10 frames per
+   second put their frame rate into the upper bits of the
+   serverdata protocol, older clients refuse to play that */
+#define PROTOCOL_FRAMERATE(rate) \
+	((rate) == 10 ? PROTOCOL_VERSION : (PROTOCOL_VERSION | ((rate) << 16)))
+
+/* highest sv_fps, in whole multiples of 10 */
+#define PROTOCOL_MAX_FRAMERATE 40
+
+/* the game's 100 msec frames end on every (rate / 10)th of
+   these frames, in the others only players and missiles move */
+#define PROTOCOL_GAMEFRAME(frame, rate) (!((frame) % ((rate) / 10)))
+
 /* ========================================= */
 
 #define PORT_MASTER 27900
@@ -169,6 +182,11 @@ void Info_Print(char *s);
 #define UPDATE_BACKUP 16    /* copies of entity_state_t to keep buffered */
 #define UPDATE_MASK (UPDATE_BACKUP - 1)
 
+/* frames to keep for the same 1.6 seconds at faster rates,
+   rounded up to a power of two so that they can be masked */
+#define PROTOCOL_UPDATE_BACKUP(rate) \
+	((rate) > 20 ? UPDATE_BACKUP * 4 : UPDATE_BACKUP * (rate) / 10)
+
 /* server to client */
 enum svc_ops_e
 {
@@ -323,6 +341,11 @@ void Cbuf_AddText(char *text);
 /* as new commands are generated from the console or keybindings, */
 /* the text is added to the end of the command buffer. */
 
+void Cbuf_QueueText(char *text);
+
+/* like Cbuf_AddText, but safe to call from any thread. The text */
+/* is added to the command buffer by the next Cbuf_Execute. */
+
 void Cbuf_InsertText(char *text);
 
 /* when a command wants to issue other commands immediately, the text is */
@@ -525,6 +548,7 @@ void NET_Config(qboolean multiplayer);
 qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from,
 		sizebuf_t *net_message);
 void NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to);
+void NET_FlushPackets(void); /* sends queued server packets */
 
 qboolean NET_CompareAdr(netadr_t a, netadr_t b);
 qboolean NET_CompareBaseAdr(netadr_t a, netadr_t b);
@@ -591,6 +615,7 @@ qboolean Netchan_CanReliable(netchan_t *chan);
 
 #include "files.h"
 
+void CM_Init(void);
 cmodel_t *CM_LoadMap(char *name, qboolean clientload, unsigned *checksum);
 cmodel_t *CM_InlineModel(char *name);       /* *1, *2, etc */
 
@@ -598,6 +623,11 @@ int CM_NumClusters(void);
 int CM_NumInlineModels(void);
 char *CM_EntityString(void);
 
+/* the texinfo of the loaded map, the client checks
+   and reads ahead the textures named there */
+extern int numtexinfo;
+extern mapsurface_t map_surfaces[];
+
 /* creates a clipping hull for an arbitrary box */
 int CM_HeadnodeForBox(vec3_t mins, vec3_t maxs);
 
@@ -612,9 +642,17 @@ trace_t CM_TransformedBoxTrace(vec3_t start, vec3_t end,
 		vec3_t mins, vec3_t maxs, int headnode,
 		int brushmask, vec3_t origin, vec3_t angles);
 
+/* drops all cached traces, called once per frame */
+void CM_ClearTraceCache(void);
+
 byte *CM_ClusterPVS(int cluster);
 byte *CM_ClusterPHS(int cluster);
 
+qboolean CM_VisCached(void);
+
+/* merges two vis rows, size in bytes and a multiple of 4 */
+void CM_OrVis(byte *dst, const byte *src, int size);
+
 int CM_PointLeafnum(vec3_t p);
 
 /* call with topnode set to the headnode, returns with topnode */
@@ -685,15 +723,29 @@ void FS_SetGamedir(char *dir);
 char *FS_Gamedir(void);
 char *FS_NextPath(char *prevpath);
 int FS_LoadFile(char *path, void **buffer);
+int FS_LoadFileWritable(char *path, void **buffer);
 
 /* a null buffer will just return the file length without loading */
 /* a -1 length is not present */
+/* FS_LoadFile buffers may be read only, loaders modifying the */
+/* file in place must use FS_LoadFileWritable */
 
 /* properly handles partial reads */
 
 void FS_FreeFile(void *buffer);
 void FS_CreatePath(char *path);
 
+/* reads files ahead in a worker thread */
+void FS_Prefetch(const char *name);
+void FS_PrefetchConfigstrings(char configstrings[MAX_CONFIGSTRINGS][MAX_QPATH]);
+void FS_PrefetchFlush(void);
+void FS_PrefetchShutdown(void);
+
+/* wall time per load phase, printed by fs_loadtimes */
+void FS_StartLoadTiming(void);
+void FS_LoadPhase(const char *name);
+void FS_StopLoadTiming(void);
+
 /* MISC */
 
 #define ERR_FATAL 0         /* exit the entire game with a popup window */
@@ -709,6 +761,8 @@ void FS_CreatePath(char *path);
 
 void Com_BeginRedirect(int target, char *buffer, int buffersize, void (*flush));
 void Com_EndRedirect(void);
+void Com_InitPrintQueue(void);
+void Com_FlushPrints(void);
 void Com_Printf(char *fmt, ...);
 void Com_DPrintf(char *fmt, ...);
 void Com_MDPrintf(char *fmt, ...);
@@ -736,6 +790,18 @@ extern int time_after_game;
 extern int time_before_ref;
 extern int time_after_ref;
 
+/* profile.c, timed zones for profile_start / profile_stop */
+extern qboolean prof_active;
+void Prof_Init(void);
+void Prof_Begin(const char *name);
+void Prof_End(void);
+void Prof_EndAll(void);
+void Prof_ThreadName(const char *name);
+void Prof_ThreadExit(void);
+
+#define PROF_BEGIN(name) do { if (prof_active) Prof_Begin(name); } while (0)
+#define PROF_END() do { if (prof_active) Prof_End(); } while (0)
+
 void Z_Free(void *ptr);
 void *Z_Malloc(int size);           /* returns 0 filled memory */
 void *Z_TagMalloc(int size, int tag);
@@ -765,12 +831,30 @@ void Sys_Quit(void);
 char *Sys_GetHomeDir(void);
 const char *Sys_GetBinaryDir(void);
 void Sys_Sleep(int msec);
+long long Sys_Microseconds(void);
+long long Sys_Nanoseconds(void);
+
+/* threads, mutexes and condition variables */
+typedef void (*sysThreadFunc_t)(void *arg);
+void *Sys_CreateThread(sysThreadFunc_t func, void *arg);
+void Sys_WaitThread(void *thread);
+void *Sys_CreateMutex(void);
+void Sys_DestroyMutex(void *mutex);
+void Sys_LockMutex(void *mutex);
+void Sys_UnlockMutex(void *mutex);
+void *Sys_CreateCond(void);
+void Sys_DestroyCond(void *cond);
+void Sys_WaitCond(void *cond, void *mutex);
+void Sys_BroadcastCond(void *cond);
 
 void Sys_FreeLibrary(void *handle);
 void *Sys_LoadLibrary(const char *path, const char *sym, void **handle);
 void *Sys_GetProcAddress(void *handle, const char *sym);
 void Sys_RedirectStdout(void);
 
+/* the backend's hunk allocator, registers its cvars and commands */
+void Hunk_Init(void);
+
 /* CLIENT / SERVER SYSTEMS */
 
 void CL_Init(void);
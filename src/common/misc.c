@@ -44,7 +44,6 @@ cvar_t *dedicated;
 
 extern cvar_t *logfile_active;
 extern jmp_buf abortframe; /* an ERR_DROP occured, exit the entire frame */
-extern zhead_t z_chain;
 
 static byte chktbl[1024] = {
 	0x84, 0x47, 0x51, 0xc1, 0x93, 0x22, 0x21, 0x24, 0x2f, 0x66, 0x60, 0x4d, 0xb0, 0x7c, 0xda,
@@ -185,13 +184,13 @@ Qcommon_Init(int argc, char **argv)
 {
 	char *s;
 
+	Com_InitPrintQueue();
+
 	if (setjmp(abortframe))
 	{
 		Sys_Error("Error during initialization");
 	}
 
-	z_chain.next = z_chain.prev = &z_chain;
-
 	/* prepare enough of the subsystems to handle
 	   cvar and command buffer management */
 	COM_InitArgv(argc, argv);
@@ -261,8 +260,11 @@ Qcommon_Init(int argc, char **argv)
 	}
 
 	Sys_Init();
+	Prof_Init();
+	Hunk_Init();
 	NET_Init();
 	Netchan_Init();
+	CM_Init();
 	SV_Init();
 #ifndef DEDICATED_ONLY
 	CL_Init();
@@ -309,9 +311,12 @@ Qcommon_Frame(int msec)
 
 	if (setjmp(abortframe))
 	{
+		Prof_EndAll();
 		return; /* an ERR_DROP was thrown */
 	}
 
+	Com_FlushPrints();
+
 	if (log_stats->modified)
 	{
 		log_stats->modified = false;
@@ -381,6 +386,8 @@ Qcommon_Frame(int msec)
 
 	Cbuf_Execute();
 
+	CM_ClearTraceCache();
+
 #ifndef DEDICATED_ONLY
 	if (host_speeds->value)
 	{
@@ -419,5 +426,6 @@ Qcommon_Frame(int msec)
 void
 Qcommon_Shutdown(void)
 {
+	FS_PrefetchShutdown();
 }
 
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Hot path profiler. Code marks zones with PROF_BEGIN() and PROF_END(),
+ * between profile_start and profile_stop every finished zone is put
+ * into a ring buffer owned by the thread that ran it. profile_stop
+ * writes all rings as a Chrome trace (chrome://tracing, about:tracing
+ * or Perfetto). When not profiling a zone costs a single test of
+ * prof_active.
+ *
+ * =======================================================================
+ */
+
+#include "header/common.h"
+
+#define PROF_MAX_THREADS 32
+#define PROF_MAX_DEPTH 32
+#define PROF_RING_SIZE 65536 /* events per thread, power of two */
+
+typedef struct
+{
+	const char *name;
+	long long start;
+	long long end;
+} profevent_t;
+
+typedef struct
+{
+	char name[32];
+	qboolean inuse; /* owned by a running thread */
+	profevent_t *events;
+	unsigned written; /* events ever written, the ring wraps */
+
+	/* zones begun but not yet ended */
+	const char *stackname[PROF_MAX_DEPTH];
+	long long stackstart[PROF_MAX_DEPTH];
+	int depth;
+} profthread_t;
+
+qboolean prof_active;
+
+static profthread_t prof_threads[PROF_MAX_THREADS];
+static int prof_numthreads;
+static int prof_unprofiled; /* threads that found no free slot */
+static void *prof_mutex;
+static long long prof_starttime;
+
+static __thread profthread_t *prof_thread;
+static __thread qboolean prof_noslot; /* don't try again */
+
+/*
+ * Gives the calling thread a slot. A thread restarted
+ * under the same name gets its old slot and ring back,
+ * then come unused slots, then those of exited threads.
+ */
+static profthread_t *
+Prof_ClaimThread(const char *name)
+{
+	profthread_t *t;
+	int i;
+
+	Sys_LockMutex(prof_mutex);
+
+	t = NULL;
+
+	for (i = 0; name && (i < prof_numthreads); i++)
+	{
+		if (!prof_threads[i].inuse && !strcmp(prof_threads[i].name, name))
+		{
+			t = &prof_threads[i];
+			break;
+		}
+	}
+
+	if (!t && (prof_numthreads < PROF_MAX_THREADS))
+	{
+		t = &prof_threads[prof_numthreads];
+		Com_sprintf(t->name, sizeof(t->name), "thread %i", prof_numthreads);
+		prof_numthreads++;
+	}
+
+	for (i = 0; !t && (i < prof_numthreads); i++)
+	{
+		if (!prof_threads[i].inuse)
+		{
+			t = &prof_threads[i];
+			t->written = 0;
+		}
+	}
+
+	if (t)
+	{
+		t->inuse = true;
+		t->depth = 0;
+
+		if (name)
+		{
+			Q_strlcpy(t->name, name, sizeof(t->name));
+		}
+	}
+	else
+	{
+		prof_unprofiled++;
+	}
+
+	Sys_UnlockMutex(prof_mutex);
+
+	prof_thread = t;
+	prof_noslot = !t;
+
+	return t;
+}
+
+static profthread_t *
+Prof_Thread(void)
+{
+	if (prof_thread || prof_noslot)
+	{
+		return prof_thread;
+	}
+
+	return Prof_ClaimThread(NULL);
+}
+
+void
+Prof_Begin(const char *name)
+{
+	profthread_t *t;
+
+	if (!(t = Prof_Thread()))
+	{
+		return;
+	}
+
+	/* the ring is only allocated once the thread is profiled */
+	if (!t->events)
+	{
+		if (!(t->events = malloc(PROF_RING_SIZE * sizeof(profevent_t))))
+		{
+			return;
+		}
+	}
+
+	if (t->depth < PROF_MAX_DEPTH)
+	{
+		t->stackname[t->depth] = name;
+		t->stackstart[t->depth] = Sys_Microseconds();
+	}
+
+	t->depth++;
+}
+
+void
+Prof_End(void)
+{
+	profthread_t *t;
+	profevent_t *ev;
+
+	t = prof_thread;
+
+	/* the zone was begun before profiling started */
+	if (!t || !t->events || !t->depth)
+	{
+		return;
+	}
+
+	t->depth--;
+
+	if (t->depth >= PROF_MAX_DEPTH)
+	{
+		return;
+	}
+
+	ev = &t->events[t->written & (PROF_RING_SIZE - 1)];
+	ev->name = t->stackname[t->depth];
+	ev->start = t->stackstart[t->depth];
+	ev->end = Sys_Microseconds();
+	t->written++;
+}
+
+/*
+ * Ends all zones of the calling thread, for
+ * when an error longjmp()ed out of them
+ */
+void
+Prof_EndAll(void)
+{
+	while (prof_thread && prof_thread->depth)
+	{
+		Prof_End();
+	}
+}
+
+/*
+ * Names the calling thread in the trace
+ */
+void
+Prof_ThreadName(const char *name)
+{
+	if (!prof_thread && !prof_noslot)
+	{
+		Prof_ClaimThread(name);
+	}
+	else if (prof_thread)
+	{
+		Q_strlcpy(prof_thread->name, name, sizeof(prof_thread->name));
+	}
+}
+
+/*
+ * Gives the slot of the calling thread back, called by
+ * threads right before they exit. The events stay in
+ * the trace until the slot is used again.
+ */
+void
+Prof_ThreadExit(void)
+{
+	prof_noslot = false;
+
+	if (!prof_thread)
+	{
+		return;
+	}
+
+	Sys_LockMutex(prof_mutex);
+	prof_thread->inuse = false;
+	Sys_UnlockMutex(prof_mutex);
+
+	prof_thread = NULL;
+}
+
+static void
+Prof_Start_f(void)
+{
+	int i;
+
+	if (prof_active)
+	{
+		Com_Printf("Already profiling.\n");
+		return;
+	}
+
+	/* other threads are idle between frames, when
+	   commands are executed, so this doesn't race */
+	for (i = 0; i < prof_numthreads; i++)
+	{
+		prof_threads[i].written = 0;
+		prof_threads[i].depth = 0;
+	}
+
+	prof_starttime = Sys_Microseconds();
+	prof_active = true;
+
+	Com_Printf("Profiling, profile_stop <file> writes the trace.\n");
+}
+
+static void
+Prof_Stop_f(void)
+{
+	char name[MAX_OSPATH];
+	profthread_t *t;
+	profevent_t *ev;
+	unsigned first, j;
+	int i, events, dropped;
+	FILE *f;
+
+	if (!prof_active)
+	{
+		Com_Printf("Not profiling.\n");
+		return;
+	}
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("usage: profile_stop <filename>\n");
+		return;
+	}
+
+	prof_active = false;
+
+	Com_sprintf(name, sizeof(name), "%s/%s.json", FS_Gamedir(), Cmd_Argv(1));
+	FS_CreatePath(name);
+
+	if (!(f = fopen(name, "w")))
+	{
+		Com_Printf("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	events = dropped = 0;
+
+	for (i = 0; i < prof_numthreads; i++)
+	{
+		t = &prof_threads[i];
+
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+				"\"tid\":%i,\"args\":{\"name\":\"%s\"}}", i ? ",\n" : "",
+				i, t->name);
+
+		first = 0;
+
+		if (t->written > PROF_RING_SIZE)
+		{
+			first = t->written - PROF_RING_SIZE;
+			dropped += first;
+		}
+
+		for (j = first; j < t->written; j++)
+		{
+			ev = &t->events[j & (PROF_RING_SIZE - 1)];
+
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,"
+					"\"ts\":%lld,\"dur\":%lld}", ev->name, i,
+					ev->start - prof_starttime, ev->end - ev->start);
+			events++;
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	Com_Printf("Wrote %i events of %i threads to %s", events,
+			prof_numthreads, name);
+
+	if (dropped)
+	{
+		Com_Printf(", %i older events were overwritten", dropped);
+	}
+
+	Com_Printf(".\n");
+
+	if (prof_unprofiled)
+	{
+		Com_Printf("WARNING: %i threads weren't profiled, all %i slots were taken.\n",
+				prof_unprofiled, PROF_MAX_THREADS);
+	}
+}
+
+void
+Prof_Init(void)
+{
+	prof_mutex = Sys_CreateMutex();
+	Prof_ThreadName("main");
+
+	Cmd_AddCommand("profile_start", Prof_Start_f);
+	Cmd_AddCommand("profile_stop", Prof_Stop_f);
+}
@@ -1078,6 +1078,32 @@ Q_strcasecmp(char *s1, char *s2)
 	return Q_strncasecmp(s1, s2, 99999);
 }
 
+/*
+ * Hash that doesn't change with the case of the
+ * string, strings equal for Q_strcasecmp() hash
+ * to the same value.
+ */
+unsigned
+Q_strcasehash(const char *s)
+{
+	unsigned hash;
+	int c;
+
+	hash = 0;
+
+	while ((c = *s++))
+	{
+		if ((c >= 'a') && (c <= 'z'))
+		{
+			c -= ('a' - 'A');
+		}
+
+		hash = hash * 31 + c;
+	}
+
+	return hash;
+}
+
 void
 Com_sprintf(char *dest, int size, char *fmt, ...)
 {
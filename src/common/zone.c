@@ -19,7 +19,11 @@
  *
  * =======================================================================
  *
- * Zone malloc. It's just a normal malloc with tags.
+ * Zone malloc. Allocations are grouped by tag, so that a whole tag can
+ * be released at once. Small blocks are carved out of per tag slabs
+ * with a free list for each size class, larger blocks are plain
+ * mallocs kept on a list per tag. Z_FreeTags() gives the slabs of a
+ * tag back in one go, without walking the small blocks.
  *
  * =======================================================================
  */
@@ -28,14 +32,129 @@
 #include "header/zone.h"
 
 #define Z_MAGIC 0x1d1d
+#define Z_FREEMAGIC 0x1d1e /* small block on a free list */
 
-zhead_t z_chain;
+#define Z_MAXTAGS 64 /* must be a power of two */
+#define Z_NUMCLASSES 6
+#define Z_SLABSIZE 0x8000
+#define Z_SLABHEADER 16 /* keeps the blocks aligned */
+
+typedef struct zslab_s
+{
+	struct zslab_s	*next;
+	int		blocksize;
+} zslab_t;
+
+typedef struct
+{
+	qboolean	used;
+	short		tag;
+	zhead_t		blocks; /* large blocks */
+	zhead_t		*freeblocks[Z_NUMCLASSES];
+	zslab_t		*slabs;
+	int			count, bytes; /* live blocks, including headers */
+	int			largecount;
+	int			numslabs;
+	int			slabbytes; /* requested bytes in the slabs */
+} ztag_t;
+
+/* block sizes, including the zhead_t */
+static const int z_classsizes[Z_NUMCLASSES] = {32, 64, 128, 256, 512, 1024};
+
+ztag_t z_tags[Z_MAXTAGS];
 int z_count, z_bytes;
 
+static int
+Z_SizeClass(int size)
+{
+	int i;
+
+	for (i = 0; i < Z_NUMCLASSES; i++)
+	{
+		if (size <= z_classsizes[i])
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static ztag_t *
+Z_FindTag(int tag, qboolean create)
+{
+	ztag_t *t;
+	int i;
+
+	/* records are never removed, so
+	   probing stops at the first free one */
+	for (i = 0; i < Z_MAXTAGS; i++)
+	{
+		t = &z_tags[((unsigned short)tag + i) & (Z_MAXTAGS - 1)];
+
+		if (t->used && (t->tag == (short)tag))
+		{
+			return t;
+		}
+
+		if (!t->used)
+		{
+			if (!create)
+			{
+				return NULL;
+			}
+
+			t->used = true;
+			t->tag = tag;
+			t->blocks.next = t->blocks.prev = &t->blocks;
+
+			return t;
+		}
+	}
+
+	Com_Error(ERR_FATAL, "Z_TagMalloc: more than %i tags", Z_MAXTAGS);
+
+	return NULL;
+}
+
+static void
+Z_NewSlab(ztag_t *t, int class)
+{
+	zslab_t *slab;
+	zhead_t *z;
+	int i, count;
+
+	slab = malloc(Z_SLABSIZE);
+
+	if (!slab)
+	{
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", Z_SLABSIZE);
+	}
+
+	slab->next = t->slabs;
+	slab->blocksize = z_classsizes[class];
+	t->slabs = slab;
+	t->numslabs++;
+
+	/* pushed backwards, so that the blocks
+	   are handed out in address order */
+	count = (Z_SLABSIZE - Z_SLABHEADER) / z_classsizes[class];
+
+	for (i = count - 1; i >= 0; i--)
+	{
+		z = (zhead_t *)((byte *)slab + Z_SLABHEADER + i * z_classsizes[class]);
+		z->magic = Z_FREEMAGIC;
+		z->next = t->freeblocks[class];
+		t->freeblocks[class] = z;
+	}
+}
+
 void
 Z_Free(void *ptr)
 {
 	zhead_t *z;
+	ztag_t *t;
+	int class;
 
 	z = ((zhead_t *)ptr) - 1;
 
@@ -46,60 +165,153 @@ Z_Free(void *ptr)
 		Com_Error(ERR_FATAL, "Z_Free: bad magic");
 	}
 
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
+	t = Z_FindTag(z->tag, false);
+
+	if (!t)
+	{
+		Com_Error(ERR_FATAL, "Z_Free: bad tag");
+	}
 
 	z_count--;
 	z_bytes -= z->size;
-	free(z);
+	t->count--;
+	t->bytes -= z->size;
+
+	class = Z_SizeClass(z->size);
+
+	if (class < 0)
+	{
+		z->prev->next = z->next;
+		z->next->prev = z->prev;
+		t->largecount--;
+		free(z);
+	}
+	else
+	{
+		t->slabbytes -= z->size;
+
+		z->magic = Z_FREEMAGIC;
+		z->next = t->freeblocks[class];
+		t->freeblocks[class] = z;
+	}
 }
 
 void
 Z_Stats_f(void)
 {
+	ztag_t *t;
+	int i, slabsize;
+
 	Com_Printf("%i bytes in %i blocks\n", z_bytes, z_count);
+
+	for (i = 0, t = z_tags; i < Z_MAXTAGS; i++, t++)
+	{
+		if (!t->used || (!t->count && !t->numslabs))
+		{
+			continue;
+		}
+
+		/* fragmentation is the part of the slabs
+		   that doesn't hold requested bytes */
+		slabsize = t->numslabs * Z_SLABSIZE;
+
+		Com_Printf("tag %5i: %6i blocks, %9i bytes, %5i large, %4i slabs, %5.1f%% fragmented\n",
+				t->tag, t->count, t->bytes, t->largecount, t->numslabs,
+				slabsize ? 100.0 * (slabsize - t->slabbytes) / slabsize : 0.0);
+	}
 }
 
 void
 Z_FreeTags(int tag)
 {
 	zhead_t *z, *next;
+	zslab_t *slab, *nextslab;
+	ztag_t *t;
+
+	t = Z_FindTag(tag, false);
+
+	if (!t)
+	{
+		return;
+	}
 
-	for (z = z_chain.next; z != &z_chain; z = next)
+	for (z = t->blocks.next; z != &t->blocks; z = next)
 	{
 		next = z->next;
+		free(z);
+	}
 
-		if (z->tag == tag)
-		{
-			Z_Free((void *)(z + 1));
-		}
+	for (slab = t->slabs; slab; slab = nextslab)
+	{
+		nextslab = slab->next;
+		free(slab);
 	}
+
+	z_count -= t->count;
+	z_bytes -= t->bytes;
+
+	t->blocks.next = t->blocks.prev = &t->blocks;
+	memset(t->freeblocks, 0, sizeof(t->freeblocks));
+	t->slabs = NULL;
+	t->count = 0;
+	t->bytes = 0;
+	t->largecount = 0;
+	t->numslabs = 0;
+	t->slabbytes = 0;
 }
 
 void *
 Z_TagMalloc(int size, int tag)
 {
 	zhead_t *z;
+	ztag_t *t;
+	int class;
 
 	size = size + sizeof(zhead_t);
-	z = malloc(size);
+	t = Z_FindTag(tag, true);
+	class = Z_SizeClass(size);
+
+	if (class < 0)
+	{
+		z = malloc(size);
+
+		if (!z)
+		{
+			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+		}
 
-	if (!z)
+		memset(z, 0, size);
+
+		z->next = t->blocks.next;
+		z->prev = &t->blocks;
+		t->blocks.next->prev = z;
+		t->blocks.next = z;
+		t->largecount++;
+	}
+	else
 	{
-		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+		if (!t->freeblocks[class])
+		{
+			Z_NewSlab(t, class);
+		}
+
+		z = t->freeblocks[class];
+		t->freeblocks[class] = z->next;
+		memset(z, 0, size);
+
+		t->slabbytes += size;
 	}
 
-	memset(z, 0, size);
-	z_count++;
-	z_bytes += size;
+	/* the header layout and size (including the
+	   header) are relied upon by some game code */
 	z->magic = Z_MAGIC;
 	z->tag = tag;
 	z->size = size;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
+	t->count++;
+	t->bytes += size;
+	z_count++;
+	z_bytes += size;
 
 	return (void *)(z + 1);
 }
@@ -109,4 +321,3 @@ Z_Malloc(int size)
 {
 	return Z_TagMalloc(size, 0);
 }
-
@@ -71,6 +71,7 @@ cvar_t *flood_persecond;
 cvar_t *flood_waitdelay;
 
 cvar_t *sv_maplist;
+cvar_t *sv_framerate;
 
 void SpawnEntities( char *mapname, char *entities, char *spawnpoint );
 void ClientThink( edict_t *ent, usercmd_t *cmd );
@@ -353,15 +354,25 @@ ExitLevel( void ) {
 }
 
 /*
- * Advances the world by 0.1 seconds
+ * Advances the world by one server frame, 1 / sv_fps
+ * seconds. Missiles move in every one, everything else
+ * thinks and moves in 0.1 second game frames, once the
+ * server frames have added up to one
  */
 void
 G_RunFrame( void ) {
 	int i;
 	edict_t *ent;
+	qboolean gameframe;
 
-	level.framenum++;
-	level.time = level.framenum * FRAMETIME;
+	level.serverframe++;
+	level.time = level.serverframe * ( 1.0 / level.framerate );
+
+	gameframe = !( level.serverframe % ( level.framerate / 10 ) );
+
+	if ( gameframe ) {
+		level.framenum++;
+	}
 
 	/* exit intermissions */
 	if ( level.exitintermission ) {
@@ -379,6 +390,13 @@ G_RunFrame( void ) {
 			continue;
 		}
 
+		/* the world and the clients only
+		   run in game frames */
+		if ( !gameframe && ( ( i <= maxclients->value ) ||
+		                     !G_MovesEveryFrame( ent ) ) ) {
+			continue;
+		}
+
 		level.current_entity = ent;
 
 		VectorCopy( ent->s.origin, ent->s.old_origin );
@@ -397,6 +415,10 @@ G_RunFrame( void ) {
 		G_RunEntity( ent );
 	}
 
+	if ( !gameframe ) {
+		return;
+	}
+
 	/* see if it is time to end a deathmatch */
 	CheckDMRules();
 
@@ -815,11 +815,11 @@ SV_Physics_Toss( edict_t *ent ) {
 
 	SV_CheckVelocity( ent );
 
-	/* move angles */
-	VectorMA( ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles );
+	/* move angles, in every server frame */
+	VectorMA( ent->s.angles, level.frametime, ent->avelocity, ent->s.angles );
 
 	/* move origin */
-	VectorScale( ent->velocity, FRAMETIME, move );
+	VectorScale( ent->velocity, level.frametime, move );
 	trace = SV_PushEntity( ent, move );
 
 	if ( !ent->inuse ) {
@@ -872,6 +872,23 @@ SV_Physics_Toss( edict_t *ent ) {
 	}
 }
 
+/*
+ * Missiles and other tossed entities move in every
+ * server frame, everything else only in game frames
+ */
+qboolean
+G_MovesEveryFrame( edict_t *ent ) {
+	switch ( ( int )ent->movetype ) {
+	case MOVETYPE_TOSS:
+	case MOVETYPE_BOUNCE:
+	case MOVETYPE_FLY:
+	case MOVETYPE_FLYMISSILE:
+		return true;
+	default:
+		return false;
+	}
+}
+
 void
 G_RunEntity( edict_t *ent ) {
 	if ( !ent ) {
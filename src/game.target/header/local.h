@@ -141,9 +141,15 @@ typedef struct {
 /* this structure is cleared as each map is entered
    it is read/written to the level.sav file for savegames */
 typedef struct {
-	int framenum;
+	int framenum; /* 0.1 second game frames */
 	float time;
 
+	/* the server calls G_RunFrame framerate (sv_fps) times
+	   a second, frametime seconds apart */
+	int serverframe;
+	int framerate;
+	float frametime;
+
 	char level_name[MAX_QPATH]; /* the descriptive name (Outer Base, etc) */
 	char mapname[MAX_QPATH]; /* the server name (base1, etc) */
 	char nextmap[MAX_QPATH]; /* go here when fraglimit is hit */
@@ -285,6 +291,7 @@ extern cvar_t *flood_persecond;
 extern cvar_t *flood_waitdelay;
 
 extern cvar_t *sv_maplist;
+extern cvar_t *sv_framerate;
 
 #define world (&g_edicts[0])
 
@@ -388,6 +395,7 @@ void G_CheckChaseStats( edict_t *ent );
 void DeathmatchScoreboardMessage( edict_t *client, edict_t *killer );
 
 /* g_phys.c */
+qboolean G_MovesEveryFrame( edict_t *ent );
 void G_RunEntity( edict_t *ent );
 
 /* g_main.c */
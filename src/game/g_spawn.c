@@ -247,6 +247,15 @@ void SpawnEntities( const char *mapname, char *entities, const char *spawnpoint
 
 	Q_strlcpy( level.mapname, mapname, sizeof( level.mapname ) );
 
+	/* the server runs the map at its sv_fps */
+	level.framerate = ( int )sv_framerate->value;
+
+	if ( ( level.framerate < 10 ) || ( level.framerate % 10 ) ) {
+		level.framerate = 10;
+	}
+
+	level.frametime = 1.0 / level.framerate;
+
 	/* set client fields on player ents */
 	for ( i = 0; i < game.maxclients; i++ ) {
 		g_edicts[i + 1].client = game.clients + i;
@@ -164,6 +164,11 @@ void InitGame( void ) {
 	/* dm map list */
 	sv_maplist = gi.cvar( "sv_maplist", "", 0 );
 
+	/* G_RunFrame keeps its own 0.1 second frames,
+	   so the server can call it in every frame */
+	sv_framerate = gi.cvar( "sv_framerate", "10", CVAR_NOSET );
+	gi.cvar_forceset( "g_subframes", "1" );
+
 	/* initialize all entities for this game */
 	game.maxentities = maxentities->value;
 	g_edicts = gi.TagMalloc( game.maxentities * sizeof( g_edicts[0] ), TAG_GAME );
@@ -34,6 +34,11 @@
 #define LATENCY_COUNTS 16
 #define RATE_MESSAGES 10
 
+/* the server can send frames faster than the 10 Hz
+   the game is written for, but only in whole multiples */
+#define SV_MAX_FRAMERATE PROTOCOL_MAX_FRAMERATE
+#define SV_FRAMETIME(n) ((int)((long long)(n) * 1000 / sv.framerate))
+
 /* MAX_CHALLENGES is made large to prevent a denial
    of service attack that could cycle all of them
    out before legitimate users connected */
@@ -60,8 +65,10 @@ typedef struct
 	qboolean attractloop;           /* running cinematics and demos for the local system only */
 	qboolean loadgame;              /* client begins should reuse existing entity */
 
-	unsigned time;                  /* always sv.framenum * 100 msec */
+	unsigned time;                  /* always SV_FRAMETIME(sv.framenum) msec */
 	int framenum;
+	int framerate;                  /* server frames per second, sv_fps */
+	qboolean gamesubframes;         /* ge->RunFrame runs in every frame, g_subframes */
 
 	char name[MAX_QPATH];           /* map name, or cinematic name */
 	struct cmodel_s *models[MAX_MODELS];
@@ -88,14 +95,21 @@ typedef enum
 	cs_spawned      /* client is fully in game */
 } client_state_t;
 
+/* every client has its own part of svs.client_entities,
+   so that frames can be built for clients in parallel */
+#define CLIENT_ENTITIES (svs.update_backup * 64)
+
+#define MAX_SEND_THREADS 16
+
 typedef struct
 {
 	int areabytes;
 	byte areabits[MAX_MAP_AREAS / 8];       /* portalarea visibility bits */
 	player_state_t ps;
 	int num_entities;
-	int first_entity;                       /* into the circular sv_packet_entities[] */
+	int first_entity;                       /* into the client's circular part of svs.client_entities */
 	int senttime;                           /* for ping calculations */
+	int sendcount;                          /* sv_sendcount when built */
 } client_frame_t;
 
 typedef struct client_s
@@ -126,7 +140,12 @@ typedef struct client_s
 	sizebuf_t datagram;
 	byte datagram_buf[MAX_MSGLEN];
 
-	client_frame_t frames[UPDATE_BACKUP];     /* updates can be delta'd from here */
+	/* the frame message, built in parallel
+	   before the datagrams are sent */
+	sizebuf_t framemsg;
+	byte framemsg_buf[MAX_MSGLEN];
+
+	int next_entities;                  /* next slot in this client's CLIENT_ENTITIES */
 
 	byte *download;                     /* file being downloaded */
 	int downloadsize;                   /* total bytes (can't use EOF because of paks) */
@@ -158,9 +177,10 @@ typedef struct
 										/* used to check late spawns */
 
 	client_t *clients;                  /* [maxclients->value]; */
-	int num_client_entities;            /* maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES */
-	int next_client_entities;           /* next client_entity to use */
-	entity_state_t *client_entities;    /* [num_client_entities] */
+	int update_backup;                  /* PROTOCOL_UPDATE_BACKUP(sv.framerate) */
+	client_frame_t *client_frames;      /* [update_backup] per client, updates can be delta'd from here */
+	int num_client_entities;            /* maxclients->value*CLIENT_ENTITIES */
+	entity_state_t *client_entities;    /* [num_client_entities], CLIENT_ENTITIES per client */
 
 	int last_heartbeat;
 
@@ -186,6 +206,13 @@ extern cvar_t *sv_noreload;                 /* don't reload level state when ree
 extern cvar_t *sv_airaccelerate;            /* don't reload level state when reentering */
 											/* development tool */
 extern cvar_t *sv_enforcetime;
+extern cvar_t *sv_threads;
+extern cvar_t *sv_fps;
+extern cvar_t *sv_deltacache;
+extern cvar_t *sv_areagrid;
+extern cvar_t *sv_linkcache;
+
+extern int sv_sendcount; /* calls to SV_SendClientMessages */
 
 extern client_t *sv_client;
 extern edict_t *sv_player;
@@ -212,6 +239,7 @@ void SV_InitGame(void);
 void SV_Map(qboolean attractloop, char *levelstring, qboolean loadgame);
 
 void SV_PrepWorldFrame(void);
+void SV_RunGameFrames(int frames);
 
 typedef enum {RD_NONE, RD_CLIENT, RD_PACKET} redirect_t;
 
@@ -236,9 +264,15 @@ void SV_ExecuteClientMessage(client_t *cl);
 void SV_ReadLevelFile(void);
 void SV_Status_f(void);
 
-void SV_WriteFrameToClient(client_t *client, sizebuf_t *msg);
+client_frame_t *SV_ClientFrame(client_t *client, int framenum);
+void SV_WriteFrameToClient(client_t *client, sizebuf_t *msg, int thread);
+void SV_AllocDeltaCaches(int threads);
+void SV_DeltaStats(int frames);
+void SV_StopSendThreads(void);
+void SV_SendStats_f(void);
+void SV_TickJitter_f(void);
 void SV_RecordDemoMessage(void);
-void SV_BuildClientFrame(client_t *client);
+void SV_BuildClientFrame(client_t *client, byte *fatpvs);
 
 void SV_Error(char *error, ...);
 
@@ -273,6 +307,13 @@ void SV_LinkEdict(edict_t *ent);
 int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list,
 		int maxcount, int areatype);
 
+/* prints spatial index statistics and resets them */
+void SV_AreaStats_f(void);
+
+/* closes the per frame link statistics */
+void SV_EndLinkFrame(void);
+extern int sv_lastlinkcalls, sv_lastlinkrecomputes;
+
 int SV_PointContents(vec3_t p);
 
 trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs,
@@ -638,5 +638,9 @@ SV_InitOperatorCommands(void)
 	Cmd_AddCommand("killserver", SV_KillServer_f);
 
 	Cmd_AddCommand("sv", SV_ServerCommand_f);
+
+	Cmd_AddCommand("sv_areastats", SV_AreaStats_f);
+	Cmd_AddCommand("sv_sendstats", SV_SendStats_f);
+	Cmd_AddCommand("sv_tickjitter", SV_TickJitter_f);
 }
 
@@ -28,13 +28,183 @@
 
 #include "header/server.h"
 
-byte fatpvs[65536 / 8];
+/*
+ * Clients that delta from the same old frame get the same bytes for
+ * an entity, so every send thread keeps the encoded deltas of the
+ * current send. Entries are matched on the sends both frames were
+ * built in, and on solid, which is cleared for the client's own
+ * missiles.
+ */
+typedef struct
+{
+	int sendcount;
+	int fromcount; /* -1 for the baseline */
+	int fromsolid, tosolid;
+	int size;
+	byte data[64];
+} deltaentry_t;
+
+typedef struct
+{
+	int lookups, hits, bytes;
+
+	/* every 16th lookup is timed, in nanoseconds */
+	int timedhits, timedmisses;
+	long long hittime, misstime;
+} deltastats_t;
+
+/* allocated for the send threads in use,
+   MAX_EDICTS * 2 entries per thread */
+static deltaentry_t (*sv_deltacaches[MAX_SEND_THREADS])[2];
+static deltastats_t sv_deltastats[MAX_SEND_THREADS];
+
+static entity_state_t *
+SV_ClientEntity(client_t *client, int index)
+{
+	return &svs.client_entities[(client - svs.clients) * CLIENT_ENTITIES +
+		index % CLIENT_ENTITIES];
+}
+
+client_frame_t *
+SV_ClientFrame(client_t *client, int framenum)
+{
+	return &svs.client_frames[(client - svs.clients) * svs.update_backup +
+		(framenum & (svs.update_backup - 1))];
+}
+
+static void
+SV_WriteCachedDelta(entity_state_t *from, entity_state_t *to, int fromcount,
+		sizebuf_t *msg, qboolean force, qboolean newentity, int thread)
+{
+	deltastats_t *stats;
+	deltaentry_t *d;
+	long long start;
+	qboolean timed;
+	int size;
+
+	if (!sv_deltacaches[thread])
+	{
+		MSG_WriteDeltaEntity(from, to, msg, force, newentity);
+		return;
+	}
+
+	stats = &sv_deltastats[thread];
+	timed = !(stats->lookups++ & 15);
+	start = timed ? Sys_Nanoseconds() : 0;
+	d = &sv_deltacaches[thread][to->number][fromcount & 1];
+
+	if ((d->sendcount == sv_sendcount) && (d->fromcount == fromcount) &&
+		(d->fromsolid == from->solid) && (d->tosolid == to->solid))
+	{
+		SZ_Write(msg, d->data, d->size);
+		stats->hits++;
+		stats->bytes += d->size;
+
+		if (timed)
+		{
+			stats->hittime += Sys_Nanoseconds() - start;
+			stats->timedhits++;
+		}
+
+		return;
+	}
+
+	size = msg->cursize;
+	MSG_WriteDeltaEntity(from, to, msg, force, newentity);
+
+	/* only the encoding, that is what a hit saves */
+	if (timed)
+	{
+		stats->misstime += Sys_Nanoseconds() - start;
+		stats->timedmisses++;
+	}
+
+	size = msg->cursize - size;
+
+	if (msg->overflowed || (size > sizeof(d->data)))
+	{
+		return;
+	}
+
+	d->sendcount = sv_sendcount;
+	d->fromcount = fromcount;
+	d->fromsolid = from->solid;
+	d->tosolid = to->solid;
+	d->size = size;
+	memcpy(d->data, msg->data + msg->cursize - size, size);
+}
+
+/*
+ * Gives the first threads send threads a delta cache and
+ * frees the rest. Called by the main thread while the
+ * workers are idle, 0 frees them all.
+ */
+void
+SV_AllocDeltaCaches(int threads)
+{
+	int i;
+
+	for (i = 0; i < MAX_SEND_THREADS; i++)
+	{
+		if ((i < threads) && !sv_deltacaches[i])
+		{
+			sv_deltacaches[i] = Z_Malloc(MAX_EDICTS * sizeof(*sv_deltacaches[i]));
+		}
+		else if ((i >= threads) && sv_deltacaches[i])
+		{
+			Z_Free(sv_deltacaches[i]);
+			sv_deltacaches[i] = NULL;
+		}
+	}
+}
+
+void
+SV_DeltaStats(int frames)
+{
+	deltastats_t total;
+	double hitcost, misscost;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+
+	for (i = 0; i < MAX_SEND_THREADS; i++)
+	{
+		total.lookups += sv_deltastats[i].lookups;
+		total.hits += sv_deltastats[i].hits;
+		total.bytes += sv_deltastats[i].bytes;
+		total.timedhits += sv_deltastats[i].timedhits;
+		total.timedmisses += sv_deltastats[i].timedmisses;
+		total.hittime += sv_deltastats[i].hittime;
+		total.misstime += sv_deltastats[i].misstime;
+	}
+
+	memset(sv_deltastats, 0, sizeof(sv_deltastats));
+
+	Com_Printf("delta cache: %i of %i entities reused (%.1f%%), %i bytes\n",
+			total.hits, total.lookups,
+			total.lookups ? 100.0f * total.hits / total.lookups : 0.0f,
+			total.bytes);
+
+	if (!total.timedhits || !total.timedmisses)
+	{
+		return;
+	}
+
+	/* a hit costs the lookup and copy instead of an encode */
+	hitcost = (double)total.hittime / total.timedhits;
+	misscost = (double)total.misstime / total.timedmisses;
+
+	Com_Printf("encode %.0f ns, reuse %.0f ns, %.1f us saved per frame\n",
+			misscost, hitcost,
+			total.hits * (misscost - hitcost) / 1000.0 / (frames ? frames : 1));
+}
 
 /*
  * Writes a delta update of an entity_state_t list to the message.
  */
 void
-SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+SV_EmitPacketEntities(client_t *client, client_frame_t *from,
+		client_frame_t *to, sizebuf_t *msg, int thread)
 {
 	entity_state_t *oldent, *newent;
 	int oldindex, newindex;
@@ -71,8 +241,7 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 		}
 		else
 		{
-			newent = &svs.client_entities[(to->first_entity +
-					 newindex) % svs.num_client_entities];
+			newent = SV_ClientEntity(client, to->first_entity + newindex);
 			newnum = newent->number;
 		}
 
@@ -82,8 +251,7 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 		}
 		else
 		{
-			oldent = &svs.client_entities[(from->first_entity +
-					 oldindex) % svs.num_client_entities];
+			oldent = SV_ClientEntity(client, from->first_entity + oldindex);
 			oldnum = oldent->number;
 		}
 
@@ -94,8 +262,8 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 			   being emited if the entity has not changed at all
 			   note that players are always 'newentities', this
 			   updates their oldorigin always and prevents warping */
-			MSG_WriteDeltaEntity(oldent, newent, msg,
-					false, newent->number <= maxclients->value);
+			SV_WriteCachedDelta(oldent, newent, from->sendcount, msg,
+					false, newent->number <= maxclients->value, thread);
 			oldindex++;
 			newindex++;
 			continue;
@@ -104,7 +272,8 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 		if (newnum < oldnum)
 		{
 			/* this is a new entity, send it from the baseline */
-			MSG_WriteDeltaEntity(&sv.baselines[newnum], newent, msg, true, true);
+			SV_WriteCachedDelta(&sv.baselines[newnum], newent, -1, msg,
+					true, true, thread);
 			newindex++;
 			continue;
 		}
@@ -380,13 +549,13 @@ SV_WritePlayerstateToClient(client_frame_t *from, client_frame_t *to,
 }
 
 void
-SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
+SV_WriteFrameToClient(client_t *client, sizebuf_t *msg, int thread)
 {
 	client_frame_t *frame, *oldframe;
 	int lastframe;
 
 	/* this is the frame we are creating */
-	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	frame = SV_ClientFrame(client, sv.framenum);
 
 	if (client->lastframe <= 0)
 	{
@@ -394,16 +563,19 @@ SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
 		oldframe = NULL;
 		lastframe = -1;
 	}
-	else if (sv.framenum - client->lastframe >= (UPDATE_BACKUP - 3))
+	else if (sv.framenum - client->lastframe >=
+			(UPDATE_BACKUP - 3) * sv.framerate / 10)
 	{
-		/* client hasn't gotten a good message through in a long time */
+		/* client hasn't gotten a good message through in a long time,
+		   that's 1.3 seconds at every sv_fps, the client keeps at
+		   least 1.6 seconds of frames at the same rate */
 		oldframe = NULL;
 		lastframe = -1;
 	}
 	else
 	{
 		/* we have a valid message to delta from */
-		oldframe = &client->frames[client->lastframe & UPDATE_MASK];
+		oldframe = SV_ClientFrame(client, client->lastframe);
 		lastframe = client->lastframe;
 	}
 
@@ -421,7 +593,7 @@ SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
 	SV_WritePlayerstateToClient(oldframe, frame, msg);
 
 	/* delta encode the entities */
-	SV_EmitPacketEntities(oldframe, frame, msg);
+	SV_EmitPacketEntities(client, oldframe, frame, msg, thread);
 }
 
 /*
@@ -429,12 +601,11 @@ SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
  * so we can't use a single PVS point
  */
 void
-SV_FatPVS(vec3_t org)
+SV_FatPVS(vec3_t org, byte *fatpvs)
 {
 	int leafs[64];
 	int i, j, count;
 	int longs;
-	byte *src;
 	vec3_t mins, maxs;
 
 	for (i = 0; i < 3; i++)
@@ -476,21 +647,17 @@ SV_FatPVS(vec3_t org)
 			continue; /* already have the cluster we want */
 		}
 
-		src = CM_ClusterPVS(leafs[i]);
-
-		for (j = 0; j < longs; j++)
-		{
-			((long *)fatpvs)[j] |= ((long *)src)[j];
-		}
+		CM_OrVis(fatpvs, CM_ClusterPVS(leafs[i]), longs << 2);
 	}
 }
 
 /*
  * Decides which entities are going to be visible to the client, and
- * copies off the playerstat and areabits.
+ * copies off the playerstat and areabits. Only the client and its part
+ * of svs.client_entities are written, so this runs on the send threads.
  */
 void
-SV_BuildClientFrame(client_t *client)
+SV_BuildClientFrame(client_t *client, byte *fatpvs)
 {
 	int e, i;
 	vec3_t org;
@@ -513,9 +680,10 @@ SV_BuildClientFrame(client_t *client)
 	}
 
 	/* this is the frame we are creating */
-	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	frame = SV_ClientFrame(client, sv.framenum);
 
 	frame->senttime = svs.realtime; /* save it for ping calc later */
+	frame->sendcount = sv_sendcount;
 
 	/* find the client's PVS */
 	for (i = 0; i < 3; i++)
@@ -534,12 +702,12 @@ SV_BuildClientFrame(client_t *client)
 	/* grab the current player_state_t */
 	frame->ps = clent->client->ps;
 
-	SV_FatPVS(org);
+	SV_FatPVS(org, fatpvs);
 	clientphs = CM_ClusterPHS(clientcluster);
 
 	/* build up the list of visible entities */
 	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
+	frame->first_entity = client->next_entities;
 
 	c_fullsend = 0;
 
@@ -637,8 +805,7 @@ SV_BuildClientFrame(client_t *client)
 		}
 
 		/* add it to the circular client_entities array */
-		state = &svs.client_entities[svs.next_client_entities %
-				svs.num_client_entities];
+		state = SV_ClientEntity(client, client->next_entities);
 
 		if (ent->s.number != e)
 		{
@@ -654,7 +821,7 @@ SV_BuildClientFrame(client_t *client)
 			state->solid = 0;
 		}
 
-		svs.next_client_entities++;
+		client->next_entities++;
 		frame->num_entities++;
 	}
 }
@@ -678,13 +845,20 @@ SV_RecordDemoMessage(void)
 		return;
 	}
 
+	/* demos are always recorded at the game's 10 Hz,
+	   so they play back with any client */
+	if (!PROTOCOL_GAMEFRAME(sv.framenum, sv.framerate))
+	{
+		return;
+	}
+
 	memset(&nostate, 0, sizeof(nostate));
 	SZ_Init(&buf, buf_data, sizeof(buf_data));
 
 	/* write a frame message that doesn't
 	   contain a player_state_t */
 	MSG_WriteByte(&buf, svc_frame);
-	MSG_WriteLong(&buf, sv.framenum);
+	MSG_WriteLong(&buf, sv.framenum / (sv.framerate / 10));
 
 	MSG_WriteByte(&buf, svc_packetentities);
 
@@ -455,6 +455,11 @@ SV_InitGameProgs(void)
 				GAME_API_VERSION);
 	}
 
+	/* a game that keeps its own 100 msec frames when called
+	   in every server frame sets this in Init, older games
+	   are only run every 100 msec */
+	Cvar_FullSet("g_subframes", "0", CVAR_NOSET);
+
 	ge->Init();
 
 	Com_Printf("------------------------------------\n\n");
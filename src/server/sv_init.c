@@ -127,7 +127,6 @@ SV_CheckForSavegame(void)
 {
 	char name[MAX_OSPATH];
 	FILE *f;
-	int i;
 
 	if (sv_noreload->value)
 	{
@@ -164,15 +163,50 @@ SV_CheckForSavegame(void)
 		previousState = sv.state;
 		sv.state = ss_loading;
 
-		for (i = 0; i < 100; i++)
-		{
-			ge->RunFrame();
-		}
+		SV_RunGameFrames(100);
 
 		sv.state = previousState;
 	}
 }
 
+/*
+ * Sizes the frame and entity rings of the clients for
+ * 1.6 seconds of frames at sv.framerate. Every client
+ * gets a full update after a map change, so there is
+ * nothing in them to keep.
+ */
+static void
+SV_AllocClientFrames(void)
+{
+	int backup;
+	int i;
+
+	backup = PROTOCOL_UPDATE_BACKUP(sv.framerate);
+
+	if (svs.client_frames && (backup == svs.update_backup))
+	{
+		return;
+	}
+
+	if (svs.client_frames)
+	{
+		Z_Free(svs.client_frames);
+		Z_Free(svs.client_entities);
+	}
+
+	svs.update_backup = backup;
+	svs.client_frames = Z_Malloc(sizeof(client_frame_t) *
+			maxclients->value * svs.update_backup);
+	svs.num_client_entities = maxclients->value * CLIENT_ENTITIES;
+	svs.client_entities =
+		Z_Malloc(sizeof(entity_state_t) * svs.num_client_entities);
+
+	for (i = 0; i < maxclients->value; i++)
+	{
+		svs.clients[i].next_entities = 0;
+	}
+}
+
 /*
  * Change the server to a new map, taking all connected
  * clients along with it.
@@ -192,6 +226,15 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 	Com_Printf("------- server initialization ------\n");
 	Com_DPrintf("SpawnServer: %s\n", server);
 
+	/* drop whatever was read ahead for the last map */
+	FS_PrefetchFlush();
+
+	/* a new map starts a new timing, whatever
+	   happened to the last one */
+	FS_StopLoadTiming();
+	FS_StartLoadTiming();
+	FS_LoadPhase("map");
+
 	if (sv.demofile)
 	{
 		FS_FCloseFile(sv.demofile);
@@ -239,6 +282,36 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 
 	sv.time = 1000;
 
+	/* the frame rate is fixed for the whole map,
+	   clients learn it from the serverdata */
+	sv.framerate = 10;
+
+	if (serverstate == ss_game)
+	{
+		sv.framerate = ((int)sv_fps->value / 10) * 10;
+
+		if (sv.framerate < 10)
+		{
+			sv.framerate = 10;
+		}
+		else if (sv.framerate > SV_MAX_FRAMERATE)
+		{
+			sv.framerate = SV_MAX_FRAMERATE;
+		}
+
+		if (sv.framerate != sv_fps->value)
+		{
+			Com_Printf("sv_fps must be 10, 20, 30 or 40, using %i\n",
+					sv.framerate);
+		}
+	}
+
+	SV_AllocClientFrames();
+
+	/* the game reads the frame rate when it spawns the map */
+	Cvar_FullSet("sv_framerate", va("%i", sv.framerate), CVAR_NOSET);
+	sv.gamesubframes = (Cvar_VariableValue("g_subframes") != 0);
+
 	strcpy(sv.name, server);
 	strcpy(sv.configstrings[CS_NAME], server);
 
@@ -273,12 +346,13 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 	sv.state = ss_loading;
 	Com_SetServerState(sv.state);
 
+	FS_LoadPhase("entities");
+
 	/* load and spawn all other entities */
 	ge->SpawnEntities(sv.name, CM_EntityString(), spawnpoint);
 
 	/* run two frames to allow everything to settle */
-	ge->RunFrame();
-	ge->RunFrame();
+	SV_RunGameFrames(2);
 
 	/* verify game didn't clobber important stuff */
 	if ((int)checksum !=
@@ -291,6 +365,15 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 	sv.state = serverstate;
 	Com_SetServerState(sv.state);
 
+	/* the local client is going to load everything
+	   the game precached, start reading it ahead */
+	if (!dedicated->value)
+	{
+		FS_PrefetchConfigstrings(sv.configstrings);
+	}
+
+	FS_LoadPhase("baseline");
+
 	/* create a baseline for more efficient communications */
 	SV_CreateBaseline();
 
@@ -300,6 +383,16 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 	/* set serverinfo variable */
 	Cvar_FullSet("mapname", sv.name, CVAR_SERVERINFO | CVAR_NOSET);
 
+	if (dedicated->value || (serverstate != ss_game))
+	{
+		FS_StopLoadTiming();
+	}
+	else
+	{
+		/* the client continues timing */
+		FS_LoadPhase("connect");
+	}
+
 	Com_Printf("------------------------------------\n\n");
 }
 
@@ -376,9 +469,6 @@ SV_InitGame(void)
 
 	svs.spawncount = randk();
 	svs.clients = Z_Malloc(sizeof(client_t) * maxclients->value);
-	svs.num_client_entities = maxclients->value * UPDATE_BACKUP * 64;
-	svs.client_entities =
-		Z_Malloc( sizeof(entity_state_t) * svs.num_client_entities);
 
 	/* init network stuff */
 	NET_Config((maxclients->value > 1));
@@ -502,6 +592,7 @@ SV_Map(qboolean attractloop, char *levelstring, qboolean loadgame)
 #endif
 		SV_BroadcastCommand("changing\n");
 		SV_SendClientMessages();
+		NET_FlushPackets(); /* before the map loads */
 		SV_SpawnServer(level, spawnpoint, ss_game, attractloop, loadgame);
 		Cbuf_CopyToDefer();
 	}
@@ -47,6 +47,25 @@ cvar_t *sv_airaccelerate;
 cvar_t *sv_noreload; /* don't reload level state when reentering */
 cvar_t *maxclients; /* rename sv_maxclients */
 cvar_t *sv_showclamp;
+cvar_t *sv_showlinks;
+cvar_t *sv_threads; /* threads building client frames */
+cvar_t *sv_deltacache; /* share encoded entity deltas between clients */
+cvar_t *sv_fps; /* server frames per second, read at map start */
+
+/* deviation of the time between two server
+   frames from the frame length, in microseconds */
+#define TICK_BUCKETS 8
+static const int sv_tickbuckets[TICK_BUCKETS - 1] = {
+	100, 250, 500, 1000, 2000, 5000, 10000
+};
+static int sv_tickhist[TICK_BUCKETS];
+static long long sv_lasttick, sv_tickjitter, sv_tickmaxjitter;
+static int sv_ticks;
+
+/* cpu time spent in server frames, split by
+   whether the game ran or only clients were sent */
+static long long sv_tickcost[2], sv_tickmaxcost;
+static int sv_costticks[2];
 cvar_t *hostname;
 cvar_t *public_server; /* should heartbeats be sent */
 
@@ -176,7 +195,8 @@ SV_GiveMsec(void)
 	int i;
 	client_t *cl;
 
-	if (sv.framenum & 15)
+	/* every 16 game frames, regardless of sv_fps */
+	if (sv.framenum % (16 * sv.framerate / 10))
 	{
 		return;
 	}
@@ -310,6 +330,105 @@ SV_CheckTimeouts(void)
 	}
 }
 
+static void
+SV_RecordTick(void)
+{
+	long long now, jitter;
+	int i;
+
+	now = Sys_Microseconds();
+	jitter = now - sv_lasttick - 1000LL *
+		(SV_FRAMETIME(sv.framenum + 1) - SV_FRAMETIME(sv.framenum));
+
+	if (!sv_lasttick || (jitter > 1000000))
+	{
+		sv_lasttick = now;
+		return; /* first frame or a map load */
+	}
+
+	sv_lasttick = now;
+
+	jitter = jitter < 0 ? -jitter : jitter;
+
+	for (i = 0; i < TICK_BUCKETS - 1; i++)
+	{
+		if (jitter < sv_tickbuckets[i])
+		{
+			break;
+		}
+	}
+
+	sv_tickhist[i]++;
+	sv_tickjitter += jitter;
+	sv_ticks++;
+
+	if (jitter > sv_tickmaxjitter)
+	{
+		sv_tickmaxjitter = jitter;
+	}
+}
+
+static void
+SV_RecordTickCost(long long start, qboolean gameframe)
+{
+	long long cost;
+
+	cost = Sys_Microseconds() - start;
+
+	sv_tickcost[gameframe] += cost;
+	sv_costticks[gameframe]++;
+
+	if (cost > sv_tickmaxcost)
+	{
+		sv_tickmaxcost = cost;
+	}
+}
+
+void
+SV_TickJitter_f(void)
+{
+	int i;
+
+	if (!sv_ticks)
+	{
+		Com_Printf("No ticks recorded.\n");
+		return;
+	}
+
+	Com_Printf("%i ticks at %i Hz, mean jitter %lld us, max %lld us\n",
+			sv_ticks, sv.framerate, sv_tickjitter / sv_ticks, sv_tickmaxjitter);
+
+	for (i = 0; i < TICK_BUCKETS; i++)
+	{
+		if (i < TICK_BUCKETS - 1)
+		{
+			Com_Printf("  < %5i us: %6i\n", sv_tickbuckets[i], sv_tickhist[i]);
+		}
+		else
+		{
+			Com_Printf(" >= %5i us: %6i\n", sv_tickbuckets[i - 1], sv_tickhist[i]);
+		}
+	}
+
+	if (sv_costticks[0] + sv_costticks[1])
+	{
+		Com_Printf("cost per tick %lld us, max %lld us\n",
+				(sv_tickcost[0] + sv_tickcost[1]) /
+				(sv_costticks[0] + sv_costticks[1]), sv_tickmaxcost);
+		Com_Printf("  %6i game frames: %6lld us\n", sv_costticks[1],
+				sv_costticks[1] ? sv_tickcost[1] / sv_costticks[1] : 0);
+		Com_Printf("  %6i subframes:   %6lld us\n", sv_costticks[0],
+				sv_costticks[0] ? sv_tickcost[0] / sv_costticks[0] : 0);
+	}
+
+	memset(sv_tickhist, 0, sizeof(sv_tickhist));
+	sv_tickjitter = sv_tickmaxjitter = 0;
+	sv_ticks = 0;
+	memset(sv_tickcost, 0, sizeof(sv_tickcost));
+	memset(sv_costticks, 0, sizeof(sv_costticks));
+	sv_tickmaxcost = 0;
+}
+
 /*
  * This has to be done before the world logic, because
  * player processing happens outside RunWorldFrame
@@ -329,9 +448,30 @@ SV_PrepWorldFrame(void)
 	}
 }
 
+/*
+ * Runs the game for a number of its 100 msec frames,
+ * for it to settle after spawning or loading a map
+ */
 void
+SV_RunGameFrames(int frames)
+{
+	if (sv.gamesubframes)
+	{
+		frames *= sv.framerate / 10;
+	}
+
+	while (frames-- > 0)
+	{
+		ge->RunFrame();
+	}
+}
+
+qboolean
 SV_RunGameFrame(void)
 {
+	static qboolean paused;
+	qboolean gameframe;
+
 #ifndef DEDICATED_ONLY
 
 	if (host_speeds->value)
@@ -346,12 +486,25 @@ SV_RunGameFrame(void)
 	   compression can get confused when a client
 	   has the "current" frame */
 	sv.framenum++;
-	sv.time = sv.framenum * 100;
+	sv.time = SV_FRAMETIME(sv.framenum);
+
+	/* the game thinks in 100 msec steps. With a higher sv_fps
+	   it runs in every server frame and counts them off itself,
+	   older games only run once a whole game frame is due */
+	gameframe = PROTOCOL_GAMEFRAME(sv.framenum, sv.framerate);
+
+	/* don't run if paused, only whole game frames are
+	   skipped so the game stays in step with the frames */
+	if (PROTOCOL_GAMEFRAME(sv.framenum - 1, sv.framerate))
+	{
+		paused = sv_paused->value && (maxclients->value <= 1);
+	}
 
-	/* don't run if paused */
-	if (!sv_paused->value || (maxclients->value > 1))
+	if ((gameframe || sv.gamesubframes) && !paused)
 	{
+		PROF_BEGIN("ge->RunFrame");
 		ge->RunFrame();
+		PROF_END();
 
 		/* never get more than one tic behind */
 		if (sv.time < svs.realtime)
@@ -365,6 +518,14 @@ SV_RunGameFrame(void)
 		}
 	}
 
+	SV_EndLinkFrame();
+
+	if (sv_showlinks->value)
+	{
+		Com_Printf("%4i links %4i recomputed\n", sv_lastlinkcalls,
+				sv_lastlinkrecomputes);
+	}
+
 #ifndef DEDICATED_ONLY
 
 	if (host_speeds->value)
@@ -373,11 +534,17 @@ SV_RunGameFrame(void)
 	}
 
 #endif
+
+	return gameframe;
 }
 
 void
 SV_Frame(int msec)
 {
+	long long start;
+	qboolean gameframe;
+	int frametime;
+
 #ifndef DEDICATED_ONLY
 	time_before_game = time_after_game = 0;
 #endif
@@ -385,6 +552,7 @@ SV_Frame(int msec)
 	/* if server is not active, do nothing */
 	if (!svs.initialized)
 	{
+		NET_FlushPackets();
 		return;
 	}
 
@@ -397,26 +565,33 @@ SV_Frame(int msec)
 	SV_CheckTimeouts();
 
 	/* get packets from clients */
+	PROF_BEGIN("SV_ReadPackets");
 	SV_ReadPackets();
+	PROF_END();
 
 	/* move autonomous things around if enough time has passed */
 	if (!sv_timedemo->value && (svs.realtime < sv.time))
 	{
 		/* never let the time get too far off */
-		if (sv.time - svs.realtime > 100)
+		frametime = (1000 + sv.framerate - 1) / sv.framerate;
+
+		if (sv.time - svs.realtime > frametime)
 		{
 			if (sv_showclamp->value)
 			{
 				Com_Printf("sv lowclamp\n");
 			}
 
-			svs.realtime = sv.time - 100;
+			svs.realtime = sv.time - frametime;
 		}
 
 		NET_Sleep(sv.time - svs.realtime);
 		return;
 	}
 
+	start = Sys_Microseconds();
+	PROF_BEGIN("SV_Frame");
+
 	/* update ping based on the last known frame from all clients */
 	SV_CalcPings();
 
@@ -424,10 +599,15 @@ SV_Frame(int msec)
 	SV_GiveMsec();
 
 	/* let everything in the world think and move */
-	SV_RunGameFrame();
+	SV_RecordTick();
+	PROF_BEGIN("SV_RunGameFrame");
+	gameframe = SV_RunGameFrame();
+	PROF_END();
 
 	/* send messages back to the clients that had packets read this frame */
+	PROF_BEGIN("SV_SendClientMessages");
 	SV_SendClientMessages();
+	PROF_END();
 
 	/* save the entire world state if recording a serverdemo */
 	SV_RecordDemoMessage();
@@ -437,6 +617,14 @@ SV_Frame(int msec)
 
 	/* clear teleport flags, etc for next frame */
 	SV_PrepWorldFrame();
+
+	/* everything sent this frame goes out now */
+	PROF_BEGIN("NET_FlushPackets");
+	NET_FlushPackets();
+	PROF_END();
+
+	PROF_END();
+	SV_RecordTickCost(start, gameframe);
 }
 
 /*
@@ -598,6 +786,16 @@ SV_Init(void)
 	timeout = Cvar_Get("timeout", "125", 0);
 	zombietime = Cvar_Get("zombietime", "2", 0);
 	sv_showclamp = Cvar_Get("showclamp", "0", 0);
+	sv_showlinks = Cvar_Get("showlinks", "0", 0);
+	sv_threads = Cvar_Get("sv_threads", "1", CVAR_ARCHIVE);
+	sv_deltacache = Cvar_Get("sv_deltacache", "1", 0);
+
+	/* sv_areagrid 0 uses the areanode tree, 1 a loose grid with
+	   an automatic cell size and larger values set the cell size */
+	sv_areagrid = Cvar_Get("sv_areagrid", "0", CVAR_LATCH);
+	sv_linkcache = Cvar_Get("sv_linkcache", "1", 0);
+
+	sv_fps = Cvar_Get("sv_fps", "10", CVAR_SERVERINFO);
 	sv_paused = Cvar_Get("paused", "0", 0);
 	sv_timedemo = Cvar_Get("timedemo", "0", 0);
 	sv_enforcetime = Cvar_Get("sv_enforcetime", "0", 0);
@@ -673,9 +871,12 @@ SV_Shutdown(char *finalmsg, qboolean reconnect)
 	if (svs.clients)
 	{
 		SV_FinalMessage(finalmsg, reconnect);
+		NET_FlushPackets();
 	}
 
 	Master_Shutdown();
+	SV_StopSendThreads();
+	SV_AllocDeltaCaches(0);
 	SV_ShutdownGameProgs();
 
 	/* free current level */
@@ -698,6 +899,11 @@ SV_Shutdown(char *finalmsg, qboolean reconnect)
 		Z_Free(svs.client_entities);
 	}
 
+	if (svs.client_frames)
+	{
+		Z_Free(svs.client_frames);
+	}
+
 	if (svs.demofile)
 	{
 		fclose(svs.demofile);
@@ -27,6 +27,28 @@
 #include "header/server.h"
 
 char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
+int sv_sendcount;
+
+/* frames are built by the main thread and sv_threads - 1
+   workers, then the datagrams are sent from the main thread */
+static void *sv_sendthreads[MAX_SEND_THREADS];
+static int sv_numsendthreads;
+static void *sv_sendmutex;
+static void *sv_sendcond; /* new clients to build */
+static void *sv_senddonecond; /* all frames built */
+static int sv_sendgeneration;
+static qboolean sv_sendquit;
+
+static client_t *sv_sendclients[MAX_CLIENTS];
+static int sv_numsendclients;
+static int sv_numsendjobs; /* clients handed to the workers */
+static int sv_sendnext; /* next client to build */
+static int sv_sendbusy; /* clients being built right now */
+static byte sv_fatpvs[MAX_SEND_THREADS][65536 / 8];
+
+/* per phase timing, in microseconds */
+static int sv_sendframes, sv_sendclientframes;
+static long long sv_preparetime, sv_buildtime, sv_transmittime;
 
 void
 SV_FlushRedirect(int sv_redirected, char *outputbuf)
@@ -415,20 +437,30 @@ SV_StartSound(vec3_t origin, edict_t *entity, int channel, int soundindex,
 	}
 }
 
-qboolean
-SV_SendClientDatagram(client_t *client)
+/*
+ * Builds the client's frame and writes it to client->framemsg.
+ * Called from the send threads, see SV_BuildClientFrame.
+ */
+static void
+SV_BuildClientDatagram(client_t *client, int thread)
 {
-	byte msg_buf[MAX_MSGLEN];
-	sizebuf_t msg;
+	SV_BuildClientFrame(client, sv_fatpvs[thread]);
 
-	SV_BuildClientFrame(client);
-
-	SZ_Init(&msg, msg_buf, sizeof(msg_buf));
-	msg.allowoverflow = true;
+	SZ_Init(&client->framemsg, client->framemsg_buf,
+			sizeof(client->framemsg_buf));
+	client->framemsg.allowoverflow = true;
 
 	/* send over all the relevant entity_state_t
 	   and the player_state_t */
-	SV_WriteFrameToClient(client, &msg);
+	SV_WriteFrameToClient(client, &client->framemsg, thread);
+}
+
+qboolean
+SV_SendClientDatagram(client_t *client)
+{
+	sizebuf_t *msg;
+
+	msg = &client->framemsg;
 
 	/* copy the accumulated multicast datagram
 	   for this client out to the message
@@ -440,27 +472,187 @@ SV_SendClientDatagram(client_t *client)
 	}
 	else
 	{
-		SZ_Write(&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write(msg, client->datagram.data, client->datagram.cursize);
 	}
 
 	SZ_Clear(&client->datagram);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{
 		/* must have room left for the packet header */
 		Com_Printf("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear(&msg);
+		SZ_Clear(msg);
 	}
 
 	/* send the datagram */
-	Netchan_Transmit(&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit(&client->netchan, msg->cursize, msg->data);
 
 	/* record the size for rate estimation */
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	client->message_size[sv.framenum % RATE_MESSAGES] = msg->cursize;
 
 	return true;
 }
 
+/*
+ * Builds frames until all clients are taken.
+ * Called with sv_sendmutex held. Only sv_numsendjobs
+ * is looked at, sv_numsendclients and the list grow
+ * without the lock while the next frame is prepared.
+ */
+static void
+SV_BuildClientDatagrams(int thread)
+{
+	client_t *c;
+
+	while (sv_sendnext < sv_numsendjobs)
+	{
+		c = sv_sendclients[sv_sendnext++];
+		sv_sendbusy++;
+
+		Sys_UnlockMutex(sv_sendmutex);
+		PROF_BEGIN("SV_BuildClientDatagram");
+		SV_BuildClientDatagram(c, thread);
+		PROF_END();
+		Sys_LockMutex(sv_sendmutex);
+
+		sv_sendbusy--;
+	}
+
+	if (!sv_sendbusy)
+	{
+		Sys_BroadcastCond(sv_senddonecond);
+	}
+}
+
+static void
+SV_SendWorker(void *arg)
+{
+	int thread, generation;
+	char name[32];
+
+	thread = (int)(size_t)arg;
+	generation = 0;
+
+	Com_sprintf(name, sizeof(name), "sv_send %i", thread);
+	Prof_ThreadName(name);
+
+	Sys_LockMutex(sv_sendmutex);
+
+	while (1)
+	{
+		while (!sv_sendquit && (generation == sv_sendgeneration))
+		{
+			Sys_WaitCond(sv_sendcond, sv_sendmutex);
+		}
+
+		if (sv_sendquit)
+		{
+			break;
+		}
+
+		generation = sv_sendgeneration;
+		SV_BuildClientDatagrams(thread);
+	}
+
+	Sys_UnlockMutex(sv_sendmutex);
+
+	Prof_ThreadExit();
+}
+
+void
+SV_StopSendThreads(void)
+{
+	int i;
+
+	if (!sv_numsendthreads)
+	{
+		return;
+	}
+
+	Sys_LockMutex(sv_sendmutex);
+	sv_sendquit = true;
+	Sys_BroadcastCond(sv_sendcond);
+	Sys_UnlockMutex(sv_sendmutex);
+
+	for (i = 1; i < sv_numsendthreads; i++)
+	{
+		Sys_WaitThread(sv_sendthreads[i]);
+	}
+
+	Sys_DestroyCond(sv_senddonecond);
+	Sys_DestroyCond(sv_sendcond);
+	Sys_DestroyMutex(sv_sendmutex);
+
+	sv_numsendthreads = 0;
+	sv_sendquit = false;
+}
+
+static void
+SV_StartSendThreads(int count)
+{
+	int i;
+
+	SV_StopSendThreads();
+
+	if (count < 2)
+	{
+		return;
+	}
+
+	sv_sendmutex = Sys_CreateMutex();
+	sv_sendcond = Sys_CreateCond();
+	sv_senddonecond = Sys_CreateCond();
+
+	/* slot 0 is the main thread */
+	for (i = 1; i < count; i++)
+	{
+		sv_sendthreads[i] = Sys_CreateThread(SV_SendWorker, (void *)(size_t)i);
+
+		if (sv_sendthreads[i] == NULL)
+		{
+			break;
+		}
+	}
+
+	sv_numsendthreads = i;
+
+	if (i < count)
+	{
+		/* keep what we got, and don't retry every frame */
+		Com_Printf("SV_StartSendThreads: couldn't create thread %i.\n", i);
+		Cvar_SetValue("sv_threads", i);
+
+		if (i < 2)
+		{
+			SV_StopSendThreads();
+		}
+	}
+}
+
+void
+SV_SendStats_f(void)
+{
+	if (!sv_sendframes)
+	{
+		Com_Printf("No frames sent.\n");
+		return;
+	}
+
+	Com_Printf("%i frames, %.1f clients per frame, %i threads%s\n",
+			sv_sendframes, (float)sv_sendclientframes / sv_sendframes,
+			sv_numsendthreads ? sv_numsendthreads : 1,
+			(sv_numsendthreads && !CM_VisCached()) ? " (serial, no PVS/PHS cache)" : "");
+	Com_Printf("prepare %.1f us, build %.1f us, transmit %.1f us per frame\n",
+			(double)sv_preparetime / sv_sendframes,
+			(double)sv_buildtime / sv_sendframes,
+			(double)sv_transmittime / sv_sendframes);
+
+	SV_DeltaStats(sv_sendframes);
+
+	sv_sendframes = sv_sendclientframes = 0;
+	sv_preparetime = sv_buildtime = sv_transmittime = 0;
+}
+
 void
 SV_DemoCompleted(void)
 {
@@ -496,7 +688,9 @@ SV_RateDrop(client_t *c)
 		total += c->message_size[i];
 	}
 
-	if (total > c->rate)
+	/* the last RATE_MESSAGES frames cover less
+	   than a second when sv_fps is above 10 */
+	if (total > c->rate * RATE_MESSAGES / sv.framerate)
 	{
 		c->surpressCount++;
 		c->message_size[sv.framenum % RATE_MESSAGES] = 0;
@@ -514,6 +708,8 @@ SV_SendClientMessages(void)
 	int msglen;
 	byte msgbuf[MAX_MSGLEN];
 	size_t r;
+	long long start;
+	int threads;
 
 	msglen = 0;
 
@@ -559,7 +755,23 @@ SV_SendClientMessages(void)
 		}
 	}
 
-	/* send a message to each connected client */
+	threads = (int)sv_threads->value;
+	threads = threads < 1 ? 1 : (threads > MAX_SEND_THREADS ? MAX_SEND_THREADS : threads);
+
+	if (threads != (sv_numsendthreads ? sv_numsendthreads : 1))
+	{
+		SV_StartSendThreads(threads);
+	}
+
+	SV_AllocDeltaCaches(sv_deltacache->value ?
+			(sv_numsendthreads ? sv_numsendthreads : 1) : 0);
+
+	start = Sys_Microseconds();
+	sv_numsendclients = 0;
+	sv_sendcount++;
+
+	/* send a message to each connected client,
+	   spawned clients get their frames built below */
 	for (i = 0, c = svs.clients; i < maxclients->value; i++, c++)
 	{
 		if (!c->state)
@@ -592,7 +804,7 @@ SV_SendClientMessages(void)
 				continue;
 			}
 
-			SV_SendClientDatagram(c);
+			sv_sendclients[sv_numsendclients++] = c;
 		}
 		else
 		{
@@ -604,5 +816,53 @@ SV_SendClientMessages(void)
 			}
 		}
 	}
+
+	sv_preparetime += Sys_Microseconds() - start;
+	start = Sys_Microseconds();
+
+	/* without the vis cache CM_ClusterPVS/PHS
+	   share their rows, so stay serial then */
+	if (sv_numsendthreads && CM_VisCached() && (sv_numsendclients > 1))
+	{
+		Sys_LockMutex(sv_sendmutex);
+
+		sv_numsendjobs = sv_numsendclients;
+		sv_sendnext = 0;
+		sv_sendgeneration++;
+		Sys_BroadcastCond(sv_sendcond);
+
+		SV_BuildClientDatagrams(0);
+
+		while (sv_sendbusy)
+		{
+			Sys_WaitCond(sv_senddonecond, sv_sendmutex);
+		}
+
+		Sys_UnlockMutex(sv_sendmutex);
+	}
+	else
+	{
+		for (i = 0; i < sv_numsendclients; i++)
+		{
+			PROF_BEGIN("SV_BuildClientDatagram");
+			SV_BuildClientDatagram(sv_sendclients[i], 0);
+			PROF_END();
+		}
+	}
+
+	sv_buildtime += Sys_Microseconds() - start;
+	start = Sys_Microseconds();
+	PROF_BEGIN("SV_SendClientDatagrams");
+
+	for (i = 0; i < sv_numsendclients; i++)
+	{
+		SV_SendClientDatagram(sv_sendclients[i]);
+	}
+
+	PROF_END();
+
+	sv_transmittime += Sys_Microseconds() - start;
+	sv_sendframes++;
+	sv_sendclientframes += sv_numsendclients;
 }
 
@@ -76,7 +76,8 @@ SV_New_f(void)
 
 	/* send the serverdata */
 	MSG_WriteByte(&sv_client->netchan.message, svc_serverdata);
-	MSG_WriteLong(&sv_client->netchan.message, PROTOCOL_VERSION);
+	MSG_WriteLong(&sv_client->netchan.message,
+			PROTOCOL_FRAMERATE(sv.framerate));
 	MSG_WriteLong(&sv_client->netchan.message, svs.spawncount);
 	MSG_WriteByte(&sv_client->netchan.message, sv.attractloop);
 	MSG_WriteString(&sv_client->netchan.message, gamedir);
@@ -567,7 +568,7 @@ SV_ExecuteClientMessage(client_t *cl)
 					if (cl->lastframe > 0)
 					{
 						cl->frame_latency[cl->lastframe & (LATENCY_COUNTS - 1)] =
-							svs.realtime - cl->frames[cl->lastframe & UPDATE_MASK].senttime;
+							svs.realtime - SV_ClientFrame(cl, cl->lastframe)->senttime;
 					}
 				}
 
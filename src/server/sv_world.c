@@ -30,6 +30,13 @@
 #define AREA_NODES 32
 #define MAX_TOTAL_ENT_LEAFS 128
 
+/* loose grid, at most AREA_GRID_CELLS cells per axis. The
+   automatic cell size aims for AREA_GRID_AUTOCELLS cells per
+   axis, but no cell gets smaller than AREA_GRID_MINSIZE units */
+#define AREA_GRID_CELLS 64
+#define AREA_GRID_AUTOCELLS 32
+#define AREA_GRID_MINSIZE 256
+
 #define STRUCT_FROM_LINK(l, t, m) ((t *)((byte *)l - (byte *)&(((t *)NULL)->m)))
 #define EDICT_FROM_AREA(l) STRUCT_FROM_LINK(l, edict_t, area)
 
@@ -45,6 +52,46 @@ typedef struct areanode_s
 areanode_t sv_areanodes[AREA_NODES];
 int sv_numareanodes;
 
+/* The loose grid sorts edicts into the cell that holds
+   the center of their box. Cells are treated as being
+   half a cell larger on each side, so an edict that is
+   no larger than a cell never sticks out of its cell.
+   Larger edicts go into sv_arealarge. Only x and y are
+   used, like the areanode tree does. */
+cvar_t *sv_areagrid;
+qboolean sv_usegrid;
+areanode_t sv_areacells[AREA_GRID_CELLS * AREA_GRID_CELLS];
+areanode_t sv_arealarge;
+int sv_areacols, sv_arearows;
+float sv_areacellsize;
+float sv_areaorigin[2];
+
+/* statistics for sv_areastats */
+int sv_areaqueries;
+int sv_areamaxnodes;
+long long sv_areanodesvisited;
+long long sv_areachecks;
+int area_nodes;
+
+/* The leafs, clusters and areas of an edict only depend
+   on its abs box, so they are kept when an edict gets
+   relinked without moving. linkcount is remembered to
+   notice edicts that were freed and reset by the game. */
+typedef struct
+{
+	vec3_t absmin, absmax;
+	int linkcount;
+} edictlink_t;
+
+cvar_t *sv_linkcache;
+edictlink_t sv_edictlinks[MAX_EDICTS];
+
+/* link calls and leaf recomputations, for the current
+   frame, the last finished frame and since sv_areastats */
+int sv_linkcalls, sv_linkrecomputes;
+int sv_lastlinkcalls, sv_lastlinkrecomputes;
+long long sv_totallinkcalls, sv_totallinkrecomputes;
+
 float *area_mins, *area_maxs;
 edict_t **area_list;
 int area_count, area_maxcount;
@@ -123,12 +170,109 @@ SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+/*
+ * Sizes the loose grid for the given world size. A
+ * cellsize of 0 picks one from the world size.
+ */
+void
+SV_CreateAreaGrid(vec3_t mins, vec3_t maxs, float cellsize)
+{
+	int i;
+	float size;
+
+	size = maxs[0] - mins[0] > maxs[1] - mins[1] ?
+		maxs[0] - mins[0] : maxs[1] - mins[1];
+
+	if (cellsize <= 0)
+	{
+		cellsize = size / AREA_GRID_AUTOCELLS;
+
+		if (cellsize < AREA_GRID_MINSIZE)
+		{
+			cellsize = AREA_GRID_MINSIZE;
+		}
+	}
+
+	/* the grid must not get larger than sv_areacells */
+	if (cellsize < size / AREA_GRID_CELLS)
+	{
+		cellsize = size / AREA_GRID_CELLS;
+	}
+
+	sv_areacellsize = cellsize;
+
+	sv_areaorigin[0] = mins[0];
+	sv_areaorigin[1] = mins[1];
+	sv_areacols = (int)ceil((maxs[0] - mins[0]) / sv_areacellsize);
+	sv_arearows = (int)ceil((maxs[1] - mins[1]) / sv_areacellsize);
+	sv_areacols = sv_areacols < 1 ? 1 : (sv_areacols > AREA_GRID_CELLS ?
+			AREA_GRID_CELLS : sv_areacols);
+	sv_arearows = sv_arearows < 1 ? 1 : (sv_arearows > AREA_GRID_CELLS ?
+			AREA_GRID_CELLS : sv_arearows);
+
+	for (i = 0; i < sv_areacols * sv_arearows; i++)
+	{
+		sv_areacells[i].axis = -1;
+		ClearLink(&sv_areacells[i].trigger_edicts);
+		ClearLink(&sv_areacells[i].solid_edicts);
+	}
+
+	sv_arealarge.axis = -1;
+	ClearLink(&sv_arealarge.trigger_edicts);
+	ClearLink(&sv_arealarge.solid_edicts);
+}
+
+/*
+ * Returns the grid column (axis 0) or row
+ * (axis 1) for v, clamped to the grid
+ */
+static int
+SV_AreaGridIndex(float v, int axis)
+{
+	int i, max;
+
+	i = (int)floor((v - sv_areaorigin[axis]) / sv_areacellsize);
+	max = axis ? sv_arearows : sv_areacols;
+
+	if (i < 0)
+	{
+		return 0;
+	}
+
+	if (i >= max)
+	{
+		return max - 1;
+	}
+
+	return i;
+}
+
 void
 SV_ClearWorld(void)
 {
+	sv_usegrid = sv_areagrid->value > 0;
+
+	memset(sv_edictlinks, 0, sizeof(sv_edictlinks));
+
 	memset(sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
-	SV_CreateAreaNode(0, sv.models[1]->mins, sv.models[1]->maxs);
+
+	if (sv_usegrid)
+	{
+		SV_CreateAreaGrid(sv.models[1]->mins, sv.models[1]->maxs,
+				sv_areagrid->value > 1 ? sv_areagrid->value : 0);
+	}
+	else
+	{
+		SV_CreateAreaNode(0, sv.models[1]->mins, sv.models[1]->maxs);
+	}
+
+	sv_areaqueries = 0;
+	sv_areamaxnodes = 0;
+	sv_areanodesvisited = 0;
+	sv_areachecks = 0;
+	sv_totallinkcalls = 0;
+	sv_totallinkrecomputes = 0;
 }
 
 void
@@ -143,17 +287,104 @@ SV_UnlinkEdict(edict_t *ent)
 	ent->area.prev = ent->area.next = NULL;
 }
 
-void
-SV_LinkEdict(edict_t *ent)
+/*
+ * Finds the PVS clusters and areas touched by the abs box
+ */
+static void
+SV_FindEdictLeafs(edict_t *ent)
 {
-	areanode_t *node;
 	int leafs[MAX_TOTAL_ENT_LEAFS];
 	int clusters[MAX_TOTAL_ENT_LEAFS];
 	int num_leafs;
-	int i, j, k;
+	int i, j;
 	int area;
 	int topnode;
 
+	/* link to PVS leafs */
+	ent->num_clusters = 0;
+	ent->areanum = 0;
+	ent->areanum2 = 0;
+
+	/* get all leafs, including solids */
+	num_leafs = CM_BoxLeafnums(ent->absmin, ent->absmax,
+			leafs, MAX_TOTAL_ENT_LEAFS, &topnode);
+
+	/* set areas */
+	for (i = 0; i < num_leafs; i++)
+	{
+		clusters[i] = CM_LeafCluster(leafs[i]);
+		area = CM_LeafArea(leafs[i]);
+
+		if (area)
+		{
+			/* doors may legally straggle two areas,
+			   but nothing should evern need more than that */
+			if (ent->areanum && (ent->areanum != area))
+			{
+				if (ent->areanum2 && (ent->areanum2 != area) &&
+					(sv.state == ss_loading))
+				{
+					Com_DPrintf("Object touching 3 areas at %f %f %f\n",
+							ent->absmin[0], ent->absmin[1], ent->absmin[2]);
+				}
+
+				ent->areanum2 = area;
+			}
+			else
+			{
+				ent->areanum = area;
+			}
+		}
+	}
+
+	if (num_leafs >= MAX_TOTAL_ENT_LEAFS)
+	{
+		/* assume we missed some leafs, and mark by headnode */
+		ent->num_clusters = -1;
+		ent->headnode = topnode;
+	}
+	else
+	{
+		ent->num_clusters = 0;
+
+		for (i = 0; i < num_leafs; i++)
+		{
+			if (clusters[i] == -1)
+			{
+				continue; /* not a visible leaf */
+			}
+
+			for (j = 0; j < i; j++)
+			{
+				if (clusters[j] == clusters[i])
+				{
+					break;
+				}
+			}
+
+			if (j == i)
+			{
+				if (ent->num_clusters == MAX_ENT_CLUSTERS)
+				{
+					/* assume we missed some leafs, and mark by headnode */
+					ent->num_clusters = -1;
+					ent->headnode = topnode;
+					break;
+				}
+
+				ent->clusternums[ent->num_clusters++] = clusters[i];
+			}
+		}
+	}
+}
+
+void
+SV_LinkEdict(edict_t *ent)
+{
+	areanode_t *node;
+	int i, j, k;
+	int num;
+
 	if (ent->area.prev)
 	{
 		SV_UnlinkEdict(ent); /* unlink from old position */
@@ -275,80 +506,25 @@ SV_LinkEdict(edict_t *ent)
 	ent->absmax[1] += 1;
 	ent->absmax[2] += 1;
 
-	/* link to PVS leafs */
-	ent->num_clusters = 0;
-	ent->areanum = 0;
-	ent->areanum2 = 0;
-
-	/* get all leafs, including solids */
-	num_leafs = CM_BoxLeafnums(ent->absmin, ent->absmax,
-			leafs, MAX_TOTAL_ENT_LEAFS, &topnode);
-
-	/* set areas */
-	for (i = 0; i < num_leafs; i++)
-	{
-		clusters[i] = CM_LeafCluster(leafs[i]);
-		area = CM_LeafArea(leafs[i]);
-
-		if (area)
-		{
-			/* doors may legally straggle two areas,
-			   but nothing should evern need more than that */
-			if (ent->areanum && (ent->areanum != area))
-			{
-				if (ent->areanum2 && (ent->areanum2 != area) &&
-					(sv.state == ss_loading))
-				{
-					Com_DPrintf("Object touching 3 areas at %f %f %f\n",
-							ent->absmin[0], ent->absmin[1], ent->absmin[2]);
-				}
-
-				ent->areanum2 = area;
-			}
-			else
-			{
-				ent->areanum = area;
-			}
-		}
-	}
+	sv_linkcalls++;
+	num = NUM_FOR_EDICT(ent);
 
-	if (num_leafs >= MAX_TOTAL_ENT_LEAFS)
+	if (sv_linkcache->value && (num < MAX_EDICTS) &&
+		(sv_edictlinks[num].linkcount == ent->linkcount) &&
+		VectorCompare(sv_edictlinks[num].absmin, ent->absmin) &&
+		VectorCompare(sv_edictlinks[num].absmax, ent->absmax))
 	{
-		/* assume we missed some leafs, and mark by headnode */
-		ent->num_clusters = -1;
-		ent->headnode = topnode;
+		/* didn't move, the old leafs are still valid */
 	}
 	else
 	{
-		ent->num_clusters = 0;
+		SV_FindEdictLeafs(ent);
+		sv_linkrecomputes++;
 
-		for (i = 0; i < num_leafs; i++)
+		if (num < MAX_EDICTS)
 		{
-			if (clusters[i] == -1)
-			{
-				continue; /* not a visible leaf */
-			}
-
-			for (j = 0; j < i; j++)
-			{
-				if (clusters[j] == clusters[i])
-				{
-					break;
-				}
-			}
-
-			if (j == i)
-			{
-				if (ent->num_clusters == MAX_ENT_CLUSTERS)
-				{
-					/* assume we missed some leafs, and mark by headnode */
-					ent->num_clusters = -1;
-					ent->headnode = topnode;
-					break;
-				}
-
-				ent->clusternums[ent->num_clusters++] = clusters[i];
-			}
+			VectorCopy(ent->absmin, sv_edictlinks[num].absmin);
+			VectorCopy(ent->absmax, sv_edictlinks[num].absmax);
 		}
 	}
 
@@ -360,32 +536,55 @@ SV_LinkEdict(edict_t *ent)
 
 	ent->linkcount++;
 
+	if (num < MAX_EDICTS)
+	{
+		sv_edictlinks[num].linkcount = ent->linkcount;
+	}
+
 	if (ent->solid == SOLID_NOT)
 	{
 		return;
 	}
 
-	/* find the first node that the ent's box crosses */
-	node = sv_areanodes;
-
-	while (1)
+	if (sv_usegrid)
 	{
-		if (node->axis == -1)
-		{
-			break;
-		}
-
-		if (ent->absmin[node->axis] > node->dist)
+		/* find the cell that holds the center of the ent's box */
+		if ((ent->absmax[0] - ent->absmin[0] > sv_areacellsize) ||
+			(ent->absmax[1] - ent->absmin[1] > sv_areacellsize))
 		{
-			node = node->children[0];
+			node = &sv_arealarge;
 		}
-		else if (ent->absmax[node->axis] < node->dist)
+		else
 		{
-			node = node->children[1];
+			node = &sv_areacells[SV_AreaGridIndex(0.5f *
+					(ent->absmin[1] + ent->absmax[1]), 1) * sv_areacols +
+				SV_AreaGridIndex(0.5f * (ent->absmin[0] + ent->absmax[0]), 0)];
 		}
-		else
+	}
+	else
+	{
+		/* find the first node that the ent's box crosses */
+		node = sv_areanodes;
+
+		while (1)
 		{
-			break; /* crosses the node */
+			if (node->axis == -1)
+			{
+				break;
+			}
+
+			if (ent->absmin[node->axis] > node->dist)
+			{
+				node = node->children[0];
+			}
+			else if (ent->absmax[node->axis] < node->dist)
+			{
+				node = node->children[1];
+			}
+			else
+			{
+				break; /* crosses the node */
+			}
 		}
 	}
 
@@ -400,12 +599,18 @@ SV_LinkEdict(edict_t *ent)
 	}
 }
 
-void
-SV_AreaEdicts_r(areanode_t *node)
+/*
+ * Adds the edicts linked to node that touch the area box,
+ * returns false when the list is full
+ */
+qboolean
+SV_AreaEdictsInNode(areanode_t *node)
 {
 	link_t *l, *next, *start;
 	edict_t *check;
 
+	area_nodes++;
+
 	/* touch linked edicts */
 	if (area_type == AREA_SOLID)
 	{
@@ -420,6 +625,7 @@ SV_AreaEdicts_r(areanode_t *node)
 	{
 		next = l->next;
 		check = (EDICT_FROM_AREA(l));
+		sv_areachecks++;
 
 		if (check->solid == SOLID_NOT)
 		{
@@ -439,13 +645,24 @@ SV_AreaEdicts_r(areanode_t *node)
 		if (area_count == area_maxcount)
 		{
 			Com_Printf("SV_AreaEdicts: MAXCOUNT\n");
-			return;
+			return false;
 		}
 
 		area_list[area_count] = check;
 		area_count++;
 	}
 
+	return true;
+}
+
+void
+SV_AreaEdicts_r(areanode_t *node)
+{
+	if (!SV_AreaEdictsInNode(node))
+	{
+		return;
+	}
+
 	if (node->axis == -1)
 	{
 		return; /* terminal node */
@@ -463,6 +680,139 @@ SV_AreaEdicts_r(areanode_t *node)
 	}
 }
 
+void
+SV_AreaEdictsGrid(void)
+{
+	int x, y;
+	int x0, x1, y0, y1;
+	float margin;
+
+	if (!SV_AreaEdictsInNode(&sv_arealarge))
+	{
+		return;
+	}
+
+	/* an edict may stick out of its cell
+	   by up to half a cell on each side */
+	margin = 0.5f * sv_areacellsize;
+	x0 = SV_AreaGridIndex(area_mins[0] - margin, 0);
+	x1 = SV_AreaGridIndex(area_maxs[0] + margin, 0);
+	y0 = SV_AreaGridIndex(area_mins[1] - margin, 1);
+	y1 = SV_AreaGridIndex(area_maxs[1] + margin, 1);
+
+	for (y = y0; y <= y1; y++)
+	{
+		for (x = x0; x <= x1; x++)
+		{
+			if (!SV_AreaEdictsInNode(&sv_areacells[y * sv_areacols + x]))
+			{
+				return;
+			}
+		}
+	}
+}
+
+/*
+ * Closes the link statistics of a server frame
+ */
+void
+SV_EndLinkFrame(void)
+{
+	sv_lastlinkcalls = sv_linkcalls;
+	sv_lastlinkrecomputes = sv_linkrecomputes;
+	sv_totallinkcalls += sv_linkcalls;
+	sv_totallinkrecomputes += sv_linkrecomputes;
+	sv_linkcalls = 0;
+	sv_linkrecomputes = 0;
+}
+
+/*
+ * Prints how much work SV_AreaEdicts did since the
+ * map was loaded or the stats were last printed
+ */
+void
+SV_AreaStats_f(void)
+{
+	int count;
+	int i;
+	link_t *l;
+
+	Com_Printf("spatial index: %s\n", sv_usegrid ?
+			va("loose grid, %ix%i cells of %g units", sv_areacols,
+				sv_arearows, sv_areacellsize) :
+			va("areanode tree, %i nodes", sv_numareanodes));
+
+	if (sv_usegrid)
+	{
+		count = 0;
+
+		for (l = sv_arealarge.solid_edicts.next;
+			 l != &sv_arealarge.solid_edicts; l = l->next)
+		{
+			count++;
+		}
+
+		for (l = sv_arealarge.trigger_edicts.next;
+			 l != &sv_arealarge.trigger_edicts; l = l->next)
+		{
+			count++;
+		}
+
+		Com_Printf("%i edicts larger than a cell\n", count);
+	}
+	else
+	{
+		for (i = 0; i < sv_numareanodes; i++)
+		{
+			count = 0;
+
+			for (l = sv_areanodes[i].solid_edicts.next;
+				 l != &sv_areanodes[i].solid_edicts; l = l->next)
+			{
+				count++;
+			}
+
+			for (l = sv_areanodes[i].trigger_edicts.next;
+				 l != &sv_areanodes[i].trigger_edicts; l = l->next)
+			{
+				count++;
+			}
+
+			if (count)
+			{
+				Com_Printf("node %2i (%s): %i edicts\n", i,
+						sv_areanodes[i].axis == -1 ? "leaf" : "split", count);
+			}
+		}
+	}
+
+	if (sv_totallinkcalls)
+	{
+		Com_Printf("%lld link calls, %lld leaf recomputations (%.1f%%), last frame %i/%i\n",
+				sv_totallinkcalls, sv_totallinkrecomputes,
+				100.0 * sv_totallinkrecomputes / sv_totallinkcalls,
+				sv_lastlinkcalls, sv_lastlinkrecomputes);
+	}
+
+	sv_totallinkcalls = 0;
+	sv_totallinkrecomputes = 0;
+
+	if (!sv_areaqueries)
+	{
+		Com_Printf("no queries\n");
+		return;
+	}
+
+	Com_Printf("%i queries, %.2f nodes/query (max %i), %.2f edicts checked/query\n",
+			sv_areaqueries, (double)sv_areanodesvisited / sv_areaqueries,
+			sv_areamaxnodes, (double)sv_areachecks / sv_areaqueries);
+
+	sv_areaqueries = 0;
+	sv_areamaxnodes = 0;
+	sv_areanodesvisited = 0;
+	sv_areachecks = 0;
+}
+
 int
 SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list,
 		int maxcount, int areatype)
@@ -474,7 +824,24 @@ SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list,
 	area_type = areatype;
 	area_count = 0;
 
-	SV_AreaEdicts_r(sv_areanodes);
+	area_nodes = 0;
+
+	if (sv_usegrid)
+	{
+		SV_AreaEdictsGrid();
+	}
+	else
+	{
+		SV_AreaEdicts_r(sv_areanodes);
+	}
+
+	sv_areaqueries++;
+	sv_areanodesvisited += area_nodes;
+
+	if (area_nodes > sv_areamaxnodes)
+	{
+		sv_areamaxnodes = area_nodes;
+	}
 
 	area_mins = 0;
 	area_maxs = 0;